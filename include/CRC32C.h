@@ -0,0 +1,14 @@
+#include <cstdint>
+#include <cstddef>
+
+#pragma once
+
+/**
+ * Extend a CRC-32C (Castagnoli) checksum. Uses the SSE4.2 crc32 instruction when the CPU has it
+ * and a slicing-by-8 table otherwise.
+ * @param crc Checksum of the preceding bytes, 0 to start a new checksum.
+ * @param data The bytes to add.
+ * @param length Number of bytes.
+ * @return The updated checksum.
+ */
+uint32_t crc32c(uint32_t crc, const uint8_t *data, size_t length);
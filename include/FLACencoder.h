@@ -0,0 +1,52 @@
+#include <cstdint>
+#include <vector>
+
+#include "WAVparser.h"
+
+#pragma once
+
+/**
+ * FLAC encoder for 8, 16 and 24 bit integer PCM with up to 8 channels. Every FLAC frame is coded on its own,
+ * trying a constant, verbatim, fixed and LPC subframe per channel (and left/side, side/right and mid/side for
+ * stereo) and keeping the smallest, with a partitioned Rice coded residual. The encoder holds no state between
+ * calls, so consecutive runs of frames can be encoded on different threads and concatenated.
+ */
+class FLAC_encoder_t
+{
+public:
+    // samples per channel in every FLAC frame but the last
+    static const uint32_t block_size = 4096;
+
+private:
+    uint32_t m_sample_rate;
+    uint32_t m_channels;
+    uint32_t m_bits;
+    WAV_fmt_t m_fmt;
+
+    // encode one FLAC frame of n samples per channel, deinterleaved in channels[c][0..n)
+    void encode_frame(const std::vector<std::vector<int32_t>> &channels, uint32_t n, uint64_t number,
+                      std::vector<uint8_t> &out) const;
+
+public:
+    /**
+     * @param fmt Format of the PCM bytes that will be encoded. An exception will be thrown for formats FLAC
+     * can't hold.
+     */
+    FLAC_encoder_t(const WAV_fmt_t &fmt);
+
+    /**
+     * The bytes a FLAC file starts with: the "fLaC" marker and a STREAMINFO block. The MD5 signature and the
+     * frame size bounds are left as unknown.
+     * @param frames Number of sample frames in the stream.
+     */
+    std::vector<uint8_t> stream_header(uint64_t frames) const;
+
+    /**
+     * Encode PCM frames as consecutive FLAC frames of block_size samples, the last one possibly shorter.
+     * @param pcm Interleaved PCM bytes in the format given to the constructor.
+     * @param frames Number of sample frames in pcm.
+     * @param first The number of the first FLAC frame within the stream (the sample offset / block_size).
+     * @param out The FLAC frames are appended to this.
+     */
+    void encode(const uint8_t *pcm, uint32_t frames, uint64_t first, std::vector<uint8_t> &out) const;
+};
@@ -6,37 +6,202 @@
 #include <memory>
 #include <exception>
 
+#include "WAVmemory.h"
+
 #pragma once
 
+// ====================================================================================================================
+/**
+ *  An open file shared by chunks whose payload is kept on disk instead of in memory. Reads are positioned
+ *  (pread) and don't move the descriptor's offset, so any number of threads may read at once.
+ */
+class RIFF_file_t
+{
+private:
+    int m_fd{-1};
+
+    // set instead of a descriptor when the "file" is a buffer in memory
+    const uint8_t *m_memory{nullptr};
+    uint64_t m_memory_size{0};
+
+public:
+    /**
+     * Take ownership of an open file descriptor. The descriptor is closed on destruction.
+     * @param fd The file descriptor to take ownership of.
+     */
+    RIFF_file_t(int fd);
+
+    /**
+     * Read from a buffer in memory instead of a file. The buffer is not copied and must outlive this object.
+     * @param memory The buffer.
+     * @param size Size of the buffer in bytes.
+     */
+    RIFF_file_t(const uint8_t *memory, uint64_t size);
+    RIFF_file_t(const RIFF_file_t&) = delete;
+    ~RIFF_file_t();
+
+    /**
+     * Open an existing file for reading.
+     * @param filename The file to open. An exception will be thrown if the file cannot be opened.
+     */
+    static std::shared_ptr<RIFF_file_t> open(const std::string &filename);
+
+    /**
+     * Create an anonymous temporary file (in $TMPDIR or /tmp) that is removed once it is closed.
+     */
+    static std::shared_ptr<RIFF_file_t> temporary();
+
+    /**
+     * @return The underlying file descriptor, -1 for a buffer in memory.
+     */
+    int fd() const;
+
+    /**
+     * @return The buffer a memory backed file reads from, nullptr for real files.
+     */
+    const uint8_t *memory() const;
+
+    /**
+     * Read up to length bytes at an absolute position.
+     * @return The number of bytes read, 0 at the end of the file.
+     */
+    size_t read_some(uint64_t offset, uint8_t *dst, size_t length) const;
+
+    /**
+     * Read bytes at an absolute position. An exception will be thrown if fewer bytes are available.
+     * @param offset Position in the file to read from.
+     * @param dst Buffer receiving at least length bytes.
+     * @param length The number of bytes to read.
+     */
+    void read(uint64_t offset, uint8_t *dst, size_t length) const;
+
+    /**
+     * Write bytes at an absolute position.
+     * @param offset Position in the file to write to.
+     * @param src The bytes to write.
+     * @param length The number of bytes to write.
+     */
+    void write(uint64_t offset, const uint8_t *src, size_t length);
+};
+
+// ====================================================================================================================
+/**
+ *  Seekable stream buffer reading a RIFF_file_t by position, so a file can be parsed through a std::istream 
+ *  while its payloads are read from the same RIFF_file_t later. The descriptor's own offset is not used.
+ */
+class RIFF_file_streambuf_t : public std::streambuf
+{
+private:
+    std::shared_ptr<RIFF_file_t> m_file;
+    std::vector<char> m_buffer;
+
+    // file position of the first byte in m_buffer
+    uint64_t m_position{0};
+
+protected:
+    int_type underflow();
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which);
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+
+public:
+    RIFF_file_streambuf_t(std::shared_ptr<RIFF_file_t> file);
+};
+
+// ====================================================================================================================
+/**
+ *  Parsing state passed down the chunk tree while a RIFF structure is read. Chunks are read strictly 
+ *  front to back so any std::istream works, including pipes and stdin.
+ */
+struct RIFF_input_t
+{
+    std::istream &stream;
+
+    // number of bytes consumed from the stream so far
+    uint64_t offset{0};
+
+    // payloads larger than this are not held in memory
+    uint32_t max_buffered{UINT32_MAX};
+
+    // the stream's file if it can be read again later, oversized payloads are left in it and skipped
+    std::shared_ptr<RIFF_file_t> file;
+
+    // otherwise oversized payloads are copied here block by block
+    std::shared_ptr<RIFF_file_t> spool;
+    uint64_t spool_size{0};
+
+    RIFF_input_t(std::istream &f, uint32_t max_buffered = UINT32_MAX, std::shared_ptr<RIFF_file_t> file = nullptr);
+
+    /**
+     * Read exactly length bytes. An exception will be thrown if the stream ends early.
+     */
+    void read(void *dst, size_t length);
+
+    /**
+     * Discard length bytes, seeking if the stream is backed by a file.
+     */
+    void skip(uint64_t length);
+
+    /**
+     * Skip the padding byte following an odd sized chunk, whatever its value. A stream ending without it is accepted.
+     */
+    void skip_padding();
+};
+
+class RIFF_chunk_list_t;
+
 // ====================================================================================================================
 /**
  *  A base class for RIFF chunks.
  */
 class RIFF_chunk_t
 {
+private:
+    friend class RIFF_chunk_list_t;
+
+    // the list holding this chunk, attached by the list whenever it computes its size (see RIFF_chunk_list_t)
+    RIFF_chunk_list_t *m_parent{nullptr};
+
 protected:
     uint8_t m_identifier[5]{0};
     uint32_t m_size{0};
 
+    // position of the chunk header in the stream it was read from
+    uint64_t m_offset{0};
+
+    // called whenever the chunk's size may have changed, marks the cached sizes of the lists above it as stale
+    void invalidate_parents();
+
 public:
+    RIFF_chunk_t() = default;
+
+    // a copy belongs to no list
+    RIFF_chunk_t(const RIFF_chunk_t &other);
+
     virtual ~RIFF_chunk_t() = 0;
-    virtual int size() = 0;
-    virtual int total_size() = 0;
-    virtual void print() = 0;
-    virtual void print_full() = 0;
-    virtual int write(std::ofstream &f) = 0;
+    virtual uint32_t size() const = 0;
+    virtual uint64_t total_size() const = 0;
+    virtual void print() const = 0;
+    virtual void print_full() const = 0;
+    virtual uint64_t write(std::ostream &f) = 0;
 
     /**
      * Get the chunk identifier.
      * @return const char * to the chunk identifier.
      */
-    const char *get_identifier();
+    const char *get_identifier() const;
 
     /**
      * Set the chunk identifier.
      * @param new_id The new identifier for this chunk. An exception will be thrown if an identifier with length != 4 is given.
      */
     void set_identifier(const char *new_id);
+
+    /**
+     * Get the position of the chunk header within the file it was read from. Chunks that were not 
+     * read from a file are at offset 0.
+     * @return Byte offset of the chunk identifier.
+     */
+    uint64_t get_offset() const;
 };
 
 // ====================================================================================================================
@@ -46,7 +211,14 @@ public:
 class RIFF_chunk_data_t : public RIFF_chunk_t
 {
 private:
-    std::vector<uint8_t> m_data;
+    byte_vector_t m_data{memory_subsystem_t::riff};
+
+    // set when the payload was left on disk, m_size bytes starting at m_file_offset
+    std::shared_ptr<RIFF_file_t> m_file;
+    uint64_t m_file_offset{0};
+
+    // move a payload left on disk into m_data
+    void load();
 
 public:
     RIFF_chunk_data_t();
@@ -59,7 +231,14 @@ public:
      * @param id Chunk identifier for the new chunk. If nullptr a chunk identifier will be read from the filestream. 
      * An exception will be thrown if an identifier with length != 4 is given.
      */
-    RIFF_chunk_data_t(std::ifstream &f, const char *id = nullptr);
+    RIFF_chunk_data_t(std::istream &f, const char *id = nullptr);
+
+    /**
+     * Construct the chunk data from a RIFF input. Payloads larger than the input's buffering limit are left on disk.
+     * @param in The input to read from.
+     * @param id Chunk identifier for the new chunk. If nullptr a chunk identifier will be read from the input.
+     */
+    RIFF_chunk_data_t(RIFF_input_t &in, const char *id = nullptr);
 
     /**
      * Construct a data chunk with given id.
@@ -76,66 +255,119 @@ public:
      * @param id Chunk identifier for the new chunk. If nullptr a chunk identifier will be read from the filestream.
      * An exception will be thrown if an identifier with length != 4 is given.
      */
-    void read(std::ifstream &f, const char *id);
+    void read(std::istream &f, const char *id);
+
+    /**
+     * Populate the chunk data from a RIFF input. Payloads larger than the input's buffering limit are left on disk.
+     * @param in The input to read from.
+     * @param id Chunk identifier for the new chunk. If nullptr a chunk identifier will be read from the input.
+     */
+    void read(RIFF_input_t &in, const char *id);
 
     /**
      * Write the byte data to the supplied filestream.
      * @param f The filestream to write the bytes to.
      * @return The number of bytes written.
      */
-    int write(std::ofstream &f);
+    uint64_t write(std::ostream &f);
 
     /**
-     * Get the currently held chunk data.
+     * Get the currently held chunk data. A payload left on disk is loaded into memory first. The data may be
+     * changed through the reference, so the lists above the chunk recompute their sizes on the next size query.
      * @return Reference to currently held chunk data.
      */
-    std::vector<uint8_t> &get_data();
+    byte_vector_t &get_data();
+
+    /**
+     * Get the chunk data for reading only. Nothing is loaded, an exception will be thrown if the payload was
+     * left on disk (use read_data() for those).
+     * @return Reference to currently held chunk data.
+     */
+    const byte_vector_t &get_data() const;
+
+    /**
+     * Copy a range of the chunk data without loading a payload left on disk into memory.
+     * @param offset Byte offset into the chunk data.
+     * @param length Number of bytes to copy. An exception will be thrown if the range exceeds the chunk data.
+     * @param dst Buffer receiving the bytes.
+     */
+    void read_data(uint32_t offset, uint32_t length, uint8_t *dst) const;
+
+    /**
+     * @return True if the chunk data is held in memory, false if it was left on disk.
+     */
+    bool is_buffered() const;
+
+    /**
+     * Point the chunk at a payload stored in a file instead of memory. The payload is read on demand.
+     * @param file The file holding the payload.
+     * @param offset Position of the first payload byte in the file.
+     * @param size Number of payload bytes.
+     */
+    void set_file(std::shared_ptr<RIFF_file_t> file, uint64_t offset, uint32_t size);
 
     /**
      * Set the data for the data chunk.
      * @param new_data The data that replaces the currently held chunk data.
      */
     void set_data(const std::vector<uint8_t> &new_data);
+    void set_data(const byte_vector_t &new_data);
 
     /**
      * Get the size of the data in the RIFF file in bytes (exluding header information).
      * @see total_size()
      * @return The test results
      */
-    int size();
+    uint32_t size() const;
 
     /**
      * Get the size of the RIFF file in bytes.
      * @see size()
      * @return The test results
      */
-    int total_size();
+    uint64_t total_size() const;
 
     /**
      * Print basic information about the subchunks.
      */
-    void print();
+    void print() const;
 
     /**
      * Print information about the subchunks along with complete chunk byte data.
      */
-    void print_full();
+    void print_full() const;
 };
 
 // ====================================================================================================================
 /**
  *  RIFF list chunk class. Chunks containing sub chunks (identifier is LIST or RIFF)
+ *
+ *  The sizes of a list are computed once and cached. Subchunks point back at the list, and a change to a
+ *  subchunk's data marks every list above it as stale, so size queries and writing are linear in the number of
+ *  chunks no matter how deeply lists are nested. Subchunks are attached to the list whenever it computes its
+ *  sizes. The non-const get_subchunks() detaches them and marks the list stale, because the vector may be changed
+ *  through the reference it returns.
+ *
+ *  Only update_sizes() and write() refresh the caches. A const size query on a stale list walks its subtree
+ *  instead, so const members never write to the list and may be called from several threads at once.
  */
 class RIFF_chunk_list_t : public RIFF_chunk_t
 {
 private:
+    friend class RIFF_chunk_t;
+
     uint8_t m_form_type[5]{0};
     std::vector<std::unique_ptr<RIFF_chunk_t>> m_subchunks;
 
+    // size() and total_size() of the subchunks as last computed, valid unless m_stale
+    uint32_t m_cached_size{0};
+    uint64_t m_cached_total_size{0};
+    bool m_stale{true};
+
 public:
     RIFF_chunk_list_t();
     RIFF_chunk_list_t(const RIFF_chunk_list_t&) = delete;
-    RIFF_chunk_list_t(RIFF_chunk_list_t&&) = default;
+    RIFF_chunk_list_t(RIFF_chunk_list_t &&other);
 
     /**
      * Construct the chunk list from a file.
@@ -144,7 +376,14 @@ public:
      * RIFF specification says list chunks should have "LIST" as the identifier (excluding the root chunk which should have "RIFF" as the identifier).
      * An exception will be thrown if an identifier with length != 4 is given.
      */
-    RIFF_chunk_list_t(std::ifstream &f, const char *id = nullptr);
+    RIFF_chunk_list_t(std::istream &f, const char *id = nullptr);
+
+    /**
+     * Construct the chunk list from a RIFF input.
+     * @param in The input to read from.
+     * @param id Chunk identifier for the new chunk. If nullptr a chunk identifier will be read from the input.
+     */
+    RIFF_chunk_list_t(RIFF_input_t &in, const char *id = nullptr);
 
     /**
      * Construct a list chunk with a specific form type.
@@ -158,7 +397,7 @@ public:
      * Get the form type of the chunk.
      * @return const char * to the form type.
      */
-    const char *get_form_type();
+    const char *get_form_type() const;
 
     /**
      * Set the form type for the chunk.
@@ -174,51 +413,71 @@ public:
      * RIFF specification says list chunks should have "LIST" as the identifier (excluding the root chunk which should have "RIFF" as the identifier).
      * An exception will be thrown if an identifier with length != 4 is given.
      */
-    void read(std::ifstream &f, const char *id);
+    void read(std::istream &f, const char *id);
+
+    /**
+     * Populate the chunk list from a RIFF input.
+     * @param in The input to read from.
+     * @param id Chunk identifier for the new chunk. If nullptr a chunk identifier will be read from the input.
+     */
+    void read(RIFF_input_t &in, const char *id);
 
     /**
      * Write the byte data to the supplied filestream.
      * @param f The filestream to write the bytes to.
      * @return The number of bytes written.
      */
-    int write(std::ofstream &f);
+    uint64_t write(std::ostream &f);
 
     /**
-     * Get a list of the subchunks contained within this LIST chunk.
+     * Get a list of the subchunks contained within this LIST chunk. The cached sizes of this list and the
+     * lists above it are recomputed on the next size query.
      * @return A reference to the list of subchunks.
      */
     std::vector<std::unique_ptr<RIFF_chunk_t>> &get_subchunks();
 
+    /**
+     * Get a list of the subchunks for reading only, leaving the cached sizes alone.
+     * @return A reference to the list of subchunks.
+     */
+    const std::vector<std::unique_ptr<RIFF_chunk_t>> &get_subchunks() const;
+
+    /**
+     * Recompute the cached sizes of this list and every stale list below it, attaching the subchunks on the way.
+     * Call it after changing a tree that is going to be shared between threads.
+     */
+    void update_sizes();
+
     /**
      * Get the size of the data in the RIFF file in bytes (exluding header information).
      * @see total_size()
      * @return The test results
      */
-    int size();
+    uint32_t size() const;
 
     /**
      * Get the size of the RIFF file in bytes.
      * @see size()
      * @return The test results
      */
-    int total_size();
+    uint64_t total_size() const;
 
     /**
      * Print basic information about the subchunks.
      */
-    void print();
+    void print() const;
 
     /**
      * Print information about the subchunks along with complete chunk byte data.
      */
-    void print_full();
+    void print_full() const;
 
     /**
      * Tell if a chunk exists within the file structure that matches the specified chunk identifier.
      * @param id The chunk identifier to search for.
      * @return True if the chunk exists, false if it does not.
      */
-    bool exists_chunk_with_id(const char *id);
+    bool exists_chunk_with_id(const char *id) const;
 
     /**
      * Find the first chunk matching a specified chunk identifier. Pointers returned by this function 
@@ -228,11 +487,16 @@ public:
      * @return A pointer to the chunk with the specified id. Null pointer if chunk does not exist.
      */
     RIFF_chunk_t *get_chunk_with_id(const char *id);
+    const RIFF_chunk_t *get_chunk_with_id(const char *id) const;
 };
 
 // ====================================================================================================================
 /**
  *  RIFF chunk container class. Provides basic operations for accessing chunks within the RIFF file structure.
+ *
+ *  A parsed RIFF_t may be shared between threads: const members don't change it and payloads left on disk are
+ *  read with positioned reads, so any number of threads may call them at once as long as none of them calls a
+ *  non-const member at the same time.
  */
 class RIFF_t
 {
@@ -240,6 +504,8 @@ private:
     RIFF_chunk_list_t m_riff;
     std::string m_filepath;
 
+    void read(RIFF_input_t &in);
+
 public:
     /**
      * Basic constructor. Create an empty RIFF file structure.
@@ -248,36 +514,54 @@ public:
 
     /**
      * Populate a RIFF file structure from a RIFF file.
-     * @param filename The RIFF file to parse.
+     * @param filename The RIFF file to parse. "-" reads from stdin.
+     * @param max_buffered Chunk payloads larger than this are not loaded into memory. They are read from the 
+     * file on demand, or spooled to a temporary file when reading from stdin.
      */
-    RIFF_t(std::string filename);
+    RIFF_t(std::string filename, uint32_t max_buffered = UINT32_MAX);
+
+    /**
+     * Populate a RIFF file structure from a stream.
+     * @param f The stream to parse. Only read and peek are used unless a file is given.
+     * @param max_buffered Chunk payloads larger than this are spooled to a temporary file instead of memory.
+     * @param file The file the stream reads, starting at offset 0. If given, the stream must be seekable and 
+     * oversized payloads are left in the file instead of being spooled.
+     */
+    RIFF_t(std::istream &f, uint32_t max_buffered = UINT32_MAX, std::shared_ptr<RIFF_file_t> file = nullptr);
 
     /**
      * Get the size of the data in the RIFF file in bytes (exluding header information).
      * @see total_size()
      * @return The test results
      */
-    int size();
+    uint32_t size() const;
 
     /**
      * Get the size of the RIFF file in bytes.
      * @see size()
      * @return The test results
      */
-    int total_size();
+    uint64_t total_size() const;
 
     /**
      * Write the RIFF file to storage. File is written at the currently set file path.
      * @see set_filepath()
      * @return The number of bytes written.
      */
-    int write();
+    uint64_t write();
+
+    /**
+     * Write the RIFF file to a stream instead of the file path.
+     * @param f The stream to write the bytes to.
+     * @return The number of bytes written.
+     */
+    uint64_t write(std::ostream &f);
 
     /**
      * Get the current file path of the RIFF file.
      * @return String representation of the location of the RIFF file.
      */
-    const std::string &get_filepath();
+    const std::string &get_filepath() const;
 
     /**
      * Set the file path. This has no changes unless write() is called.
@@ -289,19 +573,19 @@ public:
     /**
      * Print basic information about the RIFF file subchunks.
      */
-    void print();
+    void print() const;
 
     /**
      * Print information about the RIFF file subchunks along with complete chunk byte data.
      */
-    void print_full();
+    void print_full() const;
 
     /**
      * Tell if a chunk exists within the file structure that matches the specified chunk identifier.
      * @param id The chunk identifier to search for.
      * @return True if the chunk exists, false if it does not.
      */
-    bool exists_chunk_with_id(const char *id);
+    bool exists_chunk_with_id(const char *id) const;
 
     /**
      * Find the first chunk matching a specified chunk identifier. Pointers returned by this function 
@@ -311,10 +595,12 @@ public:
      * @return A pointer to the chunk with the specified id. Null pointer if chunk does not exist.
      */
     RIFF_chunk_t *get_chunk_with_id(const char *id);
+    const RIFF_chunk_t *get_chunk_with_id(const char *id) const;
 
     /**
      * Quick access to the root chunk of the RIFF file.
      * @return Reference to the RIFF root chunk.
      */
     RIFF_chunk_list_t &get_root_chunk();
+    const RIFF_chunk_list_t &get_root_chunk() const;
 };
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "WAVparser.h"
+
+#pragma once
+
+// ====================================================================================================================
+/**
+ * Which channels end up in a split, independent of the input's format. Channels are selected first and the
+ * selection is then mixed.
+ */
+struct channel_map_t
+{
+    // input channels copied to the output in this order (0 based), empty for all of them
+    std::vector<uint16_t> channels;
+
+    // output channel r is the sum of every selected channel c times gains[r][c], empty to leave them unmixed
+    std::vector<std::vector<float>> gains;
+
+    // mix the selected channels down to their average
+    bool mono{false};
+
+    /**
+     * Parse the --channels and --mix options, either may be empty. channels is a list of 1 based input channels
+     * ("1,2" or "3"), mix is "mono" or a matrix of gains with one row per output channel ("0.5,0.5;1,-1").
+     * An exception will be thrown for anything else.
+     */
+    static channel_map_t parse(const std::string &channels, const std::string &mix);
+
+    /**
+     * @return True if every channel is passed through unchanged.
+     */
+    bool empty() const;
+};
+
+// ====================================================================================================================
+/**
+ * Applies a channel map to PCM frames. A plain selection copies samples without converting them, so it works for
+ * every format and is bit exact. A mix converts a run of frames to floats, deinterleaves it into one contiguous
+ * buffer per channel, sums the scaled channels into each output buffer and interleaves and quantizes the result.
+ * Each of those loops runs over contiguous floats so the compiler can vectorize it. The mixer holds no state
+ * between calls and may be used from several threads at once.
+ */
+class channel_mixer_t
+{
+private:
+    WAV_fmt_t m_input;
+    WAV_fmt_t m_output;
+    int m_container;
+
+    // input channel of every output channel, for a plain selection
+    std::vector<uint16_t> m_select;
+
+    // m_gains[r * input channels + c], empty for a plain selection
+    std::vector<float> m_gains;
+
+    void mix(const uint8_t *src, uint32_t frames, uint8_t *dst) const;
+
+public:
+    /**
+     * @param input Format of the frames that will be mapped.
+     * @param map An exception will be thrown if it names channels the input doesn't have or doesn't fit its format.
+     */
+    channel_mixer_t(const WAV_fmt_t &input, const channel_map_t &map);
+
+    /**
+     * @return The format of the mapped frames: the input's with the channel count, block_align, byte_rate and
+     * the WAVE_FORMAT_EXTENSIBLE speaker mask adjusted.
+     */
+    const WAV_fmt_t &format() const;
+
+    /**
+     * @return True if mapped frames are the input frames.
+     */
+    bool identity() const;
+
+    /**
+     * @param src Interleaved frames in the input format.
+     * @param frames Number of frames in src.
+     * @param dst Receives frames * format().block_align bytes, may not overlap src.
+     */
+    void apply(const uint8_t *src, uint32_t frames, uint8_t *dst) const;
+};
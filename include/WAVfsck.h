@@ -0,0 +1,57 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#pragma once
+
+/**
+ * One problem found in a file.
+ */
+struct fsck_diagnostic_t
+{
+    enum severity_t
+    {
+        warning,
+        error
+    };
+
+    severity_t severity;
+
+    // short stable name for the kind of problem, e.g. "truncated" or "cue_past_data"
+    std::string code;
+
+    // position in the file the problem was found at
+    uint64_t offset;
+
+    std::string message;
+};
+
+/**
+ * Everything found in one file.
+ */
+struct fsck_result_t
+{
+    std::string filename;
+    uint64_t file_size{0};
+    uint32_t chunks{0};
+    std::vector<fsck_diagnostic_t> diagnostics;
+
+    size_t count(fsck_diagnostic_t::severity_t severity) const;
+
+    /**
+     * @return One JSON object per line: every diagnostic, then a summary with the file's status.
+     */
+    std::string to_json() const;
+};
+
+/**
+ * Structural check of a RIFF/WAV file. The chunk headers are walked with positioned reads, checking sizes against
+ * their parents and the file, padding bytes, the 'fmt ' and 'data' chunks, and that cue points lie inside
+ * 'data' and labels refer to cue points. Only the 'fmt ' and 'cue ' payloads and the first bytes of 'adtl'
+ * entries are read; a malformed file is reported, never trusted.
+ */
+class WAV_fsck_t
+{
+public:
+    static fsck_result_t check(const std::string &filename);
+};
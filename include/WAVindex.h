@@ -0,0 +1,75 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "WAVsplit.h"
+
+#pragma once
+
+/**
+ * One entry of the chunk offset table.
+ */
+struct index_chunk_t
+{
+    char identifier[4];
+
+    // form type for LIST chunks, zeros otherwise
+    char form_type[4];
+
+    // nesting level below the root RIFF chunk
+    uint32_t depth;
+
+    // position of the chunk header in the file
+    uint64_t offset;
+    uint32_t size;
+};
+
+/**
+ * Sidecar index (file.wav.wsidx) caching everything WAVsplitter needs from a file's headers,
+ * so repeated opens don't parse the file again.
+ */
+struct WAV_index_t
+{
+    // identifies the indexed file, the index is stale if any of these differ
+    uint64_t file_size{0};
+    int64_t mtime_sec{0};
+    int64_t mtime_nsec{0};
+    uint32_t header_hash{0};
+
+    std::vector<index_chunk_t> chunks;
+    std::vector<uint8_t> fmt;
+    std::vector<cue_point_t> cues;
+    std::unordered_map<uint32_t, std::string> labels;
+
+    /**
+     * @return The sidecar file name used for a WAV file.
+     */
+    static std::string path_for(const std::string &filename);
+
+    /**
+     * Fill in the key fields (size, modification time, header hash) for a file.
+     * @return False if the file can't be examined.
+     */
+    bool identify(const std::string &filename);
+
+    /**
+     * Load the sidecar index of a file if it exists and is up to date.
+     * @param filename The WAV file (not the index).
+     * @return False if there is no usable index.
+     */
+    bool load(const std::string &filename);
+
+    /**
+     * Write the sidecar index of a file, replacing any existing one atomically. Failing to write
+     * is not an error, the index is only a cache.
+     * @param filename The WAV file (not the index).
+     */
+    void save(const std::string &filename) const;
+
+    /**
+     * Position of the payload of the first chunk with an identifier.
+     * @return False if there is no such chunk.
+     */
+    bool find(const char *id, uint64_t &payload_offset, uint32_t &size) const;
+};
@@ -0,0 +1,85 @@
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "RIFFparser.h"
+
+#pragma once
+
+/**
+ * One chunk of a file's layout.
+ */
+struct inspect_chunk_t
+{
+    char identifier[5];
+
+    // form type for RIFF and LIST chunks, empty otherwise
+    char form_type[5];
+
+    // nesting level below the root RIFF chunk, which is at 0
+    uint32_t depth;
+
+    // position of the chunk header in the file, the payload follows 8 bytes later
+    uint64_t offset;
+
+    // payload bytes, including the form type of lists
+    uint64_t size;
+};
+
+/**
+ * Looks at a RIFF file without loading it. Only the chunk headers are parsed; payloads are read from the file
+ * when they are decoded or dumped, and only the bytes being printed.
+ */
+class WAV_inspector_t
+{
+private:
+    std::shared_ptr<RIFF_file_t> m_file;
+    std::vector<inspect_chunk_t> m_chunks;
+    uint64_t m_file_size{0};
+    FILE *m_out;
+
+    std::vector<uint8_t> read_payload(const inspect_chunk_t &chunk, uint64_t max_size) const;
+
+    void decode_fmt(const inspect_chunk_t &chunk);
+    void decode_cue(const inspect_chunk_t &chunk);
+    void decode_adtl(const inspect_chunk_t &chunk);
+    void decode_bext(const inspect_chunk_t &chunk);
+
+public:
+    /**
+     * @param filename The file to inspect. An exception will be thrown if it is not a RIFF file.
+     * @param out Where everything is printed.
+     */
+    WAV_inspector_t(const std::string &filename, FILE *out = stdout);
+
+    /**
+     * @return Every chunk, depth first, in file order.
+     */
+    const std::vector<inspect_chunk_t> &get_chunks() const;
+
+    /**
+     * Find a chunk by its position in get_chunks() or by identifier (the first one, trailing spaces optional).
+     * @return Index into get_chunks(). An exception will be thrown if there is no such chunk.
+     */
+    size_t find(const std::string &chunk) const;
+
+    /**
+     * Print the chunk tree with numbers, offsets and sizes.
+     */
+    void print_tree();
+
+    /**
+     * Print the contents of every chunk there is a decoder for: 'fmt ', 'cue ', LIST 'adtl' and 'bext'.
+     */
+    void print_decoded();
+
+    /**
+     * Print a canonical hexdump (offset, 16 bytes in hex, then as text) of part of a chunk's payload.
+     * @param chunk Index into get_chunks().
+     * @param offset First payload byte to dump.
+     * @param length Bytes to dump, clamped to the end of the payload.
+     */
+    void hexdump(size_t chunk, uint64_t offset, uint64_t length);
+};
@@ -0,0 +1,134 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "WAVstats.h"
+
+#pragma once
+
+/**
+ * @return The string quoted and escaped for JSON.
+ */
+std::string json_string(const std::string &s);
+
+/**
+ * Everything recorded about a single written split.
+ */
+struct manifest_entry_t
+{
+    std::string name;
+    uint32_t frame_offset{0};
+    uint32_t frames{0};
+
+    // size of the written WAV file
+    uint64_t bytes{0};
+
+    bool has_stats{false};
+    split_stats_t stats{};
+
+    // CRC-32C of the written file and of the region's bytes in the source 'data' chunk
+    bool has_checksum{false};
+    uint32_t crc32c{0};
+    uint32_t data_crc32c{0};
+};
+
+/**
+ * Per-split manifest written next to the outputs.
+ */
+class split_manifest_t
+{
+public:
+    enum format_t
+    {
+        none,
+        json,
+        csv
+    };
+
+    std::vector<manifest_entry_t> entries;
+
+    /**
+     * @param format The manifest format.
+     * @param part Set when only part of the splits is written, so runs writing different parts into the same
+     * directory keep separate manifests ("manifest.part-1-of-4.json").
+     * @return The file name the manifest is written under.
+     */
+    static std::string filename(format_t format, const std::string &part = "");
+
+    /**
+     * Parse a format name ("json" or "csv"). An exception will be thrown for anything else.
+     */
+    static format_t parse_format(const std::string &name);
+
+    /**
+     * Render the manifest.
+     * @param format The format to render, none returns an empty string.
+     */
+    std::string serialize(format_t format) const;
+
+    std::string to_json() const;
+    std::string to_csv() const;
+
+    /**
+     * Load a manifest written by serialize(). An exception will be thrown if the file can't be read.
+     * @param filename The manifest to read, the format is taken from its first character.
+     */
+    static split_manifest_t read(const std::string &filename);
+};
+
+/**
+ * A region as planned, before anything is read or written.
+ */
+struct plan_region_t
+{
+    // position among all regions of the input, names and shards depend on it
+    uint32_t index{0};
+
+    // file name of the split, including its shard and extension
+    std::string name;
+    uint32_t frame_offset{0};
+    uint32_t frames{0};
+
+    // the region's samples in the input file
+    uint64_t source_offset{0};
+    uint64_t source_bytes{0};
+
+    // size of the written file, 0 if it is only known once written (FLAC)
+    uint64_t bytes{0};
+};
+
+/**
+ * Where every split of an input comes from and what it will be called, written by --plan without reading any
+ * samples. Plans (or parts of them) are handed to other runs with --plan-in, so several machines sharing the
+ * input and output directories can each write some of the splits.
+ */
+class split_plan_t
+{
+public:
+    std::string source;
+
+    // frames in the input's 'data' chunk and the file offset of its first sample
+    uint32_t source_frames{0};
+    uint64_t data_offset{0};
+
+    // the format and header size of the splits, after the channel map
+    WAV_fmt_t format;
+    uint32_t header_bytes{0};
+    bool flac{false};
+
+    // "K/N" if the plan only holds one part of the regions
+    std::string part;
+
+    std::vector<plan_region_t> regions;
+
+    /**
+     * Render the plan as JSON, one region per line.
+     */
+    std::string to_json() const;
+
+    /**
+     * Load a plan written by to_json(). An exception will be thrown if the file can't be read.
+     * @param filename The plan to read.
+     */
+    static split_plan_t read(const std::string &filename);
+};
@@ -0,0 +1,131 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#pragma once
+
+/**
+ * Parts of the program heap memory is accounted to. Scoped, so a subsystem passed to a container constructor
+ * can only mean its allocator and never a size.
+ */
+enum class memory_subsystem_t
+{
+    // chunk payloads held by RIFF_chunk_data_t
+    riff,
+
+    // decoded WAV_t::samples
+    samples,
+
+    // per-split copies of region bytes and samples kept by WAVsplitter
+    split,
+
+    // temporary byte vectors built while serializing a WAV_t
+    encode,
+
+    // tracked containers not given a subsystem
+    other,
+
+    count
+};
+
+/**
+ * Allocation counters per subsystem, fed by tracking_allocator_t. Counting is always on, it costs a few
+ * relaxed atomic operations per allocation, and is reported on request (--stats).
+ */
+class memory_stats_t
+{
+public:
+    struct counters_t
+    {
+        uint64_t allocations;
+        uint64_t total_bytes;
+
+        // bytes held right now and the most held at once
+        int64_t bytes;
+        int64_t peak_bytes;
+    };
+
+    static void allocated(memory_subsystem_t subsystem, size_t bytes);
+    static void released(memory_subsystem_t subsystem, size_t bytes);
+
+    static const char *name(memory_subsystem_t subsystem);
+
+    /**
+     * @return A snapshot of one subsystem's counters.
+     */
+    static counters_t get(memory_subsystem_t subsystem);
+
+    /**
+     * Print a table of every subsystem's counters.
+     */
+    static void report(FILE *out);
+};
+
+/**
+ * std::allocator that accounts every allocation to a subsystem. The allocator moves with the memory when
+ * containers are swapped or moved, so bytes are released from the subsystem that allocated them.
+ */
+template <typename T>
+class tracking_allocator_t
+{
+public:
+    using value_type = T;
+    using propagate_on_container_swap = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    memory_subsystem_t subsystem;
+
+    tracking_allocator_t(memory_subsystem_t subsystem = memory_subsystem_t::other) : subsystem(subsystem)
+    {
+    }
+
+    template <typename U>
+    tracking_allocator_t(const tracking_allocator_t<U> &other) : subsystem(other.subsystem)
+    {
+    }
+
+    T *allocate(size_t n)
+    {
+        T *p = std::allocator<T>().allocate(n);
+        memory_stats_t::allocated(subsystem, n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        memory_stats_t::released(subsystem, n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const tracking_allocator_t<T> &a, const tracking_allocator_t<U> &b)
+{
+    return a.subsystem == b.subsystem;
+}
+
+template <typename T, typename U>
+bool operator!=(const tracking_allocator_t<T> &a, const tracking_allocator_t<U> &b)
+{
+    return a.subsystem != b.subsystem;
+}
+
+using byte_vector_t = std::vector<uint8_t, tracking_allocator_t<uint8_t>>;
+using sample_vector_t = std::vector<uint64_t, tracking_allocator_t<uint64_t>>;
+
+/**
+ * Prints memory_stats_t::report() to stderr when it goes out of scope, if enabled.
+ */
+class memory_stats_session_t
+{
+private:
+    bool m_enabled;
+
+public:
+    memory_stats_session_t(bool enabled);
+    ~memory_stats_session_t();
+};
@@ -0,0 +1,196 @@
+#include <string>
+#include <fstream>
+#include <ostream>
+#include <functional>
+#include <unordered_map>
+
+#include "WAVparser.h"
+
+#pragma once
+
+// ====================================================================================================================
+/**
+ *  Destination for split WAV files.
+ */
+class split_output_t
+{
+public:
+    /**
+     * Supplies a region's samples block by block.
+     * @param dst Buffer for the next bytes.
+     * @param capacity Size of dst.
+     * @return Number of bytes stored in dst, at most capacity and only 0 once all bytes were supplied.
+     */
+    using region_reader_t = std::function<size_t(uint8_t *dst, size_t capacity)>;
+
+    virtual ~split_output_t();
+
+    /**
+     * Write a single split.
+     * @param name File name of the split relative to the output location.
+     * @param wav The split to write.
+     * @param crc If not nullptr, receives the CRC-32C of the bytes written, computed as they are written.
+     * @return The number of bytes written.
+     */
+    virtual uint64_t write(const std::string &name, WAV_t &wav, uint32_t *crc) = 0;
+
+    /**
+     * Write a single split from its header and samples read block by block, so the split is never held
+     * in memory as a whole.
+     * @param name File name of the split relative to the output location.
+     * @param header The bytes in front of the samples.
+     * @param data_size Number of sample bytes. A padding byte is added if odd.
+     * @param read Called for consecutive blocks of the samples.
+     * @param crc If not nullptr, receives the CRC-32C of the bytes written.
+     * @return The number of bytes written.
+     */
+    virtual uint64_t write_region(const std::string &name, const std::vector<uint8_t> &header, uint64_t data_size,
+                                  const region_reader_t &read, uint32_t *crc) = 0;
+
+    /**
+     * Write a single split whose size isn't known before it is complete, such as an encoded one.
+     * @param name File name of the split relative to the output location.
+     * @param read Called for consecutive blocks of the file until it returns 0.
+     * @param crc If not nullptr, receives the CRC-32C of the bytes written.
+     * @return The number of bytes written.
+     */
+    virtual uint64_t write_stream(const std::string &name, const region_reader_t &read, uint32_t *crc) = 0;
+
+    /**
+     * Write an auxiliary file (such as a manifest) next to the splits.
+     * @param name File name relative to the output location.
+     * @param contents The bytes to write.
+     */
+    virtual void write_file(const std::string &name, const std::string &contents) = 0;
+
+    /**
+     * Complete the output after the last split has been written.
+     */
+    virtual void finish();
+};
+
+// ====================================================================================================================
+/**
+ *  How splits are spread over subdirectories, so no single directory has to hold all of them.
+ */
+struct shard_options_t
+{
+    enum mode_t
+    {
+        none,
+
+        // by a hash of the split's name, into fan_out subdirectories
+        hashed,
+
+        // in order, fan_out splits per subdirectory
+        numbered
+    };
+
+    mode_t mode{none};
+    uint32_t fan_out{256};
+
+    /**
+     * Parse "hash:N" or "number:N" (":N" is optional). An exception will be thrown for anything else.
+     */
+    static shard_options_t parse(const std::string &option);
+
+    /**
+     * @param name File name of the split.
+     * @param index Position of the split among all splits.
+     * @param count Number of splits.
+     * @return The subdirectory the split goes in, with a trailing '/', empty without sharding.
+     */
+    std::string subdirectory(const std::string &name, size_t index, size_t count) const;
+};
+
+// ====================================================================================================================
+/**
+ *  Writes each split to its own file inside a directory. The directory is opened once and files are created
+ *  relative to it, subdirectories (names containing '/') are opened once each as they are first used.
+ */
+class split_directory_output_t : public split_output_t
+{
+private:
+    std::string m_directory;
+    int m_fd{-1};
+    bool m_atomic{false};
+
+    // descriptors of the subdirectories used so far, by their path relative to m_directory
+    std::unordered_map<std::string, int> m_subdirectories;
+
+    // the directory a name is created in and the name's last component, creating subdirectories on first use
+    int directory_for(const std::string &name, std::string &base);
+
+    // samples requested from a region reader, kept between splits so each one doesn't allocate its own
+    byte_vector_t m_block{memory_subsystem_t::split};
+
+    // open the file for a split, let contents write to the descriptor and move the file into place
+    uint64_t write_split(const std::string &name, const std::function<uint64_t(int fd)> &contents);
+
+public:
+    /**
+     * @param directory The directory to write into, including the trailing '/'. It is created, along with
+     * any missing parents, if it doesn't exist.
+     * @param atomic Write each file under a temporary name and rename it into place once complete.
+     */
+    split_directory_output_t(const std::string &directory, bool atomic = false);
+    split_directory_output_t(const split_directory_output_t &) = delete;
+    ~split_directory_output_t();
+
+    uint64_t write(const std::string &name, WAV_t &wav, uint32_t *crc);
+    uint64_t write_region(const std::string &name, const std::vector<uint8_t> &header, uint64_t data_size,
+                          const region_reader_t &read, uint32_t *crc);
+    uint64_t write_stream(const std::string &name, const region_reader_t &read, uint32_t *crc);
+    void write_file(const std::string &name, const std::string &contents);
+
+    /**
+     * Tell if a file already in the directory matches a planned split.
+     * @param name File name of the split.
+     * @param header The header bytes the split would start with.
+     * @param size The size the split would have.
+     * @param crc If not nullptr, the file is also read back and must have this CRC-32C.
+     * @return True if the file exists and matches.
+     */
+    bool is_current(const std::string &name, const std::vector<uint8_t> &header, uint64_t size, const uint32_t *crc);
+};
+
+// ====================================================================================================================
+/**
+ *  Writes every split as a member of a single POSIX (ustar) tar stream. Members are written sequentially
+ *  so the archive can go to a pipe.
+ */
+class split_tar_output_t : public split_output_t
+{
+private:
+    std::ofstream m_file;
+    std::ostream *m_stream{nullptr};
+    std::string m_directory;
+    bool m_finished{false};
+
+    // emit the 512 byte header block for a member
+    void write_header(const std::string &name, uint64_t size);
+
+    // emit a whole member, header, contents and padding
+    uint64_t write_member(const std::string &name, const std::string &contents);
+
+    // pad a member of the given size to a whole number of blocks, returns the padding
+    int write_padding(uint64_t size);
+
+public:
+    /**
+     * @param filename The archive to create. "-" writes the archive to stdout.
+     * @param directory Path prepended to every member name, may be empty.
+     */
+    split_tar_output_t(const std::string &filename, const std::string &directory = "");
+
+    uint64_t write(const std::string &name, WAV_t &wav, uint32_t *crc);
+    uint64_t write_region(const std::string &name, const std::vector<uint8_t> &header, uint64_t data_size,
+                          const region_reader_t &read, uint32_t *crc);
+    uint64_t write_stream(const std::string &name, const region_reader_t &read, uint32_t *crc);
+    void write_file(const std::string &name, const std::string &contents);
+
+    /**
+     * Write the end-of-archive marker and flush the stream.
+     */
+    void finish();
+};
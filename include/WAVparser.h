@@ -6,7 +6,8 @@
 
 #pragma once
 
-#pragma pack(2)
+// the header is copied straight out of the 'fmt ' chunk, keep the layout of the file
+#pragma pack(push, 2)
 
 /**
  * WAV file header struct.
@@ -23,22 +24,37 @@ struct WAV_fmt_t
     std::vector<uint8_t> extra_params; // generally don't exist
 };
 
+#pragma pack(pop)
+
 /**
  * Class for storing and manipulating WAV file data.
+ *
+ * Like RIFF_t, a parsed WAV_t may be read from several threads at once through its const members (frames(),
+ * read_frames(), the const get_riff() and so on), as long as no thread calls a non-const member meanwhile.
+ * One parsed file can be shared by every worker instead of each parsing its own.
  */
 class WAV_t
 {
 private:
     RIFF_t m_riff;
 
+    // the 'fmt ' and 'data' chunks, looked up once and forgotten whenever the tree may be changed through get_riff()
+    RIFF_chunk_data_t *m_fmt_chunk{nullptr};
+    RIFF_chunk_data_t *m_data_chunk{nullptr};
+
     // quick access
     RIFF_chunk_data_t *m_data();
     RIFF_chunk_data_t *m_fmt();
+    const RIFF_chunk_data_t *m_data() const;
+    const RIFF_chunk_data_t *m_fmt() const;
 
     // write fmt and data sections into m_riff
     int write_fmt();
     int write_data();
 
+    // check for the chunks every WAV file needs and load them
+    void load();
+
 public:
     /**
      * WAV file header information. Use load_fmt() to load from the RIFF_t
@@ -52,7 +68,7 @@ public:
      * object into the header.
      * @see load_samples()
      */
-    std::vector<uint64_t> samples;
+    sample_vector_t samples{memory_subsystem_t::samples};
 
     /**
      * Construct an empty WAV file. Contains no samples and 
@@ -62,9 +78,25 @@ public:
 
     /**
      * Construct a WAV_t object from a WAV file.
-     * @param filename The file to parse.
+     * @param filename The file to parse. "-" reads from stdin.
+     * @param max_buffered Chunk payloads larger than this are left on disk (spooled to a temporary file 
+     * when reading from stdin). Samples are only loaded if the 'data' chunk is held in memory.
+     * @see RIFF_t
+     */
+    WAV_t(std::string filename, uint32_t max_buffered = UINT32_MAX);
+
+    /**
+     * Construct a WAV_t object from a stream.
+     * @param f The stream to parse.
+     * @param max_buffered Chunk payloads larger than this are spooled to a temporary file, or left in file if 
+     * one is given. Samples are only loaded if the 'data' chunk is held in memory.
+     * @param file The file the stream reads, if any.
+     * @see RIFF_t
      */
-    WAV_t(std::string filename);
+    WAV_t(std::istream &f, uint32_t max_buffered = UINT32_MAX, std::shared_ptr<RIFF_file_t> file = nullptr);
+
+    WAV_t(const WAV_t &) = delete;
+    WAV_t(WAV_t &&other);
 
     /**
      * Load raw byte data from the RIFF_t object into the header.
@@ -84,7 +116,8 @@ public:
      * @return Reference to raw byte data. 
      * @see load_fmt()
      */
-    std::vector<uint8_t> &get_fmt();
+    byte_vector_t &get_fmt();
+    const byte_vector_t &get_fmt() const;
 
     /**
      * Get the raw 'data' data contained in the RIFF_t object. 
@@ -93,18 +126,48 @@ public:
      * @return Reference to raw byte data. 
      * @see load_data()
      */
-    std::vector<uint8_t> &get_data();
+    byte_vector_t &get_data();
+
+    /**
+     * Get the raw 'data' data for reading only. An exception will be thrown if it was left on disk, use
+     * read_frames() to read those.
+     * @return Reference to raw byte data.
+     */
+    const byte_vector_t &get_data() const;
 
     /**
-     * Get the underlying RIFF_t data.
+     * @return The number of sample frames in the 'data' chunk.
+     */
+    uint32_t frames() const;
+
+    /**
+     * Copy a range of sample frames out of the 'data' chunk. If the chunk was left on disk only the 
+     * requested bytes are read, so the cost does not depend on the size of the file.
+     * @param offset The first frame to copy.
+     * @param count Number of frames to copy. An exception will be thrown if the range exceeds the data.
+     * @param dst Buffer receiving count * block_align bytes.
+     */
+    void read_frames(uint32_t offset, uint32_t count, uint8_t *dst) const;
+
+    /**
+     * Copy a range of sample frames out of the 'data' chunk.
+     * @see read_frames(uint32_t, uint32_t, uint8_t *)
+     * @return The raw bytes of the frames.
+     */
+    std::vector<uint8_t> read_frames(uint32_t offset, uint32_t count) const;
+
+    /**
+     * Get the underlying RIFF_t data. The chunks may be changed through the reference, so the 'fmt ' and
+     * 'data' chunks are looked up again on their next use.
      * @return Reference to the RIFF_t object.
      */
     RIFF_t &get_riff();
+    const RIFF_t &get_riff() const;
 
     /**
      * @return The number of bytes in a single sample.
      */
-    int sample_size();
+    int sample_size() const;
 
     /**
      * Get a specific individual sample.
@@ -117,6 +180,7 @@ public:
      * @return Reference to the requested sample.
      */
     uint64_t &get_sample(int i, int channel = 0);
+    uint64_t get_sample(int i, int channel = 0) const;
 
     /**
      * Helper function to set header byte rate. Generally only used internally but can be useful to do 
@@ -151,10 +215,17 @@ public:
      * @see set_filepath()
      * @return Number of bytes written
      */
-    int write();
+    uint64_t write();
+
+    /**
+     * Write WAV_t data to a stream instead of the file path.
+     * @param f The stream to write the bytes to.
+     * @return Number of bytes written
+     */
+    uint64_t write(std::ostream &f);
 
     /**
      * Quickly print header information
      */
-    void print_header();
+    void print_header() const;
 };
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include <cstdint>
+#include <cstddef>
+
+#include "WAVparser.h"
+
+#pragma once
+
+/**
+ * PCM sample conversion kernels. Loops are kept branch free over contiguous buffers so the
+ * compiler can vectorize them.
+ */
+
+/**
+ * Size in bytes of a single sample's container within a frame. An exception will be thrown for
+ * formats that can't be converted (anything but integer PCM of 8-32 bits and 32/64 bit float, given
+ * directly or as the sub format of WAVE_FORMAT_EXTENSIBLE). A-law, mu-law, ADPCM and the like are rejected.
+ * @param fmt The format to check.
+ */
+int pcm_container_size(const WAV_fmt_t &fmt);
+
+/**
+ * @param fmt A format pcm_container_size() accepts.
+ * @return If the samples are IEEE floats.
+ */
+bool pcm_is_float(const WAV_fmt_t &fmt);
+
+/**
+ * Convert interleaved PCM samples to floats in [-1, 1).
+ * @param src PCM bytes.
+ * @param samples Number of samples (frames * channels) to convert.
+ * @param fmt Format of the PCM bytes.
+ * @param dst Receives one float per sample.
+ */
+void pcm_to_float(const uint8_t *src, size_t samples, const WAV_fmt_t &fmt, float *dst);
+
+/**
+ * Convert interleaved integer PCM samples to signed 32 bit integers, keeping their scale (8 bit samples
+ * become [-128, 127], 16 bit samples [-32768, 32767] and so on). An exception will be thrown for float formats.
+ * @param src PCM bytes.
+ * @param samples Number of samples (frames * channels) to convert.
+ * @param fmt Format of the PCM bytes.
+ * @param dst Receives one integer per sample.
+ */
+void pcm_to_int(const uint8_t *src, size_t samples, const WAV_fmt_t &fmt, int32_t *dst);
+
+/**
+ * Convert floats in [-1, 1) back to interleaved PCM samples, the inverse of pcm_to_float(). Integer samples are
+ * rounded to the nearest step and clamped to full scale.
+ * @param src One float per sample.
+ * @param samples Number of samples (frames * channels) to convert.
+ * @param fmt Format of the PCM bytes.
+ * @param dst Receives the PCM bytes.
+ */
+void float_to_pcm(const float *src, size_t samples, const WAV_fmt_t &fmt, uint8_t *dst);
+
+/**
+ * Accumulate the sum of squares and absolute peak of a float buffer.
+ * @param src Samples to scan.
+ * @param count Number of samples.
+ * @param sum_squares Incremented by the sum of squares.
+ * @param peak Raised to the largest absolute sample value.
+ */
+void pcm_accumulate(const float *src, size_t count, double &sum_squares, float &peak);
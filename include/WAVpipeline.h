@@ -0,0 +1,161 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "WAVmemory.h"
+#include "WAVoutput.h"
+
+#pragma once
+
+// ====================================================================================================================
+/**
+ * Bounded queue between exactly one producer and one consumer thread. Neither side ever blocks or locks, a full
+ * or empty queue is reported and the caller decides how to wait.
+ */
+template <typename T>
+class spsc_queue_t
+{
+private:
+    std::vector<T> m_slots;
+
+    // both only ever grow, the slot of an index is index % capacity
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+
+public:
+    spsc_queue_t(size_t capacity) : m_slots(capacity)
+    {
+    }
+
+    spsc_queue_t(const spsc_queue_t &) = delete;
+    spsc_queue_t &operator=(const spsc_queue_t &) = delete;
+
+    /**
+     * Called by the producer only.
+     * @return False if the queue is full.
+     */
+    bool try_push(const T &value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == m_slots.size())
+            return false;
+
+        m_slots[tail % m_slots.size()] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Called by the consumer only.
+     * @return False if the queue is empty.
+     */
+    bool try_pop(T &value)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+
+        value = m_slots[head % m_slots.size()];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// ====================================================================================================================
+/**
+ * Writes regions of a source through three stages on their own threads: a reader filling blocks with frames of
+ * the source, an optional transform looking at every block (statistics, checksums) and the writer,
+ * the calling thread, handing blocks to the output. The stages pass a fixed set of reusable blocks through
+ * bounded queues, so reading the next blocks overlaps with writing the current ones while memory stays at
+ * depth blocks no matter how large a region is.
+ */
+class split_pipeline_t
+{
+public:
+    struct region_t
+    {
+        uint32_t frame_offset;
+        uint32_t frames;
+    };
+
+    /**
+     * Fills dst with count frames starting at frame, on the reader thread.
+     */
+    using read_t = std::function<void(uint32_t frame, uint32_t count, uint8_t *dst)>;
+
+    /**
+     * Sees every block of every region in order, on the transform thread.
+     * @param region Index into the regions given to run().
+     * @param last True for the last block of the region.
+     */
+    using transform_t = std::function<void(size_t region, const uint8_t *data, size_t size, bool last)>;
+
+    /**
+     * Writes one region on the calling thread, in order.
+     * @param region Index into the regions given to run().
+     * @param read Supplies exactly the region's bytes.
+     */
+    using write_t = std::function<void(size_t region, const split_output_t::region_reader_t &read)>;
+
+private:
+    struct block_t
+    {
+        size_t region;
+        size_t buffer;
+        size_t size;
+        bool last;
+    };
+
+    std::vector<byte_vector_t> m_buffers;
+    size_t m_block_size;
+
+    std::atomic<bool> m_stop{false};
+    std::mutex m_error_mutex;
+    std::exception_ptr m_error;
+
+    // record the first error and make every stage give up
+    void fail(std::exception_ptr error);
+
+    template <typename T>
+    bool push(spsc_queue_t<T> &queue, const T &value);
+
+    template <typename T>
+    bool pop(spsc_queue_t<T> &queue, T &value);
+
+    void read_stage(const read_t &read, uint32_t frame_size, const std::vector<region_t> &regions,
+                    spsc_queue_t<size_t> &recycled, spsc_queue_t<block_t> &filled);
+    void transform_stage(const transform_t &transform, spsc_queue_t<block_t> &filled, spsc_queue_t<block_t> &transformed);
+    void write_stage(const std::vector<region_t> &regions, const write_t &write, spsc_queue_t<block_t> &transformed,
+                     spsc_queue_t<size_t> &recycled);
+
+public:
+    /**
+     * @param depth Number of blocks in flight.
+     * @param block_size Bytes per block, rounded down to whole frames.
+     */
+    split_pipeline_t(size_t depth = 4, size_t block_size = 1 << 20);
+
+    split_pipeline_t(const split_pipeline_t &) = delete;
+    split_pipeline_t &operator=(const split_pipeline_t &) = delete;
+
+    /**
+     * @return Memory held by the blocks once they are allocated.
+     */
+    uint64_t buffer_bytes() const;
+
+    /**
+     * Write regions of the source. The blocks are allocated on first use and kept for the next run.
+     * An error in any stage stops all of them and is rethrown here.
+     * @param read Reads frames of the source. Only the reader stage calls it.
+     * @param frame_size Bytes per frame read.
+     * @param regions Frame ranges of the source.
+     * @param transform Called for every block before it is written, may be empty.
+     * @param write Called once per region.
+     */
+    void run(const read_t &read, uint32_t frame_size, const std::vector<region_t> &regions, const transform_t &transform,
+             const write_t &write);
+};
@@ -0,0 +1,161 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#pragma once
+
+/*
+ * Progress of the run: input bytes parsed, source bytes split, regions written and their totals. The read and
+ * write paths add to relaxed atomic counters, and while progress is off each call costs one relaxed atomic load.
+ * Nothing is printed from those paths, a progress_session_t samples the counters from its own thread at a fixed
+ * interval, so reporting costs the same no matter how small the blocks or regions are.
+ */
+class progress_t
+{
+private:
+    static std::atomic<bool> s_enabled;
+
+    static std::atomic<uint64_t> s_input_total;
+    static std::atomic<uint64_t> s_input_done;
+    static std::atomic<uint64_t> s_split_total;
+    static std::atomic<uint64_t> s_split_done;
+    static std::atomic<uint64_t> s_regions_total;
+    static std::atomic<uint64_t> s_regions_done;
+
+    // inputs being parsed and being split right now, several at once with multiple inputs or --watch
+    static std::atomic<uint64_t> s_active[2];
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t n)
+    {
+        if (enabled())
+            counter.fetch_add(n, std::memory_order_relaxed);
+    }
+
+public:
+    enum stage_t
+    {
+        parsing,
+        splitting
+    };
+
+    /**
+     * Counts one input as being in a stage for its lifetime.
+     */
+    class stage_scope_t
+    {
+    private:
+        stage_t m_stage;
+        bool m_counted;
+
+    public:
+        stage_scope_t(stage_t stage) : m_stage(stage), m_counted(enabled())
+        {
+            if (m_counted)
+                s_active[m_stage].fetch_add(1, std::memory_order_relaxed);
+        }
+        stage_scope_t(const stage_scope_t &) = delete;
+        ~stage_scope_t()
+        {
+            if (m_counted)
+                s_active[m_stage].fetch_sub(1, std::memory_order_relaxed);
+        }
+    };
+
+    struct snapshot_t
+    {
+        uint64_t input_total;
+        uint64_t input_done;
+        uint64_t split_total;
+        uint64_t split_done;
+        uint64_t regions_total;
+        uint64_t regions_done;
+        uint64_t parsing;
+        uint64_t splitting;
+    };
+
+    static void enable();
+
+    static bool enabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * An input of this many bytes is about to be parsed, 0 if its size isn't known (stdin).
+     */
+    static void add_input(uint64_t bytes)
+    {
+        add(s_input_total, bytes);
+    }
+
+    /**
+     * Bytes consumed from an input while parsing.
+     */
+    static void input_read(uint64_t bytes)
+    {
+        add(s_input_done, bytes);
+    }
+
+    /**
+     * Regions about to be written, with the number of source bytes they cover.
+     */
+    static void add_split(uint64_t bytes, uint64_t regions)
+    {
+        add(s_split_total, bytes);
+        add(s_regions_total, regions);
+    }
+
+    /**
+     * Source bytes of the regions read for writing.
+     */
+    static void split_read(uint64_t bytes)
+    {
+        add(s_split_done, bytes);
+    }
+
+    /**
+     * A region was written.
+     */
+    static void region_done()
+    {
+        add(s_regions_done, 1);
+    }
+
+    static snapshot_t get();
+};
+
+/**
+ * Enables progress for its lifetime and reports it on a descriptor from a thread of its own, either as a
+ * terminal line redrawn in place or as JSON lines. A last report is written when it goes out of scope.
+ */
+class progress_session_t
+{
+private:
+    int m_fd;
+    bool m_json;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop{false};
+
+    // phase, time and bytes parsed and split at the last report, and the smoothed rate in bytes/s
+    const char *m_phase{""};
+    double m_last_time{0};
+    uint64_t m_last_input{0};
+    uint64_t m_last_split{0};
+    double m_rate{0};
+
+    void report(double elapsed, bool last);
+
+public:
+    /**
+     * @param fd Where the reports go, nothing is reported if negative.
+     * @param json Write a JSON object per line instead of a terminal line.
+     */
+    progress_session_t(int fd, bool json);
+    progress_session_t(const progress_session_t &) = delete;
+    ~progress_session_t();
+};
@@ -0,0 +1,92 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "WAVsplit.h"
+#include "WorkerPool.h"
+
+#pragma once
+
+/**
+ * @return The peak resident set size of the process so far, in bytes.
+ */
+uint64_t peak_rss();
+
+// ====================================================================================================================
+/**
+ *  Memory shared by concurrent jobs. A job that does not fit waits until running jobs release enough; a job
+ *  larger than the whole budget is refused.
+ */
+class memory_budget_t
+{
+private:
+    uint64_t m_limit;
+    uint64_t m_used{0};
+
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+
+public:
+    memory_budget_t(uint64_t limit);
+
+    /**
+     * Reserve bytes if they fit in the budget right now.
+     * @return False if they don't, nothing is reserved then.
+     */
+    bool try_acquire(uint64_t bytes);
+
+    /**
+     * Reserve bytes, waiting for other jobs to release theirs if needed. An exception will be thrown if
+     * they are more than the whole budget.
+     */
+    void acquire(uint64_t bytes);
+
+    void release(uint64_t bytes);
+
+    uint64_t limit() const;
+};
+
+// ====================================================================================================================
+/**
+ *  Splits several files concurrently within a memory budget. Each file's headers are parsed first and its
+ *  footprint estimated from them; the file is split normally if that fits the budget right away and
+ *  streamed block by block otherwise. A file that doesn't fit even when streamed fails without being split.
+ */
+class split_scheduler_t
+{
+private:
+    std::string m_output_root;
+    std::function<void(WAVsplitter &)> m_configure;
+    memory_budget_t m_budget;
+    std::atomic<int> m_failed{0};
+
+    // last so the workers are gone before anything they use
+    worker_pool_t m_pool;
+
+    void process(const std::string &filename);
+
+public:
+    /**
+     * @param max_memory Peak RSS the process should stay under, in bytes. What the process already uses
+     * when the scheduler is created is not available to jobs.
+     * @param workers Number of files split at once at most, 0 for one per hardware thread.
+     * @param output_root If not empty, the splits of file.wav go to output_root/file/ instead of file/.
+     * @param configure Applied to the WAVsplitter of every file to set the split options.
+     */
+    split_scheduler_t(uint64_t max_memory, unsigned workers, const std::string &output_root,
+                      const std::function<void(WAVsplitter &)> &configure);
+
+    /**
+     * Queue a file for splitting.
+     */
+    void add(const std::string &filename);
+
+    /**
+     * Wait until every queued file has been split.
+     * @return The number of files that failed.
+     */
+    int wait();
+};
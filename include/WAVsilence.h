@@ -0,0 +1,82 @@
+#include <cstdint>
+#include <vector>
+
+#include "WAVparser.h"
+
+#pragma once
+
+/**
+ * Settings for finding regions separated by silence.
+ */
+struct silence_options_t
+{
+    // a window is silent when its RMS level is below this (dBFS)
+    double threshold_db{-50.0};
+
+    // ... and none of its samples peak above this (dBFS)
+    double peak_db{-30.0};
+
+    // silence shorter than this (seconds) does not separate two regions
+    double min_silence{0.5};
+
+    // length of the analysis window (seconds)
+    double window{0.01};
+};
+
+/**
+ * Streaming silence detector. PCM bytes are fed in order, the detector reports the frame
+ * index at which each non-silent region starts.
+ */
+class silence_detector_t
+{
+private:
+    WAV_fmt_t m_fmt;
+
+    uint32_t m_window_frames{1};
+    uint32_t m_min_silent_windows{1};
+    double m_threshold{0};
+    float m_peak_threshold{0};
+
+    // current window
+    double m_sum_squares{0};
+    float m_peak{0};
+    uint32_t m_window_fill{0};
+    uint32_t m_window_start{0};
+
+    // length of the current silent run in windows, starts "long" so leading audio begins a region
+    uint32_t m_silent_windows{UINT32_MAX};
+
+    std::vector<float> m_buffer;
+    std::vector<uint32_t> m_onsets;
+
+    void end_window();
+
+public:
+    /**
+     * @param fmt Format of the PCM data. An exception will be thrown for unsupported sample formats.
+     * @param options Detection settings.
+     */
+    silence_detector_t(const WAV_fmt_t &fmt, const silence_options_t &options);
+
+    /**
+     * Feed the next PCM bytes. Length must be a whole number of frames.
+     * @param bytes Interleaved PCM data.
+     * @param length Number of bytes.
+     */
+    void process(const uint8_t *bytes, size_t length);
+
+    /**
+     * Flush the final partial window.
+     * @return Frame index of the start of every non-silent region.
+     */
+    const std::vector<uint32_t> &finish();
+
+    /**
+     * Scan a whole 'data' chunk sequentially, reading it block by block.
+     * @param data The chunk to scan, may be left on disk.
+     * @param fmt Format of the PCM data.
+     * @param options Detection settings.
+     * @return Frame index of the start of every non-silent region.
+     */
+    static std::vector<uint32_t> scan(const RIFF_chunk_data_t &data, const WAV_fmt_t &fmt, const silence_options_t &options);
+};
@@ -1,8 +1,14 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <memory>
 
 #include "WAVparser.h"
+#include "WAVchannels.h"
+#include "WAVoutput.h"
+#include "WAVsilence.h"
+#include "WAVmanifest.h"
+#include "WAVpipeline.h"
 
 #pragma once
 
@@ -33,6 +39,8 @@ struct cue_chunk_t
     std::vector<cue_point_t> data;
 };
 
+struct WAV_index_t;
+
 
 
 class WAVsplitter
@@ -43,14 +51,91 @@ private:
     std::vector<splitWAV> split_wavs;
     WAV_fmt_t wav_header;
 
+    // parsed input, regions are read from its 'data' chunk while splitting
+    std::unique_ptr<WAV_t> source;
+
+    // reads, analyzes and writes regions concurrently, its blocks are kept so a reused splitter doesn't reallocate
+    split_pipeline_t pipeline;
+
+    // 'data' payloads larger than this stay on disk (or spooled from stdin) instead of memory
+    uint32_t max_buffered{16 << 20};
+
     std::string prefix;
     std::string suffix;
 
     std::string output_directory;
 
+    // spread the splits over subdirectories of the output directory
+    shard_options_t shard;
+
+    // write every split into this tar archive instead of individual files ("-" for stdout)
+    std::string archive;
+
+    // synthesize cue points from silence gaps when the file has none
+    bool auto_split{false};
+    silence_options_t silence;
+
+    // per-split statistics and the manifest they are reported in
+    bool analyze{false};
+    split_manifest_t::format_t manifest_format{split_manifest_t::none};
+    split_manifest_t manifest;
+
+    // CRC-32C of every output and its source region
+    bool checksum{false};
+
+    // cache parsed headers in a sidecar index next to the input
+    bool use_index{false};
+
+    // only write splits that are missing or differ from what is already in the output directory
+    bool incremental{false};
+    bool incremental_hash{false};
+
+    // write regions block by block on the calling thread instead of through the pipeline, for the least memory
+    bool streaming{false};
+
+    // encode splits as FLAC on this many threads (0 for one per hardware thread)
+    bool flac{false};
+    unsigned encode_threads{0};
+
+    // channels written to every split, and the mixer built from it for the source's format while splitting
+    channel_map_t channel_map;
+    std::unique_ptr<channel_mixer_t> mixer;
+
+    // file offset of the first sample in the source's 'data' chunk
+    uint64_t data_start{0};
+
+    // only the regions in selection are written if selected, part is "K/N" when they are one part of all regions
+    bool selected{false};
+    std::vector<size_t> selection;
+    std::string part;
+
+    void reset();
     void read_wav(const std::string &filename);
-    void read_labl(WAV_t &wav);
-    void read_cue(WAV_t &wav);
+    void parse_wav(const std::string &filename);
+    void read_source();
+    void plan_splits();
+    bool load_index(const std::string &filename);
+    void save_index(const std::string &filename, WAV_index_t &index);
+    void read_labl(const WAV_t &wav);
+    void read_cue(const WAV_t &wav);
+    void detect_silence(const WAV_t &wav);
+
+    // file name of split_wavs[index], including its shard subdirectory
+    std::string output_name(size_t index) const;
+
+    // indices of the regions split() writes
+    std::vector<size_t> regions_to_write() const;
+
+    // indices of the regions in part k (1 based) of n
+    std::vector<size_t> part_regions(uint32_t k, uint32_t n) const;
+
+    // read frames of the source through the mixer, scratch holds the unmixed frames
+    void read_frames(uint32_t frame, uint32_t frames, uint8_t *dst, byte_vector_t &scratch);
+
+    // write the regions split_wavs[pending[k]] and fill in entries[pending[k]]
+    void write_streaming(split_output_t &output, const std::vector<size_t> &pending, std::vector<manifest_entry_t> &entries);
+    void write_pipelined(split_output_t &output, const std::vector<size_t> &pending, std::vector<manifest_entry_t> &entries);
+    void write_flac(split_output_t &output, const std::vector<size_t> &pending, std::vector<manifest_entry_t> &entries);
 
     void output_dir_from_filename(const std::string &filename);
 
@@ -60,6 +145,16 @@ public:
 
     void open(const std::string &filename);
 
+    // parse from a stream, oversized payloads are left in file if one is given (see WAV_t)
+    void open(std::istream &f, std::shared_ptr<RIFF_file_t> file = nullptr);
+
+    // the parsed input, valid after open()
+    WAV_t &get_source();
+    const WAV_t &get_source() const;
+
+    // the bytes written in front of a region's samples
+    std::vector<uint8_t> get_header(const splitWAV &region) const;
+
     void set_prefix(const std::string &new_prefix);
     const std::string &get_prefix() const;
 
@@ -69,7 +164,68 @@ public:
     void set_output_directory(const std::string &new_output_directory);
     const std::string &get_output_directory() const;
 
+    void set_archive(const std::string &new_archive);
+    const std::string &get_archive() const;
+
+    void set_shard(const shard_options_t &new_shard);
+    const shard_options_t &get_shard() const;
+
+    void set_auto_split(bool new_auto_split);
+    bool get_auto_split() const;
+
+    void set_silence_options(const silence_options_t &new_silence);
+    const silence_options_t &get_silence_options() const;
+
+    void set_analyze(bool new_analyze);
+    bool get_analyze() const;
+
+    void set_manifest_format(split_manifest_t::format_t new_manifest_format);
+    split_manifest_t::format_t get_manifest_format() const;
+
+    const split_manifest_t &get_manifest() const;
+
+    void set_checksum(bool new_checksum);
+    bool get_checksum() const;
+
+    void set_use_index(bool new_use_index);
+    bool get_use_index() const;
+
+    void set_incremental(bool new_incremental, bool compare_hash = false);
+    bool get_incremental() const;
+    bool get_incremental_hash() const;
+
+    void set_streaming(bool new_streaming);
+    bool get_streaming() const;
+
+    void set_flac(bool new_flac, unsigned threads = 0);
+    bool get_flac() const;
+    unsigned get_encode_threads() const;
+
+    void set_channel_map(const channel_map_t &new_channel_map);
+    const channel_map_t &get_channel_map() const;
+
+    void set_max_buffered(uint32_t new_max_buffered);
+    uint32_t get_max_buffered() const;
+
     std::vector<splitWAV> &get_splits();
 
+    // heap split() is expected to need on top of the parsed headers, in bytes
+    uint64_t estimate_memory(bool streaming) const;
+
+    // replace the regions with a single one covering frames [start, end)
+    void select_range(uint32_t start, uint32_t end);
+
+    // the regions split() would write, their names and where they come from, without reading any samples
+    split_plan_t get_plan() const;
+
+    // only write part k (1 based) of n, consecutive regions with about the same number of frames in each part
+    void select_part(uint32_t k, uint32_t n);
+
+    // only write the regions listed in a plan, an exception is thrown if it was made for another input or options
+    void select_plan(const split_plan_t &plan);
+
     void split();
+
+    // re-hash the source regions listed in a manifest in one sequential pass, returns the number of mismatches
+    int verify(const std::string &manifest_file);
 };
\ No newline at end of file
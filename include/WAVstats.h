@@ -0,0 +1,83 @@
+#include <cstdint>
+#include <vector>
+
+#include "WAVparser.h"
+
+#pragma once
+
+/**
+ * Audio statistics of a single split. Levels are in dBFS, -infinity for digital silence.
+ */
+struct split_stats_t
+{
+    double peak_db;
+    double true_peak_db;
+    double rms_db;
+
+    // ITU-R BS.1770 gated integrated loudness, -infinity if the split is shorter than one 400ms block
+    double loudness_lufs;
+
+    // mean sample value of the channel with the largest offset, in full scale units
+    double dc_offset;
+
+    // samples at or beyond full scale
+    uint64_t clipped_samples;
+};
+
+/**
+ * Streaming statistics accumulator. PCM bytes of a region are fed in order while it is written.
+ */
+class stats_accumulator_t
+{
+private:
+    WAV_fmt_t m_fmt;
+    int m_channels{0};
+    float m_clip_level{1.0f};
+
+    std::vector<float> m_buffer;
+
+    // per channel state, m_channel holds one deinterleaved block with true peak history in front
+    std::vector<float> m_channel;
+    std::vector<float> m_history;
+    std::vector<double> m_sums;
+    std::vector<double> m_biquad;
+    std::vector<double> m_block_sums;
+    std::vector<double> m_weights;
+
+    double m_sum_squares{0};
+    float m_peak{0};
+    float m_true_peak{0};
+    uint64_t m_clipped{0};
+    uint64_t m_frames{0};
+
+    // K-weighting filter coefficients (shelf then high-pass)
+    double m_shelf_b[3];
+    double m_shelf_a[3];
+    double m_highpass_b[3];
+    double m_highpass_a[3];
+
+    // gating sub-blocks of 100ms
+    uint32_t m_subblock_frames{0};
+    uint32_t m_subblock_fill{0};
+    std::vector<double> m_subblocks;
+
+    void process_channel(int channel, uint32_t frames);
+
+public:
+    /**
+     * @param fmt Format of the PCM data. An exception will be thrown for unsupported sample formats.
+     */
+    stats_accumulator_t(const WAV_fmt_t &fmt);
+
+    /**
+     * Feed the next PCM bytes. Length must be a whole number of frames.
+     * @param bytes Interleaved PCM data.
+     * @param length Number of bytes.
+     */
+    void process(const uint8_t *bytes, size_t length);
+
+    /**
+     * @return The statistics of everything processed so far.
+     */
+    split_stats_t finish();
+};
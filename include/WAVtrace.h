@@ -0,0 +1,110 @@
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#pragma once
+
+/*
+ * Timeline tracing. Spans are recorded per thread while tracing is enabled and written as Chrome trace-event
+ * JSON, which chrome://tracing and Perfetto open directly.
+ *
+ * TRACE_SPAN(name[, detail]) times the rest of the enclosing scope. Without WAVSPLIT_TRACE (make TRACE=0) it
+ * expands to nothing; with it, a disabled span costs one relaxed atomic load.
+ */
+
+#ifdef WAVSPLIT_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(...) trace_span_t TRACE_CONCAT(trace_span_, __LINE__)(__VA_ARGS__)
+#else
+#define TRACE_SPAN(...) ((void)0)
+#endif
+
+class trace_t
+{
+private:
+    static std::atomic<bool> s_enabled;
+
+public:
+    static void enable();
+
+    static bool enabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @return Nanoseconds since the first call.
+     */
+    static uint64_t now();
+
+    /**
+     * Name the calling thread in the timeline.
+     */
+    static void name_thread(const std::string &name);
+
+    /**
+     * Record a finished span of the calling thread.
+     * @param name Must outlive the trace, spans are named with string literals.
+     * @param detail Shown as the span's argument, the region or file it worked on. May be empty.
+     */
+    static void record(const char *name, const std::string &detail, uint64_t begin, uint64_t end);
+
+    /**
+     * Write every span recorded so far. Threads should be idle, their buffers are read as they are.
+     */
+    static void write(const std::string &filename);
+};
+
+/**
+ * Times its own lifetime, use through TRACE_SPAN.
+ */
+class trace_span_t
+{
+private:
+    const char *m_name;
+    std::string m_detail;
+    uint64_t m_begin{0};
+    bool m_active;
+
+public:
+    trace_span_t(const char *name) : m_name(name), m_active(trace_t::enabled())
+    {
+        if (m_active)
+            m_begin = trace_t::now();
+    }
+
+    trace_span_t(const char *name, const std::string &detail) : m_name(name), m_active(trace_t::enabled())
+    {
+        if (m_active)
+        {
+            m_detail = detail;
+            m_begin = trace_t::now();
+        }
+    }
+
+    ~trace_span_t()
+    {
+        if (m_active)
+            trace_t::record(m_name, m_detail, m_begin, trace_t::now());
+    }
+
+    trace_span_t(const trace_span_t &) = delete;
+    trace_span_t &operator=(const trace_span_t &) = delete;
+};
+
+/**
+ * Enables tracing for its lifetime and writes the trace when it goes out of scope.
+ */
+class trace_session_t
+{
+private:
+    std::string m_filename;
+
+public:
+    /**
+     * @param filename Where the trace goes, nothing is traced if empty.
+     */
+    trace_session_t(const std::string &filename);
+    ~trace_session_t();
+};
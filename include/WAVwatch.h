@@ -0,0 +1,94 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "WAVsplit.h"
+#include "WorkerPool.h"
+
+#pragma once
+
+/**
+ * Snapshot of a watcher's counters.
+ */
+struct watch_status_t
+{
+    // files waiting for a worker and files being split
+    size_t queued{0};
+    size_t active{0};
+
+    uint64_t done{0};
+    uint64_t failed{0};
+
+    // input bytes of the finished files
+    uint64_t bytes{0};
+
+    // seconds since the watcher started
+    double uptime{0};
+};
+
+/**
+ * Watches a spool directory and splits every WAV file that is completely written into it (closed
+ * after writing or renamed in). Files are split on a pool of workers that each keep a WAVsplitter
+ * between files, then moved into done/ or failed/ below the spool directory.
+ */
+class WAV_watcher_t
+{
+private:
+    std::string m_directory;
+    std::string m_output_root;
+
+    std::vector<std::unique_ptr<WAVsplitter>> m_splitters;
+
+    // names queued or being split, repeated events for them are ignored
+    std::set<std::string> m_pending;
+    std::mutex m_mutex;
+
+    std::atomic<uint64_t> m_done{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::atomic<uint64_t> m_bytes{0};
+    std::chrono::steady_clock::time_point m_start;
+
+    // files and bytes finished at recent status updates, only touched by run()
+    struct rate_sample_t
+    {
+        double time;
+        uint64_t files;
+        uint64_t bytes;
+    };
+    std::deque<rate_sample_t> m_rate_samples;
+
+    // last so the workers are gone before anything they use
+    worker_pool_t m_pool;
+
+    void enqueue(const std::string &name);
+    void process(unsigned worker, const std::string &name);
+    void write_status();
+
+public:
+    /**
+     * Create done/ and failed/ in the spool directory and start the workers. An exception will be
+     * thrown if the spool directory can't be used.
+     * @param directory The spool directory.
+     * @param output_root Splits of file.wav are written to output_root/file/.
+     * @param workers Number of workers, 0 for one per hardware thread.
+     * @param configure Applied once to each worker's WAVsplitter to set the split options.
+     */
+    WAV_watcher_t(const std::string &directory, const std::string &output_root, unsigned workers,
+                  const std::function<void(WAVsplitter &)> &configure);
+
+    watch_status_t status() const;
+
+    /**
+     * Split the files already in the spool directory, then every file that arrives until SIGINT or
+     * SIGTERM. The running splits are finished before returning, queued files stay in the spool
+     * directory for the next start. The counters are kept in .wavsplit-status.json in the spool directory.
+     */
+    void run();
+};
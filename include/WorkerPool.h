@@ -0,0 +1,70 @@
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#pragma once
+
+/**
+ * Fixed set of threads running submitted jobs in submission order. The threads live as long as the
+ * pool, so jobs can keep per-worker state (parsers, buffers) warm from one job to the next.
+ */
+class worker_pool_t
+{
+public:
+    // a job is given the index of the worker running it, in [0, size())
+    using job_t = std::function<void(unsigned worker)>;
+
+private:
+    std::vector<std::thread> m_threads;
+    std::deque<job_t> m_jobs;
+    size_t m_active{0};
+    bool m_stopping{false};
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+
+    void run(unsigned worker);
+
+public:
+    /**
+     * @param threads Number of workers, 0 starts one per hardware thread.
+     */
+    worker_pool_t(unsigned threads = 0);
+
+    /**
+     * Discards the queued jobs and waits for the running ones.
+     */
+    ~worker_pool_t();
+
+    worker_pool_t(const worker_pool_t &) = delete;
+    worker_pool_t &operator=(const worker_pool_t &) = delete;
+
+    unsigned size() const;
+
+    /**
+     * Queue a job. A job that throws is abandoned, it has to report its own errors.
+     */
+    void submit(job_t job);
+
+    // jobs waiting for a worker
+    size_t queued() const;
+
+    // jobs being run right now
+    size_t active() const;
+
+    /**
+     * Block until every submitted job has finished.
+     */
+    void wait();
+
+    /**
+     * Drop the jobs that have not started yet and wait for the running ones.
+     * @return The number of jobs dropped.
+     */
+    size_t cancel();
+};
@@ -0,0 +1,118 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#pragma once
+
+/*
+ * C interface of libwavsplit. Splits a WAV file at its cue points (or on silence) and hands every region
+ * to a callback as the bytes of a complete WAV file, without writing anything to disk.
+ *
+ * The interface is stable: structs passed in carry their own size so fields can be added at the end, and
+ * only the functions below are exported from the shared library.
+ */
+
+#if defined(__GNUC__)
+#define WAVSPLIT_API __attribute__((visibility("default")))
+#else
+#define WAVSPLIT_API
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define WAVSPLIT_API_VERSION 1
+
+/* return values */
+#define WAVSPLIT_OK 0
+#define WAVSPLIT_STOPPED 1
+#define WAVSPLIT_ERROR -1
+#define WAVSPLIT_ERROR_ALLOCATION -2
+#define WAVSPLIT_ERROR_ARGUMENT -3
+
+/*
+ * Memory for region data. release receives the size that was passed to allocate.
+ */
+typedef struct wavsplit_allocator_t
+{
+    void *(*allocate)(void *context, size_t size);
+    void (*release)(void *context, void *pointer, size_t size);
+    void *context;
+} wavsplit_allocator_t;
+
+typedef struct wavsplit_options_t
+{
+    /* sizeof(wavsplit_options_t), set by wavsplit_options_init() */
+    size_t size;
+
+    /* split on silence when the file has no cue points */
+    int auto_split;
+    double silence_threshold_db;
+    double silence_min_duration;
+
+    /* NULL for malloc and free */
+    const wavsplit_allocator_t *allocator;
+} wavsplit_options_t;
+
+/*
+ * One region, as a complete WAV file: header, then data, then padding zero bytes. The pointers are only
+ * valid during the callback.
+ */
+typedef struct wavsplit_region_t
+{
+    /* file name the command line tool would write the region to */
+    const char *name;
+    uint32_t index;
+
+    /* position and length in the source, in sample frames */
+    uint32_t frame_offset;
+    uint32_t frames;
+
+    const uint8_t *header;
+    size_t header_size;
+
+    const uint8_t *data;
+    size_t data_size;
+
+    /* 0 or 1 */
+    size_t padding;
+} wavsplit_region_t;
+
+/*
+ * Called once per region, in order. Return 0 to continue, anything else stops splitting.
+ */
+typedef int (*wavsplit_region_callback_t)(void *user, const wavsplit_region_t *region);
+
+/*
+ * Fill options with the defaults.
+ */
+WAVSPLIT_API void wavsplit_options_init(wavsplit_options_t *options);
+
+/*
+ * Split a WAV file read from a descriptor. The descriptor must refer to a seekable file holding the WAV at
+ * offset 0, it is read by position and neither closed nor moved. options may be NULL for the defaults.
+ * Returns WAVSPLIT_OK, WAVSPLIT_STOPPED if the callback stopped early, or a negative error.
+ */
+WAVSPLIT_API int wavsplit_split_fd(int fd, const wavsplit_options_t *options, wavsplit_region_callback_t callback,
+                                   void *user);
+
+/*
+ * Split a WAV file held in memory. Region data points straight into the buffer, nothing is copied.
+ */
+WAVSPLIT_API int wavsplit_split_memory(const void *buffer, size_t size, const wavsplit_options_t *options,
+                                       wavsplit_region_callback_t callback, void *user);
+
+/*
+ * Description of the last error on the calling thread, empty if there was none.
+ */
+WAVSPLIT_API const char *wavsplit_last_error(void);
+
+/*
+ * WAVSPLIT_API_VERSION of the library that is loaded.
+ */
+WAVSPLIT_API int wavsplit_api_version(void);
+
+#ifdef __cplusplus
+}
+#endif
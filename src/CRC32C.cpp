@@ -0,0 +1,82 @@
+#include "CRC32C.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// reflected Castagnoli polynomial
+static const uint32_t polynomial = 0x82f63b78;
+
+struct crc32c_table_t
+{
+    uint32_t t[8][256];
+
+    crc32c_table_t()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i;
+            for (int b = 0; b < 8; b++)
+                crc = crc & 1 ? (crc >> 1) ^ polynomial : crc >> 1;
+            t[0][i] = crc;
+        }
+
+        for (uint32_t i = 0; i < 256; i++)
+            for (int s = 1; s < 8; s++)
+                t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+    }
+};
+
+static uint32_t crc32c_software(uint32_t crc, const uint8_t *data, size_t length)
+{
+    static const crc32c_table_t table;
+    const uint32_t(&t)[8][256] = table.t;
+
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        uint64_t v;
+        memcpy(&v, data, 8);
+        v ^= crc;
+        crc = t[7][v & 0xff] ^ t[6][(v >> 8) & 0xff] ^ t[5][(v >> 16) & 0xff] ^ t[4][(v >> 24) & 0xff] ^
+              t[3][(v >> 32) & 0xff] ^ t[2][(v >> 40) & 0xff] ^ t[1][(v >> 48) & 0xff] ^ t[0][v >> 56];
+    }
+
+    for (; length > 0; data++, length--)
+        crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hardware(uint32_t crc, const uint8_t *data, size_t length)
+{
+    uint64_t c = crc;
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        uint64_t v;
+        memcpy(&v, data, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+
+    uint32_t c32 = static_cast<uint32_t>(c);
+    for (; length > 0; data++, length--)
+        c32 = _mm_crc32_u8(c32, *data);
+
+    return c32;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const uint8_t *data, size_t length)
+{
+    crc = ~crc;
+
+#if defined(__x86_64__)
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware)
+        return ~crc32c_hardware(crc, data, length);
+#endif
+
+    return ~crc32c_software(crc, data, length);
+}
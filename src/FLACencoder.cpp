@@ -0,0 +1,624 @@
+#include "FLACencoder.h"
+#include "WAVpcm.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+static const uint32_t max_fixed_order = 4;
+static const uint32_t max_lpc_order = 8;
+static const uint32_t max_partition_order = 8;
+
+// Rice parameters above this need the 5 bit parameter coding (RICE2)
+static const uint32_t max_rice_parameter = 14;
+static const uint32_t max_rice2_parameter = 30;
+
+// the fixed predictors of order 0 to 4 written as LPC coefficients with a shift of 0
+static const int32_t fixed_coefficients[max_fixed_order + 1][max_fixed_order] = {
+    {0, 0, 0, 0}, {1, 0, 0, 0}, {2, -1, 0, 0}, {3, -3, 1, 0}, {4, -6, 4, -1}};
+
+// ====================================================================================================================
+// CRC-8 (x^8 + x^2 + x + 1) over frame headers and CRC-16 (x^16 + x^15 + x^2 + 1) over whole frames
+static uint8_t crc8(const uint8_t *data, size_t length)
+{
+    static const std::array<uint8_t, 256> table = []() {
+        std::array<uint8_t, 256> t;
+        for (int i = 0; i < 256; i++)
+        {
+            uint8_t crc = i;
+            for (int b = 0; b < 8; b++)
+                crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+            t[i] = crc;
+        }
+        return t;
+    }();
+
+    uint8_t crc{0};
+    for (size_t i = 0; i < length; i++)
+        crc = table[crc ^ data[i]];
+    return crc;
+}
+
+static uint16_t crc16(const uint8_t *data, size_t length)
+{
+    static const std::array<uint16_t, 256> table = []() {
+        std::array<uint16_t, 256> t;
+        for (int i = 0; i < 256; i++)
+        {
+            uint16_t crc = i << 8;
+            for (int b = 0; b < 8; b++)
+                crc = crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1;
+            t[i] = crc;
+        }
+        return t;
+    }();
+
+    uint16_t crc{0};
+    for (size_t i = 0; i < length; i++)
+        crc = (crc << 8) ^ table[(crc >> 8) ^ data[i]];
+    return crc;
+}
+
+// ====================================================================================================================
+// appends bits most significant first
+class bit_writer_t
+{
+private:
+    std::vector<uint8_t> &m_out;
+    uint64_t m_buffer{0};
+    unsigned m_bits{0};
+
+public:
+    bit_writer_t(std::vector<uint8_t> &out) : m_out(out)
+    {
+    }
+
+    // the low bits of value, at most 32
+    void write(uint32_t value, unsigned bits)
+    {
+        if (bits == 0)
+            return;
+
+        m_buffer = (m_buffer << bits) | (value & (0xffffffffu >> (32 - bits)));
+        m_bits += bits;
+        while (m_bits >= 8)
+        {
+            m_bits -= 8;
+            m_out.push_back(static_cast<uint8_t>(m_buffer >> m_bits));
+        }
+    }
+
+    void write_signed(int32_t value, unsigned bits)
+    {
+        write(static_cast<uint32_t>(value), bits);
+    }
+
+    // value as a quotient in unary and parameter low bits
+    void write_rice(uint32_t value, uint32_t parameter)
+    {
+        uint32_t quotient = value >> parameter;
+        uint32_t low = value & ((1u << parameter) - 1);
+        if (quotient + parameter < 32)
+        {
+            write((1u << parameter) | low, quotient + 1 + parameter);
+            return;
+        }
+
+        for (; quotient >= 32; quotient -= 32)
+            write(0, 32);
+        write(1, quotient + 1);
+        write(low, parameter);
+    }
+
+    // UTF-8 style variable length number, as used for frame numbers
+    void write_utf8(uint64_t value)
+    {
+        if (value < 0x80)
+        {
+            write(value, 8);
+            return;
+        }
+
+        int bytes = 2;
+        while (bytes < 7 && value >= (1ull << (5 * bytes + 1)))
+            bytes++;
+
+        write((0xff00 >> bytes) | (value >> (6 * (bytes - 1))), 8);
+        for (int i = bytes - 2; i >= 0; i--)
+            write(0x80 | ((value >> (6 * i)) & 0x3f), 8);
+    }
+
+    void align()
+    {
+        if (m_bits)
+            write(0, 8 - m_bits);
+    }
+};
+
+// ====================================================================================================================
+// one channel of one frame, as it will be coded
+struct subframe_t
+{
+    enum type_t
+    {
+        constant,
+        verbatim,
+        fixed,
+        lpc
+    };
+
+    type_t type{verbatim};
+    uint32_t order{0};
+
+    // LPC only
+    uint32_t precision{0};
+    int shift{0};
+    int32_t coefficients[max_lpc_order]{0};
+
+    // zig-zag coded residual of the samples after the warm-up, and how it is partitioned
+    std::vector<uint32_t> residual;
+    uint32_t partition_order{0};
+    std::vector<uint32_t> parameters;
+    bool rice2{false};
+
+    uint64_t bits{0};
+};
+
+// residual of a linear predictor, false if it doesn't fit the 32 bits FLAC allows
+static bool predict(const int32_t *x, uint32_t n, const int32_t *coefficients, uint32_t order, int shift,
+                    std::vector<uint32_t> &residual)
+{
+    residual.resize(n - order);
+
+    int64_t low{0};
+    int64_t high{0};
+    for (uint32_t i = order; i < n; i++)
+    {
+        int64_t sum{0};
+        for (uint32_t j = 0; j < order; j++)
+            sum += static_cast<int64_t>(coefficients[j]) * x[i - 1 - j];
+
+        int64_t r = x[i] - (sum >> shift);
+        low = std::min(low, r);
+        high = std::max(high, r);
+        residual[i - order] = static_cast<uint32_t>(r >= 0 ? 2 * r : -2 * r - 1);
+    }
+
+    return low > INT32_MIN && high <= INT32_MAX;
+}
+
+// the parameter for a partition of count values summing to sum, about log2 of their mean
+static uint32_t rice_parameter(uint64_t sum, uint32_t count)
+{
+    uint32_t parameter{0};
+    while (parameter < max_rice2_parameter && (static_cast<uint64_t>(count) << (parameter + 1)) <= sum)
+        parameter++;
+    return parameter;
+}
+
+// pick the partition order and parameters for the residual, returns the size of the residual section in bits
+static uint64_t plan_residual(subframe_t &s, uint32_t n)
+{
+    uint32_t finest{0};
+    while (finest < max_partition_order && n % (2u << finest) == 0 && (n >> (finest + 1)) > s.order)
+        finest++;
+
+    // sums at the finest order, coarser orders add up neighbouring partitions
+    std::vector<uint64_t> sums(1u << finest, 0);
+    uint32_t length = n >> finest;
+    for (uint32_t p = 0, i = 0; p < sums.size(); p++)
+        for (uint32_t end = (p + 1) * length - s.order; i < end; i++)
+            sums[p] += s.residual[i];
+
+    uint64_t best{UINT64_MAX};
+    std::vector<uint32_t> parameters;
+    for (int order = finest; order >= 0; order--)
+    {
+        uint32_t partitions = 1u << order;
+        length = n >> order;
+
+        uint64_t bits{2 + 4};
+        bool rice2{false};
+        parameters.resize(partitions);
+        for (uint32_t p = 0; p < partitions; p++)
+        {
+            uint32_t count = length - (p == 0 ? s.order : 0);
+            parameters[p] = rice_parameter(sums[p], count);
+            bits += static_cast<uint64_t>(count) * (parameters[p] + 1) + (sums[p] >> parameters[p]);
+            rice2 |= parameters[p] > max_rice_parameter;
+        }
+        bits += partitions * (rice2 ? 5 : 4);
+
+        if (bits < best)
+        {
+            best = bits;
+            s.partition_order = order;
+            s.parameters = parameters;
+            s.rice2 = rice2;
+        }
+
+        for (uint32_t p = 0; p < partitions / 2; p++)
+            sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+
+    return best;
+}
+
+// Levinson-Durbin recursion, lp[o - 1] receives the predictor of order o and error[o - 1] its error
+static uint32_t levinson(const double *autocorrelation, uint32_t max_order, double lp[][max_lpc_order], double *error)
+{
+    double a[max_lpc_order]{0};
+    double e = autocorrelation[0];
+
+    for (uint32_t i = 0; i < max_order; i++)
+    {
+        double acc = -autocorrelation[i + 1];
+        for (uint32_t j = 0; j < i; j++)
+            acc -= a[j] * autocorrelation[i - j];
+        double reflection = acc / e;
+
+        a[i] = reflection;
+        uint32_t j = 0;
+        for (; j < i / 2; j++)
+        {
+            double t = a[j];
+            a[j] += reflection * a[i - 1 - j];
+            a[i - 1 - j] += reflection * t;
+        }
+        if (i % 2)
+            a[j] += a[j] * reflection;
+
+        e *= 1.0 - reflection * reflection;
+        for (j = 0; j <= i; j++)
+            lp[i][j] = -a[j];
+        error[i] = e;
+
+        if (!(e > 0))
+            return i + 1;
+    }
+    return max_order;
+}
+
+// integer coefficients of precision bits (sign included) and the shift that scales them back
+static bool quantize(const double *lp, uint32_t order, uint32_t precision, int32_t *coefficients, int &shift)
+{
+    double largest{0};
+    for (uint32_t i = 0; i < order; i++)
+    {
+        if (!std::isfinite(lp[i]))
+            return false;
+        largest = std::max(largest, std::fabs(lp[i]));
+    }
+    if (!(largest > 0))
+        return false;
+
+    int exponent;
+    frexp(largest, &exponent);
+    shift = std::min(static_cast<int>(precision) - exponent - 1, 15);
+    if (shift < 0)
+        return false;
+
+    // carry the rounding error to the next coefficient
+    const int32_t high = (1 << (precision - 1)) - 1;
+    const int32_t low = -(1 << (precision - 1));
+    double carry{0};
+    for (uint32_t i = 0; i < order; i++)
+    {
+        carry += lp[i] * (1 << shift);
+        long q = std::max<long>(low, std::min<long>(high, lround(carry)));
+        coefficients[i] = q;
+        carry -= q;
+    }
+    return true;
+}
+
+// coefficient precision by block size, more bits only pay off for longer blocks
+static uint32_t lpc_precision(uint32_t n)
+{
+    return n <= 192 ? 7 : n <= 384 ? 8 : n <= 576 ? 9 : n <= 1152 ? 10 : n <= 2304 ? 11 : n <= 4608 ? 12 : 13;
+}
+
+// Tukey (0.5) window
+static void tukey(std::vector<double> &window, uint32_t n)
+{
+    window.assign(n, 1.0);
+    uint32_t taper = n / 4;
+    for (uint32_t i = 0; i < taper; i++)
+    {
+        double w = 0.5 - 0.5 * cos(M_PI * i / taper);
+        window[i] = w;
+        window[n - 1 - i] = w;
+    }
+}
+
+// the smallest coding of one channel of bits bit samples
+static void plan_subframe(const int32_t *x, uint32_t n, uint32_t bits, const std::vector<double> &window, subframe_t &best)
+{
+    best.type = subframe_t::verbatim;
+    best.order = 0;
+    best.bits = 8 + static_cast<uint64_t>(n) * bits;
+
+    if (std::all_of(x, x + n, [x](int32_t v) { return v == x[0]; }))
+    {
+        best.type = subframe_t::constant;
+        best.bits = 8 + bits;
+        return;
+    }
+
+    subframe_t candidate;
+    auto consider = [&](uint64_t header_bits) {
+        candidate.bits = header_bits + plan_residual(candidate, n);
+        if (candidate.bits < best.bits)
+            std::swap(best, candidate);
+    };
+
+    for (uint32_t order = 0; order <= max_fixed_order && order < n; order++)
+    {
+        candidate.type = subframe_t::fixed;
+        candidate.order = order;
+        if (predict(x, n, fixed_coefficients[order], order, 0, candidate.residual))
+            consider(8 + order * bits);
+    }
+
+    uint32_t max_order = std::min(max_lpc_order, n - 1);
+    if (max_order < 1)
+        return;
+
+    // autocorrelation of the windowed block, lag by lag over contiguous arrays
+    std::vector<double> windowed(n);
+    for (uint32_t i = 0; i < n; i++)
+        windowed[i] = x[i] * window[i];
+
+    double autocorrelation[max_lpc_order + 1];
+    for (uint32_t lag = 0; lag <= max_order; lag++)
+    {
+        double sum{0};
+        for (uint32_t i = lag; i < n; i++)
+            sum += windowed[i] * windowed[i - lag];
+        autocorrelation[lag] = sum;
+    }
+    if (!(autocorrelation[0] > 0))
+        return;
+
+    double lp[max_lpc_order][max_lpc_order];
+    double error[max_lpc_order];
+    max_order = levinson(autocorrelation, max_order, lp, error);
+
+    // the order with the fewest expected bits, from the prediction error alone
+    uint32_t precision = lpc_precision(n);
+    uint32_t order{0};
+    double fewest{HUGE_VAL};
+    for (uint32_t o = 1; o <= max_order; o++)
+    {
+        double per_sample = error[o - 1] > 0 ? std::max(0.0, 0.5 * log2(0.5 / n * error[o - 1])) : 0;
+        double expected = per_sample * (n - o) + o * (precision + bits);
+        if (expected < fewest)
+        {
+            fewest = expected;
+            order = o;
+        }
+    }
+
+    candidate.type = subframe_t::lpc;
+    candidate.order = order;
+    candidate.precision = precision;
+    if (quantize(lp[order - 1], order, precision, candidate.coefficients, candidate.shift) &&
+        predict(x, n, candidate.coefficients, order, candidate.shift, candidate.residual))
+        consider(8 + order * bits + 4 + 5 + order * precision);
+}
+
+static void write_subframe(bit_writer_t &out, const subframe_t &s, const int32_t *x, uint32_t n, uint32_t bits)
+{
+    switch (s.type)
+    {
+    case subframe_t::constant:
+        out.write(0x00, 8);
+        out.write_signed(x[0], bits);
+        return;
+
+    case subframe_t::verbatim:
+        out.write(0x02, 8);
+        for (uint32_t i = 0; i < n; i++)
+            out.write_signed(x[i], bits);
+        return;
+
+    case subframe_t::fixed:
+        out.write((0x08 | s.order) << 1, 8);
+        break;
+
+    case subframe_t::lpc:
+        out.write((0x20 | (s.order - 1)) << 1, 8);
+        break;
+    }
+
+    for (uint32_t i = 0; i < s.order; i++)
+        out.write_signed(x[i], bits);
+
+    if (s.type == subframe_t::lpc)
+    {
+        out.write(s.precision - 1, 4);
+        out.write_signed(s.shift, 5);
+        for (uint32_t i = 0; i < s.order; i++)
+            out.write_signed(s.coefficients[i], s.precision);
+    }
+
+    out.write(s.rice2 ? 1 : 0, 2);
+    out.write(s.partition_order, 4);
+
+    uint32_t length = n >> s.partition_order;
+    const uint32_t *r = s.residual.data();
+    for (uint32_t p = 0; p < s.parameters.size(); p++)
+    {
+        out.write(s.parameters[p], s.rice2 ? 5 : 4);
+        for (uint32_t i = p == 0 ? s.order : 0; i < length; i++)
+            out.write_rice(*r++, s.parameters[p]);
+    }
+}
+
+// ====================================================================================================================
+const uint32_t FLAC_encoder_t::block_size;
+
+FLAC_encoder_t::FLAC_encoder_t(const WAV_fmt_t &fmt) : m_fmt(fmt)
+{
+    int container = pcm_container_size(fmt);
+    if (pcm_is_float(fmt) || container > 3)
+        throw std::runtime_error("FLAC output needs 8, 16 or 24 bit integer PCM.");
+    if (fmt.num_channels > 8)
+        throw std::runtime_error("FLAC output supports at most 8 channels.");
+    if (fmt.sample_rate == 0 || fmt.sample_rate >= 1 << 20)
+        throw std::runtime_error("The sample rate can't be stored in FLAC.");
+
+    m_sample_rate = fmt.sample_rate;
+    m_channels = fmt.num_channels;
+    m_bits = container * 8;
+}
+
+std::vector<uint8_t> FLAC_encoder_t::stream_header(uint64_t frames) const
+{
+    std::vector<uint8_t> bytes{'f', 'L', 'a', 'C'};
+    bit_writer_t out(bytes);
+
+    // STREAMINFO, the only (last) metadata block
+    out.write(0x80, 8);
+    out.write(34, 24);
+
+    out.write(block_size, 16);
+    out.write(block_size, 16);
+    out.write(0, 24);
+    out.write(0, 24);
+    out.write(m_sample_rate, 20);
+    out.write(m_channels - 1, 3);
+    out.write(m_bits - 1, 5);
+    out.write(frames >> 32, 4);
+    out.write(frames & 0xffffffff, 32);
+    for (int i = 0; i < 4; i++)
+        out.write(0, 32);
+
+    return bytes;
+}
+
+void FLAC_encoder_t::encode(const uint8_t *pcm, uint32_t frames, uint64_t first, std::vector<uint8_t> &out) const
+{
+    std::vector<int32_t> interleaved(static_cast<size_t>(std::min(frames, block_size)) * m_channels);
+    std::vector<std::vector<int32_t>> channels(m_channels, std::vector<int32_t>(block_size));
+
+    for (uint32_t done = 0, n; done < frames; done += n, first++)
+    {
+        n = std::min(block_size, frames - done);
+        pcm_to_int(pcm + static_cast<size_t>(done) * m_fmt.block_align, static_cast<size_t>(n) * m_channels, m_fmt,
+                   interleaved.data());
+
+        for (uint32_t c = 0; c < m_channels; c++)
+            for (uint32_t i = 0; i < n; i++)
+                channels[c][i] = interleaved[static_cast<size_t>(i) * m_channels + c];
+
+        encode_frame(channels, n, first, out);
+    }
+}
+
+void FLAC_encoder_t::encode_frame(const std::vector<std::vector<int32_t>> &channels, uint32_t n, uint64_t number,
+                                  std::vector<uint8_t> &out) const
+{
+    std::vector<double> window;
+    tukey(window, n);
+
+    // the channels as coded, and the channel assignment of the frame header
+    std::vector<subframe_t> subframes(m_channels);
+    std::vector<const int32_t *> sources(m_channels);
+    std::vector<uint32_t> bits(m_channels, m_bits);
+    uint32_t assignment = m_channels - 1;
+
+    for (uint32_t c = 0; c < m_channels; c++)
+        sources[c] = channels[c].data();
+
+    std::vector<int32_t> side;
+    std::vector<int32_t> mid;
+    if (m_channels == 2)
+    {
+        // side takes one more bit than the input
+        side.resize(n);
+        mid.resize(n);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            side[i] = channels[0][i] - channels[1][i];
+            mid[i] = (channels[0][i] + channels[1][i]) >> 1;
+        }
+
+        subframe_t left, right, s, m;
+        plan_subframe(channels[0].data(), n, m_bits, window, left);
+        plan_subframe(channels[1].data(), n, m_bits, window, right);
+        plan_subframe(side.data(), n, m_bits + 1, window, s);
+        plan_subframe(mid.data(), n, m_bits, window, m);
+
+        // independent, left/side, side/right, mid/side
+        uint64_t sizes[4] = {left.bits + right.bits, left.bits + s.bits, s.bits + right.bits, m.bits + s.bits};
+        int choice = std::min_element(sizes, sizes + 4) - sizes;
+        switch (choice)
+        {
+        case 0:
+            subframes[0] = std::move(left);
+            subframes[1] = std::move(right);
+            break;
+        case 1:
+            assignment = 8;
+            subframes[0] = std::move(left);
+            subframes[1] = std::move(s);
+            sources[1] = side.data();
+            bits[1] = m_bits + 1;
+            break;
+        case 2:
+            assignment = 9;
+            subframes[0] = std::move(s);
+            subframes[1] = std::move(right);
+            sources[0] = side.data();
+            bits[0] = m_bits + 1;
+            break;
+        case 3:
+            assignment = 10;
+            subframes[0] = std::move(m);
+            subframes[1] = std::move(s);
+            sources[0] = mid.data();
+            sources[1] = side.data();
+            bits[1] = m_bits + 1;
+            break;
+        }
+    }
+    else
+    {
+        for (uint32_t c = 0; c < m_channels; c++)
+            plan_subframe(sources[c], n, m_bits, window, subframes[c]);
+    }
+
+    size_t start = out.size();
+    bit_writer_t w(out);
+
+    // sync code and fixed block size strategy
+    w.write(0xfff8, 16);
+
+    uint32_t size_code = n == block_size ? 12 : n <= 256 ? 6 : 7;
+    static const uint32_t rates[] = {0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000};
+    uint32_t rate_code = std::find(rates + 1, rates + 12, m_sample_rate) - rates;
+    w.write(size_code, 4);
+    w.write(rate_code == 12 ? 0 : rate_code, 4);
+
+    w.write(assignment, 4);
+    w.write(m_bits == 8 ? 1 : m_bits == 16 ? 4 : 6, 3);
+    w.write(0, 1);
+
+    w.write_utf8(number);
+    if (size_code == 6)
+        w.write(n - 1, 8);
+    else if (size_code == 7)
+        w.write(n - 1, 16);
+    w.write(crc8(out.data() + start, out.size() - start), 8);
+
+    for (uint32_t c = 0; c < m_channels; c++)
+        write_subframe(w, subframes[c], sources[c], n, bits[c]);
+
+    w.align();
+    uint16_t crc = crc16(out.data() + start, out.size() - start);
+    w.write(crc, 16);
+}
@@ -1,8 +1,237 @@
 #include "RIFFparser.h"
+#include "WAVprogress.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+
+// size of the blocks used to copy payloads between streams and files
+static const size_t copy_block_size = 1 << 16;
+
+// ====================================================================================================================
+RIFF_file_t::RIFF_file_t(int fd) : m_fd(fd)
+{
+}
+
+RIFF_file_t::RIFF_file_t(const uint8_t *memory, uint64_t size) : m_memory(memory), m_memory_size(size)
+{
+}
+
+RIFF_file_t::~RIFF_file_t()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+std::shared_ptr<RIFF_file_t> RIFF_file_t::open(const std::string &filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("An error occurred opening the specified RIFF file.");
+
+    return std::make_shared<RIFF_file_t>(fd);
+}
+
+std::shared_ptr<RIFF_file_t> RIFF_file_t::temporary()
+{
+    const char *dir = getenv("TMPDIR");
+    std::string path = std::string(dir && *dir ? dir : "/tmp") + "/wavsplit-XXXXXX";
+
+    int fd = mkstemp(&path.front());
+    if (fd < 0)
+        throw std::runtime_error("Unable to create a temporary spool file.");
+
+    // the file disappears as soon as the descriptor is closed
+    unlink(path.c_str());
+    return std::make_shared<RIFF_file_t>(fd);
+}
+
+int RIFF_file_t::fd() const
+{
+    return m_fd;
+}
+
+const uint8_t *RIFF_file_t::memory() const
+{
+    return m_memory;
+}
+
+size_t RIFF_file_t::read_some(uint64_t offset, uint8_t *dst, size_t length) const
+{
+    if (m_memory)
+    {
+        if (offset >= m_memory_size)
+            return 0;
+        if (length > m_memory_size - offset)
+            length = m_memory_size - offset;
+
+        memcpy(dst, m_memory + offset, length);
+        return length;
+    }
+
+    while (true)
+    {
+        ssize_t n = pread(m_fd, dst, length, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw std::runtime_error("Unable to read chunk data from file.");
+
+        return n;
+    }
+}
+
+void RIFF_file_t::read(uint64_t offset, uint8_t *dst, size_t length) const
+{
+    if (m_memory)
+    {
+        if (read_some(offset, dst, length) != length)
+            throw std::runtime_error("Unable to read chunk data from file.");
+        return;
+    }
+
+    while (length > 0)
+    {
+        ssize_t n = pread(m_fd, dst, length, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            throw std::runtime_error("Unable to read chunk data from file.");
+
+        dst += n;
+        offset += n;
+        length -= n;
+    }
+}
+
+void RIFF_file_t::write(uint64_t offset, const uint8_t *src, size_t length)
+{
+    if (m_memory)
+        throw std::runtime_error("Unable to write chunk data to a buffer in memory.");
+
+    while (length > 0)
+    {
+        ssize_t n = pwrite(m_fd, src, length, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            throw std::runtime_error("Unable to write chunk data to file.");
+
+        src += n;
+        offset += n;
+        length -= n;
+    }
+}
 
 // ====================================================================================================================
+RIFF_file_streambuf_t::RIFF_file_streambuf_t(std::shared_ptr<RIFF_file_t> file) : m_file(file), m_buffer(copy_block_size)
+{
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+}
+
+RIFF_file_streambuf_t::int_type RIFF_file_streambuf_t::underflow()
+{
+    m_position += egptr() - eback();
+
+    size_t n = m_file->read_some(m_position, reinterpret_cast<uint8_t *>(m_buffer.data()), m_buffer.size());
+    setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + n);
+
+    return n == 0 ? traits_type::eof() : traits_type::to_int_type(*gptr());
+}
+
+RIFF_file_streambuf_t::pos_type RIFF_file_streambuf_t::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+    if (!(which & std::ios_base::in) || dir == std::ios_base::end)
+        return pos_type(off_type(-1));
+
+    uint64_t current = m_position + (gptr() - eback());
+    uint64_t target = dir == std::ios_base::beg ? off : current + off;
+
+    // stay in the buffer if the target is inside it, otherwise refill from the target on the next read
+    if (target >= m_position && target <= m_position + (egptr() - eback()))
+    {
+        setg(eback(), eback() + (target - m_position), egptr());
+    }
+    else
+    {
+        m_position = target;
+        setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+    }
+    return pos_type(off_type(target));
+}
+
+RIFF_file_streambuf_t::pos_type RIFF_file_streambuf_t::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+// ====================================================================================================================
+RIFF_input_t::RIFF_input_t(std::istream &f, uint32_t max_buffered, std::shared_ptr<RIFF_file_t> file)
+    : stream(f), max_buffered(max_buffered), file(file)
+{
+}
+
+void RIFF_input_t::read(void *dst, size_t length)
+{
+    stream.read(reinterpret_cast<char *>(dst), length);
+    if (static_cast<size_t>(stream.gcount()) != length)
+        throw std::runtime_error("Unexpected end of RIFF data.");
+
+    offset += length;
+    progress_t::input_read(length);
+}
+
+void RIFF_input_t::skip(uint64_t length)
+{
+    if (file)
+    {
+        // seeking past the end succeeds, read the last skipped byte so a truncated payload is still noticed
+        uint8_t last;
+        if (length > 0 && file->read_some(offset + length - 1, &last, 1) != 1)
+            throw std::runtime_error("Unexpected end of RIFF data.");
+
+        stream.seekg(length, std::ios::cur);
+        if (!stream)
+            throw std::runtime_error("Unexpected end of RIFF data.");
+    }
+    else
+    {
+        stream.ignore(length);
+        if (static_cast<uint64_t>(stream.gcount()) != length)
+            throw std::runtime_error("Unexpected end of RIFF data.");
+    }
+    offset += length;
+    progress_t::input_read(length);
+}
+
+void RIFF_input_t::skip_padding()
+{
+    if (stream.peek() != std::char_traits<char>::eof())
+    {
+        stream.get();
+        offset++;
+        progress_t::input_read(1);
+    }
+}
+
+// ====================================================================================================================
+RIFF_chunk_t::RIFF_chunk_t(const RIFF_chunk_t &other) : m_size(other.m_size), m_offset(other.m_offset)
+{
+    memcpy(m_identifier, other.m_identifier, sizeof(m_identifier));
+}
+
 RIFF_chunk_t::~RIFF_chunk_t() {}
 
+void RIFF_chunk_t::invalidate_parents()
+{
+    // a stale list only has stale lists above it, the walk stops at the first one
+    for (RIFF_chunk_list_t *list = m_parent; list && !list->m_stale; list = list->m_parent)
+        list->m_stale = true;
+}
+
 void RIFF_chunk_t::set_identifier(const char *new_id)
 {
     if (strlen(new_id) != 4)
@@ -14,17 +243,27 @@ void RIFF_chunk_t::set_identifier(const char *new_id)
     m_identifier[3] = new_id[3];
 }
 
-const char *RIFF_chunk_t::get_identifier()
+const char *RIFF_chunk_t::get_identifier() const
 {
     return reinterpret_cast<const char *>(m_identifier);
 }
 
+uint64_t RIFF_chunk_t::get_offset() const
+{
+    return m_offset;
+}
+
 // ====================================================================================================================
-RIFF_chunk_data_t::RIFF_chunk_data_t(std::ifstream &f, const char *id)
+RIFF_chunk_data_t::RIFF_chunk_data_t(std::istream &f, const char *id)
 {
     read(f, id);
 }
 
+RIFF_chunk_data_t::RIFF_chunk_data_t(RIFF_input_t &in, const char *id)
+{
+    read(in, id);
+}
+
 RIFF_chunk_data_t::RIFF_chunk_data_t()
 {
 }
@@ -39,8 +278,17 @@ RIFF_chunk_data_t::~RIFF_chunk_data_t()
 {
 }
 
-void RIFF_chunk_data_t::read(std::ifstream &f, const char *id)
+void RIFF_chunk_data_t::read(std::istream &f, const char *id)
+{
+    RIFF_input_t in(f);
+    read(in, id);
+}
+
+void RIFF_chunk_data_t::read(RIFF_input_t &in, const char *id)
 {
+    // a supplied id has already been consumed from the input
+    m_offset = in.offset - (id ? 4 : 0);
+
     // if no id is supplied, read it from the filestream
     if (id)
     {
@@ -49,33 +297,89 @@ void RIFF_chunk_data_t::read(std::ifstream &f, const char *id)
     else
     {
         char identifier[5]{0};
-        f.read(identifier, 4);
+        in.read(identifier, 4);
         set_identifier(identifier);
 
     }
-    f.read(reinterpret_cast<char *>(&m_size), sizeof(m_size));
+    in.read(&m_size, sizeof(m_size));
 
-    // grab data
-    m_data.reserve(m_size);
-    for (int i = 0; i < m_size; i++)
-        m_data.push_back(f.get());
+    m_data.clear();
+    m_file.reset();
 
-    if(m_data.size() > 64)
+    if (m_size <= in.max_buffered)
     {
-        putchar('\n');
-        return;
+        // grab data
+        m_data.resize(m_size);
+        in.read(m_data.data(), m_size);
+    }
+    else if (in.file)
+    {
+        // the payload can be read again from the source file later, skip over it
+        m_file = in.file;
+        m_file_offset = in.offset;
+        in.skip(m_size);
     }
+    else
+    {
+        // forward-only stream, copy the payload to the spool file one block at a time
+        if (!in.spool)
+            in.spool = RIFF_file_t::temporary();
+
+        m_file = in.spool;
+        m_file_offset = in.spool_size;
+
+        std::vector<uint8_t> block(copy_block_size);
+        for (uint32_t remaining = m_size; remaining > 0;)
+        {
+            uint32_t n = remaining < block.size() ? remaining : block.size();
+            in.read(block.data(), n);
+            in.spool->write(in.spool_size, block.data(), n);
+            in.spool_size += n;
+            remaining -= n;
+        }
+    }
+
+    invalidate_parents();
+
+    // odd sized chunks are followed by a padding byte
+    if (m_size % 2 != 0)
+        in.skip_padding();
 }
 
-int RIFF_chunk_data_t::write(std::ofstream &f)
+void RIFF_chunk_data_t::load()
+{
+    if (!m_file)
+        return;
+
+    m_data.resize(m_size);
+    m_file->read(m_file_offset, m_data.data(), m_size);
+    m_file.reset();
+}
+
+uint64_t RIFF_chunk_data_t::write(std::ostream &f)
 {
     f.write(reinterpret_cast<const char *>(m_identifier), 4);
-    m_size = m_data.size();
+    m_size = size();
     f.write(reinterpret_cast<const char *>(&m_size), 4);
-    for (auto i : m_data)
-        f.write(reinterpret_cast<const char *>(&i), 1);
 
-    int bytes = 8 + m_data.size();
+    if (m_file)
+    {
+        // stream a payload left on disk through a single block
+        std::vector<uint8_t> block(copy_block_size);
+        for (uint32_t done = 0; done < m_size;)
+        {
+            uint32_t n = m_size - done < block.size() ? m_size - done : block.size();
+            m_file->read(m_file_offset + done, block.data(), n);
+            f.write(reinterpret_cast<const char *>(block.data()), n);
+            done += n;
+        }
+    }
+    else
+    {
+        f.write(reinterpret_cast<const char *>(m_data.data()), m_data.size());
+    }
+
+    uint64_t bytes = 8 + static_cast<uint64_t>(m_size);
 
     // padding byte if data is odd sized
     if (bytes % 2 != 0)
@@ -89,22 +393,66 @@ int RIFF_chunk_data_t::write(std::ofstream &f)
 
 void RIFF_chunk_data_t::set_data(const std::vector<uint8_t> &new_data)
 {
+    m_file.reset();
+    m_data.assign(new_data.begin(), new_data.end());
+    invalidate_parents();
+}
+
+void RIFF_chunk_data_t::set_data(const byte_vector_t &new_data)
+{
+    m_file.reset();
     m_data = new_data;
+    invalidate_parents();
 }
 
-std::vector<uint8_t> &RIFF_chunk_data_t::get_data()
+byte_vector_t &RIFF_chunk_data_t::get_data()
 {
+    load();
+    invalidate_parents();
     return m_data;
 }
 
-int RIFF_chunk_data_t::size()
+const byte_vector_t &RIFF_chunk_data_t::get_data() const
 {
-    return m_data.size();
+    if (m_file)
+        throw std::runtime_error("Chunk payload was left on disk and can't be read without loading it.");
+
+    return m_data;
+}
+
+void RIFF_chunk_data_t::read_data(uint32_t offset, uint32_t length, uint8_t *dst) const
+{
+    if (static_cast<uint64_t>(offset) + length > static_cast<uint64_t>(size()))
+        throw std::out_of_range("Requested range exceeds the chunk data.");
+
+    if (m_file)
+        m_file->read(m_file_offset + offset, dst, length);
+    else if (length > 0)
+        memcpy(dst, m_data.data() + offset, length);
+}
+
+bool RIFF_chunk_data_t::is_buffered() const
+{
+    return !m_file;
+}
+
+void RIFF_chunk_data_t::set_file(std::shared_ptr<RIFF_file_t> file, uint64_t offset, uint32_t size)
+{
+    m_data.clear();
+    m_file = file;
+    m_file_offset = offset;
+    m_size = size;
+    invalidate_parents();
+}
+
+uint32_t RIFF_chunk_data_t::size() const
+{
+    return m_file ? m_size : m_data.size();
 }
 
-int RIFF_chunk_data_t::total_size()
+uint64_t RIFF_chunk_data_t::total_size() const
 {
-    int bytes = m_data.size() + 8;
+    uint64_t bytes = static_cast<uint64_t>(size()) + 8;
 
     // padding byte
     if (bytes % 2 != 0)
@@ -113,29 +461,49 @@ int RIFF_chunk_data_t::total_size()
     return bytes;
 }
 
-void RIFF_chunk_data_t::print()
+void RIFF_chunk_data_t::print() const
 {
-    printf("RIFF_chunk_data: (length %lu) id: %s\n", m_data.size(), get_identifier());
-    for (int i = 0; i < m_data.size() && i < 8; i++)
+    printf("RIFF_chunk_data: (length %u) id: %s\n", size(), get_identifier());
+
+    uint8_t head[8]{0};
+    uint32_t n = size() < 8 ? size() : 8;
+    read_data(0, n, head);
+    for (uint32_t i = 0; i < n; i++)
     {
-        printf(" %02x", m_data[i]);
+        printf(" %02x", head[i]);
     }
 
-    if (m_data.size() > 8)
+    if (size() > 8)
         printf(" ... ");
 
     putchar('\n');
 }
 
-void RIFF_chunk_data_t::print_full()
+void RIFF_chunk_data_t::print_full() const
 {
-    printf("RIFF_chunk_data: (length %lu) id: %s\n", m_data.size(), get_identifier());
-    for (int i = 0; i < m_data.size(); i++)
+    printf("RIFF_chunk_data: (length %u) id: %s\n", size(), get_identifier());
+
+    // formatted a block at a time without loading a payload left on disk, 8 bytes per line
+    const char *digits = "0123456789abcdef";
+    std::vector<uint8_t> block(1 << 16);
+    std::vector<char> text(block.size() / 8 * 25);
+    for (uint32_t done = 0; done < size();)
     {
-        if (i % 8 == 0 && i != 0)
-            putchar('\n');
+        uint32_t n = std::min<uint32_t>(block.size(), size() - done);
+        read_data(done, n, block.data());
+
+        char *o = text.data();
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if ((done + i) % 8 == 0 && done + i != 0)
+                *o++ = '\n';
 
-        printf(" %02x", m_data[i]);
+            *o++ = ' ';
+            *o++ = digits[block[i] >> 4];
+            *o++ = digits[block[i] & 15];
+        }
+        fwrite(text.data(), 1, o - text.data(), stdout);
+        done += n;
     }
     putchar('\n');
 }
@@ -145,11 +513,28 @@ RIFF_chunk_list_t::RIFF_chunk_list_t()
 {
 }
 
-RIFF_chunk_list_t::RIFF_chunk_list_t(std::ifstream &f, const char *id)
+RIFF_chunk_list_t::RIFF_chunk_list_t(std::istream &f, const char *id)
 {
     read(f, id);
 }
 
+RIFF_chunk_list_t::RIFF_chunk_list_t(RIFF_input_t &in, const char *id)
+{
+    read(in, id);
+}
+
+RIFF_chunk_list_t::RIFF_chunk_list_t(RIFF_chunk_list_t &&other)
+    : RIFF_chunk_t(other), m_subchunks(std::move(other.m_subchunks)), m_cached_size(other.m_cached_size),
+      m_cached_total_size(other.m_cached_total_size), m_stale(other.m_stale)
+{
+    memcpy(m_form_type, other.m_form_type, sizeof(m_form_type));
+    other.m_stale = true;
+
+    // the subchunks move along with their sizes, keep them attached so the cache stays valid
+    for (auto &i : m_subchunks)
+        i->m_parent = this;
+}
+
 RIFF_chunk_list_t::RIFF_chunk_list_t(const char *form_type)
 {
     set_identifier("LIST");
@@ -160,7 +545,7 @@ RIFF_chunk_list_t::~RIFF_chunk_list_t()
 {
 }
 
-const char *RIFF_chunk_list_t::get_form_type()
+const char *RIFF_chunk_list_t::get_form_type() const
 {
     return reinterpret_cast<const char *>(m_form_type);
 }
@@ -176,55 +561,75 @@ void RIFF_chunk_list_t::set_form_type(const char *new_form_type)
     m_form_type[3] = new_form_type[3];
 }
 
-void RIFF_chunk_list_t::read(std::ifstream &f, const char *id)
+void RIFF_chunk_list_t::read(std::istream &f, const char *id)
 {
+    RIFF_input_t in(f);
+    read(in, id);
+}
+
+void RIFF_chunk_list_t::read(RIFF_input_t &in, const char *id)
+{
+    // a supplied id has already been consumed from the input
+    m_offset = in.offset - (id ? 4 : 0);
+
     if (id)
         set_identifier(id);
 
     else
     {
         char identifier[5]{0};
-        f.read(identifier, 4);
+        in.read(identifier, 4);
         set_identifier(identifier);
     }
 
-    f.read(reinterpret_cast<char *>(&m_size), sizeof(m_size));
-    f.read(reinterpret_cast<char *>(&m_form_type), 4);
+    in.read(&m_size, sizeof(m_size));
+    in.read(&m_form_type, 4);
 
     // size == 4 means the list contains only the form type
     // form type has already been read, return
     if(m_size <= 4)
         return;
 
-    // while bytes from original position until position + chunk size have been read, or file has been read completely
-    std::streampos fpos = f.tellg();
-    while (!f.eof() && f.tellg() <= fpos + static_cast<std::streampos>(m_size))
+    // count consumed bytes instead of asking the stream for its position, pipes can't tell
+    uint64_t end = in.offset + m_size - 4;
+    while (in.offset + 8 <= end)
     {
-        char identifier[5]{0};
+        // stop quietly if the stream ends before the list says it should
+        if (in.stream.peek() == std::char_traits<char>::eof())
+            return;
 
-        // skip padding bytes, eof sometimes doesn't work in the initial while test? check it here also.
-        if(f.peek() == 0 || f.eof())
+        // skip stray zero padding between chunks
+        if (in.stream.peek() == 0)
         {
-            f.read(identifier, 1);
+            in.skip(1);
             continue;
         }
 
-        f.read(identifier, 4);
+        char identifier[5]{0};
+        in.read(identifier, 4);
 
         // determine which type of chunk to add based on its identifier
         if (strcmp(identifier, "LIST") == 0)
-            m_subchunks.push_back(std::make_unique<RIFF_chunk_list_t>(f, identifier));
+            m_subchunks.push_back(std::make_unique<RIFF_chunk_list_t>(in, identifier));
         else
-            m_subchunks.push_back(std::make_unique<RIFF_chunk_data_t>(f, identifier));
+            m_subchunks.push_back(std::make_unique<RIFF_chunk_data_t>(in, identifier));
     }
+
+    // trailing padding inside the list
+    while (in.offset < end && in.stream.peek() == 0)
+        in.skip(1);
+
+    m_stale = true;
+    invalidate_parents();
 }
 
-int RIFF_chunk_list_t::write(std::ofstream &f)
+uint64_t RIFF_chunk_list_t::write(std::ostream &f)
 {
-    int bytes{0};
+    uint64_t bytes{0};
     f.write(reinterpret_cast<const char *>(m_identifier), 4);
 
-    // size of contained data minus size of header bytes
+    // size of contained data minus size of header bytes, the subchunks write from the refreshed caches
+    update_sizes();
     uint32_t size = total_size() - 8;
 
     // in case a padding byte is needed at the end
@@ -240,7 +645,7 @@ int RIFF_chunk_list_t::write(std::ofstream &f)
         bytes += i.get()->write(f);
 
     // if the calculated size of the bytes does not match - write pad bytes until it does
-    for (int i = 0; i + bytes < size + 8; i++)
+    while (bytes < size + 8ull)
     {
         const char pad{'\0'};
         f.write(&pad, 1);
@@ -252,23 +657,62 @@ int RIFF_chunk_list_t::write(std::ofstream &f)
 
 std::vector<std::unique_ptr<RIFF_chunk_t>> &RIFF_chunk_list_t::get_subchunks()
 {
+    // chunks may be added, removed or moved to another list through the reference, none keeps pointing here
+    for (auto &i : m_subchunks)
+        i->m_parent = nullptr;
+
+    m_stale = true;
+    invalidate_parents();
     return m_subchunks;
 }
 
-int RIFF_chunk_list_t::size()
+const std::vector<std::unique_ptr<RIFF_chunk_t>> &RIFF_chunk_list_t::get_subchunks() const
 {
-    int bytes{0};
+    return m_subchunks;
+}
+
+void RIFF_chunk_list_t::update_sizes()
+{
+    if (!m_stale)
+        return;
+
+    // stale lists below are refreshed first, fresh ones answer from their caches
+    m_cached_size = 0;
+    m_cached_total_size = 0;
     for (auto &i : m_subchunks)
-        bytes += i.get()->size();
+    {
+        i->m_parent = this;
+        RIFF_chunk_list_t *list = dynamic_cast<RIFF_chunk_list_t *>(i.get());
+        if (list)
+            list->update_sizes();
 
-    return bytes;
+        m_cached_size += i->size();
+        m_cached_total_size += i->total_size();
+    }
+    m_stale = false;
 }
 
-int RIFF_chunk_list_t::total_size()
+uint32_t RIFF_chunk_list_t::size() const
 {
-    int bytes{0};
+    if (!m_stale)
+        return m_cached_size;
+
+    uint32_t bytes{0};
     for (auto &i : m_subchunks)
-        bytes += i.get()->total_size();
+        bytes += i->size();
+    return bytes;
+}
+
+uint64_t RIFF_chunk_list_t::total_size() const
+{
+    uint64_t bytes{0};
+    if (!m_stale)
+        bytes = m_cached_total_size;
+    else
+    {
+        for (auto &i : m_subchunks)
+            bytes += i->total_size();
+    }
 
     // compensate for padding bytes if the number of bytes is odd
     if (bytes % 2 != 0)
@@ -278,7 +722,7 @@ int RIFF_chunk_list_t::total_size()
     return bytes + 12;
 }
 
-void RIFF_chunk_list_t::print()
+void RIFF_chunk_list_t::print() const
 {
     printf("\nRIFF_chunk_list: (length %lu chunks) id: %s, form type: %s\n", m_subchunks.size(), get_identifier(), get_form_type());
     for (auto &i : m_subchunks)
@@ -287,7 +731,7 @@ void RIFF_chunk_list_t::print()
     }
 }
 
-void RIFF_chunk_list_t::print_full()
+void RIFF_chunk_list_t::print_full() const
 {
     printf("\nRIFF_chunk_list: (length %lu chunks) id: %s, form type: %s\n", m_subchunks.size(), get_identifier(), get_form_type());
     for (auto &i : m_subchunks)
@@ -296,12 +740,18 @@ void RIFF_chunk_list_t::print_full()
     }
 }
 
-bool RIFF_chunk_list_t::exists_chunk_with_id(const char *id)
+bool RIFF_chunk_list_t::exists_chunk_with_id(const char *id) const
 {
     return get_chunk_with_id(id) ? true : false;
 }
 
 RIFF_chunk_t *RIFF_chunk_list_t::get_chunk_with_id(const char *id)
+{
+    // the search doesn't change anything, the chunk found may be changed by the caller
+    return const_cast<RIFF_chunk_t *>(static_cast<const RIFF_chunk_list_t *>(this)->get_chunk_with_id(id));
+}
+
+const RIFF_chunk_t *RIFF_chunk_list_t::get_chunk_with_id(const char *id) const
 {
     if (strlen(id) != 4)
         return nullptr;
@@ -309,15 +759,15 @@ RIFF_chunk_t *RIFF_chunk_list_t::get_chunk_with_id(const char *id)
     for (auto &i : m_subchunks)
     {
         // compare identifiers
-        RIFF_chunk_t *current = i.get();
+        const RIFF_chunk_t *current = i.get();
         if (strcmp(current->get_identifier(), id) == 0)
             return current;
 
         // if the current chunk is a list chunk, recurse into it
-        RIFF_chunk_list_t *dyn_next = dynamic_cast<RIFF_chunk_list_t *>(current);
+        const RIFF_chunk_list_t *dyn_next = dynamic_cast<const RIFF_chunk_list_t *>(current);
         if (dyn_next)
         {
-            RIFF_chunk_t *next = dyn_next->get_chunk_with_id(id);
+            const RIFF_chunk_t *next = dyn_next->get_chunk_with_id(id);
             if (next)
                 return next;
         }
@@ -332,35 +782,63 @@ RIFF_t::RIFF_t()
     m_riff.set_form_type("NULL");
 }
 
-RIFF_t::RIFF_t(std::string filename)
+RIFF_t::RIFF_t(std::string filename, uint32_t max_buffered)
 {
     m_filepath = filename;
-    
+
+    if (filename == "-")
+    {
+        RIFF_input_t in(std::cin, max_buffered);
+        read(in);
+        return;
+    }
+
     std::ifstream f(filename, std::ios::binary);
     if (!f.is_open())
         throw std::runtime_error("An error occurred opening the specified RIFF file.");
 
+    if (progress_t::enabled())
+    {
+        f.seekg(0, std::ios::end);
+        progress_t::add_input(f.tellg());
+        f.seekg(0);
+    }
+
+    // only keep a descriptor around if payloads may be left in the file
+    RIFF_input_t in(f, max_buffered, max_buffered < UINT32_MAX ? RIFF_file_t::open(filename) : nullptr);
+    read(in);
+
+    f.close();
+}
+
+RIFF_t::RIFF_t(std::istream &f, uint32_t max_buffered, std::shared_ptr<RIFF_file_t> file)
+{
+    RIFF_input_t in(f, max_buffered, file);
+    read(in);
+}
+
+void RIFF_t::read(RIFF_input_t &in)
+{
     // read file identifier, verify that this is a valid RIFF file
     char identifier[5]{0};
-    f.read(identifier, 4);
+    in.read(identifier, 4);
 
     if (strcmp(identifier, "RIFF") != 0)
         throw std::runtime_error("The specified file is not a valid RIFF file.");
 
-    // this is a valid riff file, read the rest of it
-    m_riff.read(f, identifier);
-
-    f.close();
+    // this is a valid riff file, read the rest of it, sizes are cached before the tree can be shared
+    m_riff.read(in, identifier);
+    m_riff.update_sizes();
 }
 
-int RIFF_t::size()
+uint32_t RIFF_t::size() const
 {
     return m_riff.size();
 }
 
-int RIFF_t::total_size()
+uint64_t RIFF_t::total_size() const
 {
-    int size = m_riff.total_size();
+    uint64_t size = m_riff.total_size();
 
     // compensate for padding bytes if the number of bytes is odd
     if (size % 2)
@@ -369,22 +847,22 @@ int RIFF_t::total_size()
     return size;
 }
 
-void RIFF_t::print()
+void RIFF_t::print() const
 {
     m_riff.print();
 }
 
-void RIFF_t::print_full()
+void RIFF_t::print_full() const
 {
     m_riff.print_full();
 }
 
-int RIFF_t::write()
+uint64_t RIFF_t::write()
 {
     if (m_filepath.empty())
         throw std::runtime_error("No file path specified.");
 
-    int bytes{0};
+    uint64_t bytes{0};
 
     std::ofstream f(m_filepath, std::ios::binary | std::ios::trunc);
 
@@ -396,7 +874,12 @@ int RIFF_t::write()
     return bytes;
 }
 
-const std::string &RIFF_t::get_filepath()
+uint64_t RIFF_t::write(std::ostream &f)
+{
+    return m_riff.write(f);
+}
+
+const std::string &RIFF_t::get_filepath() const
 {
     return m_filepath;
 }
@@ -406,7 +889,7 @@ void RIFF_t::set_filepath(const std::string &new_file_path)
     m_filepath = new_file_path;
 }
 
-bool RIFF_t::exists_chunk_with_id(const char *id)
+bool RIFF_t::exists_chunk_with_id(const char *id) const
 {
     if (strlen(id) != 4)
         return false;
@@ -415,6 +898,11 @@ bool RIFF_t::exists_chunk_with_id(const char *id)
 }
 
 RIFF_chunk_t *RIFF_t::get_chunk_with_id(const char *id)
+{
+    return const_cast<RIFF_chunk_t *>(static_cast<const RIFF_t *>(this)->get_chunk_with_id(id));
+}
+
+const RIFF_chunk_t *RIFF_t::get_chunk_with_id(const char *id) const
 {
     if (strlen(id) != 4)
         return nullptr;
@@ -427,6 +915,11 @@ RIFF_chunk_t *RIFF_t::get_chunk_with_id(const char *id)
 }
 
 RIFF_chunk_list_t &RIFF_t::get_root_chunk()
+{
+    return m_riff;
+}
+
+const RIFF_chunk_list_t &RIFF_t::get_root_chunk() const
 {
     return m_riff;
 }
\ No newline at end of file
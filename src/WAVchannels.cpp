@@ -0,0 +1,268 @@
+#include "WAVchannels.h"
+#include "WAVpcm.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// frames converted to floats at a time when mixing, small enough for the channel buffers to stay in cache
+static const uint32_t mix_frames = 256;
+
+static std::vector<std::string> split_list(const std::string &list, char separator)
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (true)
+    {
+        size_t end = list.find(separator, start);
+        items.push_back(list.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos)
+            return items;
+        start = end + 1;
+    }
+}
+
+channel_map_t channel_map_t::parse(const std::string &channels, const std::string &mix)
+{
+    channel_map_t map;
+
+    if (!channels.empty())
+    {
+        for (auto &i : split_list(channels, ','))
+        {
+            char *end;
+            unsigned long channel = strtoul(i.c_str(), &end, 10);
+            if (i.empty() || *end || channel < 1 || channel > UINT16_MAX)
+                throw std::invalid_argument("Unknown channel: " + i);
+            map.channels.push_back(channel - 1);
+        }
+    }
+
+    if (mix == "mono")
+    {
+        map.mono = true;
+    }
+    else if (!mix.empty())
+    {
+        for (auto &row : split_list(mix, ';'))
+        {
+            map.gains.emplace_back();
+            for (auto &i : split_list(row, ','))
+            {
+                char *end;
+                float gain = strtof(i.c_str(), &end);
+                if (i.empty() || *end)
+                    throw std::invalid_argument("Unknown gain: " + i);
+                map.gains.back().push_back(gain);
+            }
+
+            if (map.gains.back().size() != map.gains.front().size())
+                throw std::invalid_argument("Every mix row needs the same number of gains.");
+        }
+    }
+
+    return map;
+}
+
+bool channel_map_t::empty() const
+{
+    return channels.empty() && gains.empty() && !mono;
+}
+
+// copy whole samples of N bytes, the constant size turns every copy into a single move
+template <size_t N>
+static void select_channels(const uint8_t *src, uint32_t frames, size_t channels, const std::vector<uint16_t> &select,
+                            uint8_t *dst)
+{
+    size_t outputs = select.size();
+    for (uint32_t f = 0; f < frames; f++)
+    {
+        const uint8_t *frame = src + f * channels * N;
+        for (size_t o = 0; o < outputs; o++)
+            memcpy(dst + (f * outputs + o) * N, frame + select[o] * N, N);
+    }
+}
+
+channel_mixer_t::channel_mixer_t(const WAV_fmt_t &input, const channel_map_t &map) : m_input(input), m_output(input)
+{
+    uint16_t channels = input.num_channels;
+    if (channels == 0 || input.block_align % channels != 0)
+        throw std::runtime_error("WAV format has no channels.");
+    m_container = input.block_align / channels;
+
+    m_select = map.channels;
+    if (m_select.empty())
+    {
+        for (uint16_t c = 0; c < channels; c++)
+            m_select.push_back(c);
+    }
+    for (uint16_t c : m_select)
+    {
+        if (c >= channels)
+            throw std::runtime_error("Channel " + std::to_string(c + 1) + " selected, the input has " +
+                                     std::to_string(channels) + ".");
+    }
+
+    // the speaker of each channel is the position of its bit among the set bits of the mask (WAVE_FORMAT_EXTENSIBLE)
+    uint32_t mask{0};
+    bool extensible = input.audio_format == 0xFFFE && input.extra_params.size() >= 6;
+    if (extensible)
+        memcpy(&mask, &input.extra_params[2], 4);
+
+    std::vector<uint32_t> speakers;
+    for (uint32_t bit = 0; bit < 32; bit++)
+    {
+        if (mask & (1u << bit))
+            speakers.push_back(1u << bit);
+    }
+
+    uint32_t output_mask{0};
+    uint16_t outputs = m_select.size();
+    if (map.mono || !map.gains.empty())
+    {
+        // one row of gains per output channel, scattered onto the input channels the selection picked
+        std::vector<std::vector<float>> rows = map.gains;
+        if (map.mono)
+            rows = {std::vector<float>(m_select.size(), 1.0f / m_select.size())};
+
+        // mixing goes through floats, throws for formats pcm_to_float() doesn't know
+        pcm_container_size(input);
+        m_gains.assign(rows.size() * channels, 0.0f);
+        for (size_t r = 0; r < rows.size(); r++)
+        {
+            if (rows[r].size() != m_select.size())
+                throw std::runtime_error("The mix needs " + std::to_string(m_select.size()) + " gains per row, one for every selected channel.");
+
+            for (size_t s = 0; s < m_select.size(); s++)
+                m_gains[r * channels + m_select[s]] += rows[r][s];
+        }
+        outputs = rows.size();
+
+        // a mono mix goes to the front center speaker, anything else to no speaker in particular
+        if (outputs == 1 && extensible)
+            output_mask = 0x4;
+    }
+    else
+    {
+        // the channels must stay in speaker order for the mask to keep meaning something
+        for (size_t o = 0; o < m_select.size(); o++)
+        {
+            if (m_select[o] >= speakers.size() || (o > 0 && m_select[o] <= m_select[o - 1]))
+            {
+                output_mask = 0;
+                break;
+            }
+            output_mask |= speakers[m_select[o]];
+        }
+    }
+
+    m_output.num_channels = outputs;
+    m_output.block_align = outputs * m_container;
+    m_output.byte_rate = m_output.sample_rate * m_output.block_align;
+    if (extensible)
+        memcpy(&m_output.extra_params[2], &output_mask, 4);
+}
+
+const WAV_fmt_t &channel_mixer_t::format() const
+{
+    return m_output;
+}
+
+bool channel_mixer_t::identity() const
+{
+    if (!m_gains.empty() || m_select.size() != m_input.num_channels)
+        return false;
+
+    for (size_t c = 0; c < m_select.size(); c++)
+    {
+        if (m_select[c] != c)
+            return false;
+    }
+    return true;
+}
+
+void channel_mixer_t::mix(const uint8_t *src, uint32_t frames, uint8_t *dst) const
+{
+    size_t inputs = m_input.num_channels;
+    size_t outputs = m_output.num_channels;
+
+    std::vector<float> interleaved(mix_frames * std::max(inputs, outputs));
+    std::vector<float> planes(mix_frames * inputs);
+    std::vector<float> mixed(mix_frames * outputs);
+
+    for (uint32_t done = 0; done < frames;)
+    {
+        uint32_t n = std::min(mix_frames, frames - done);
+        pcm_to_float(src + static_cast<size_t>(done) * m_input.block_align, n * inputs, m_input, interleaved.data());
+
+        for (size_t c = 0; c < inputs; c++)
+        {
+            float *plane = &planes[c * mix_frames];
+            for (uint32_t f = 0; f < n; f++)
+                plane[f] = interleaved[f * inputs + c];
+        }
+
+        for (size_t r = 0; r < outputs; r++)
+        {
+            float *out = &mixed[r * mix_frames];
+            std::fill(out, out + n, 0.0f);
+            for (size_t c = 0; c < inputs; c++)
+            {
+                float gain = m_gains[r * inputs + c];
+                if (gain == 0)
+                    continue;
+
+                const float *plane = &planes[c * mix_frames];
+                for (uint32_t f = 0; f < n; f++)
+                    out[f] += gain * plane[f];
+            }
+        }
+
+        for (size_t r = 0; r < outputs; r++)
+        {
+            const float *out = &mixed[r * mix_frames];
+            for (uint32_t f = 0; f < n; f++)
+                interleaved[f * outputs + r] = out[f];
+        }
+
+        float_to_pcm(interleaved.data(), n * outputs, m_output, dst + static_cast<size_t>(done) * m_output.block_align);
+        done += n;
+    }
+}
+
+void channel_mixer_t::apply(const uint8_t *src, uint32_t frames, uint8_t *dst) const
+{
+    if (!m_gains.empty())
+    {
+        mix(src, frames, dst);
+        return;
+    }
+
+    size_t channels = m_input.num_channels;
+    switch (m_container)
+    {
+    case 1:
+        select_channels<1>(src, frames, channels, m_select, dst);
+        break;
+    case 2:
+        select_channels<2>(src, frames, channels, m_select, dst);
+        break;
+    case 3:
+        select_channels<3>(src, frames, channels, m_select, dst);
+        break;
+    case 4:
+        select_channels<4>(src, frames, channels, m_select, dst);
+        break;
+    case 8:
+        select_channels<8>(src, frames, channels, m_select, dst);
+        break;
+    default:
+        for (uint32_t f = 0; f < frames; f++)
+        {
+            for (size_t o = 0; o < m_select.size(); o++)
+                memcpy(dst + (f * m_select.size() + o) * m_container, src + (f * channels + m_select[o]) * m_container,
+                       m_container);
+        }
+        break;
+    }
+}
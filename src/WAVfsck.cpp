@@ -0,0 +1,413 @@
+#include "WAVfsck.h"
+#include "WAVmanifest.h"
+#include "RIFFparser.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <sys/stat.h>
+
+// deeper nesting than this is not a WAV file, and must not run the walk out of stack
+static const uint32_t max_depth = 32;
+
+// cue points read at a time
+static const uint32_t cue_block = 4096;
+
+static bool is_identifier(const uint8_t *id)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (id[i] < 0x20 || id[i] > 0x7e)
+            return false;
+    }
+    return true;
+}
+
+static std::string printable(const uint8_t *id)
+{
+    std::string s;
+    for (int i = 0; i < 4; i++)
+        s += id[i] >= 0x20 && id[i] <= 0x7e ? static_cast<char>(id[i]) : '?';
+    return s;
+}
+
+// a chunk found by the walk that later checks need
+struct fsck_chunk_t
+{
+    uint64_t offset{0};
+    uint32_t size{0};
+};
+
+// state of checking one file
+class fsck_walker_t
+{
+private:
+    fsck_result_t &m_result;
+    std::shared_ptr<RIFF_file_t> m_file;
+
+    std::vector<fsck_chunk_t> m_fmt;
+    std::vector<fsck_chunk_t> m_data;
+    std::vector<fsck_chunk_t> m_cue;
+
+    // cue identifiers each 'adtl' entry refers to, with the entry's offset
+    std::vector<std::pair<uint32_t, uint64_t>> m_labels;
+
+    void report(fsck_diagnostic_t::severity_t severity, const char *code, uint64_t offset, const std::string &message)
+    {
+        m_result.diagnostics.push_back({severity, code, offset, message});
+    }
+
+    // read exactly size bytes, false if the file is shorter
+    bool read(uint64_t offset, void *dst, size_t size)
+    {
+        return m_file->read_some(offset, static_cast<uint8_t *>(dst), size) == size;
+    }
+
+    void walk(uint64_t start, uint64_t end, uint32_t depth, const std::string &form_type);
+    void check_fmt(uint32_t &block_align);
+    void check_cue(uint64_t frames);
+
+public:
+    fsck_walker_t(fsck_result_t &result, std::shared_ptr<RIFF_file_t> file) : m_result(result), m_file(file)
+    {
+    }
+
+    void run();
+};
+
+void fsck_walker_t::walk(uint64_t start, uint64_t end, uint32_t depth, const std::string &form_type)
+{
+    if (depth > max_depth)
+    {
+        report(fsck_diagnostic_t::error, "nesting_too_deep", start, "LIST chunks are nested more than " + std::to_string(max_depth) + " deep.");
+        return;
+    }
+
+    bool stray_padding{false};
+    uint64_t position = start;
+    while (position + 8 <= end)
+    {
+        uint8_t header[8];
+        if (!read(position, header, 8))
+        {
+            report(fsck_diagnostic_t::error, "truncated", position, "The file ends inside a chunk header.");
+            return;
+        }
+
+        // single zero bytes between chunks are skipped by the parser, but they shouldn't be there
+        if (header[0] == 0)
+        {
+            if (!stray_padding)
+                report(fsck_diagnostic_t::warning, "stray_padding", position, "Zero bytes between chunks.");
+            stray_padding = true;
+            position++;
+            continue;
+        }
+
+        if (!is_identifier(header))
+        {
+            report(fsck_diagnostic_t::error, "bad_identifier", position,
+                   "Not a chunk identifier: '" + printable(header) + "', the rest of the list is skipped.");
+            return;
+        }
+
+        std::string id(reinterpret_cast<char *>(header), 4);
+        uint32_t size;
+        memcpy(&size, header + 4, 4);
+        uint64_t payload = position + 8;
+        uint64_t chunk_end = payload + size;
+        m_result.chunks++;
+
+        if (chunk_end > m_result.file_size)
+            report(fsck_diagnostic_t::error, "truncated", position,
+                   "'" + id + "' needs " + std::to_string(chunk_end - m_result.file_size) + " bytes past the end of the file.");
+        else if (chunk_end > end)
+            report(fsck_diagnostic_t::error, "chunk_overflows_parent", position,
+                   "'" + id + "' ends " + std::to_string(chunk_end - end) + " bytes past the end of its parent.");
+
+        if (id == "LIST")
+        {
+            char list_type[5]{0};
+            if (size < 4 || !read(payload, list_type, 4))
+                report(fsck_diagnostic_t::error, "bad_list_size", position, "LIST chunk too short for its form type.");
+            else
+                walk(payload + 4, std::min(chunk_end, end), depth + 1, list_type);
+        }
+        else if (id == "fmt ")
+        {
+            m_fmt.push_back({position, size});
+        }
+        else if (id == "data")
+        {
+            m_data.push_back({position, size});
+        }
+        else if (id == "cue ")
+        {
+            m_cue.push_back({position, size});
+        }
+        else if (form_type == "adtl" && (id == "labl" || id == "note" || id == "ltxt"))
+        {
+            uint32_t cue_id;
+            if (size < 4 || !read(payload, &cue_id, 4))
+                report(fsck_diagnostic_t::error, "bad_label", position, "'" + id + "' too short for a cue point identifier.");
+            else
+                m_labels.push_back({cue_id, position});
+        }
+
+        if (chunk_end >= end)
+        {
+            if (chunk_end == end && size % 2)
+                report(fsck_diagnostic_t::warning, "missing_padding", chunk_end, "'" + id + "' has an odd size and its parent ends before the padding byte.");
+            return;
+        }
+
+        position = chunk_end;
+        if (size % 2 == 0)
+            continue;
+
+        // odd sizes are followed by a zero byte, which writers sometimes leave out
+        uint8_t pad;
+        uint8_t next[4];
+        if (!read(position, &pad, 1))
+        {
+            report(fsck_diagnostic_t::error, "missing_padding", chunk_end, "'" + id + "' has an odd size and no padding byte.");
+            return;
+        }
+
+        if (pad != 0 && read(position, next, 4) && is_identifier(next))
+        {
+            report(fsck_diagnostic_t::error, "missing_padding", chunk_end, "'" + id + "' has an odd size and no padding byte.");
+            continue;
+        }
+
+        if (pad != 0)
+            report(fsck_diagnostic_t::warning, "nonzero_padding", chunk_end, "Padding byte after '" + id + "' is not zero.");
+        position++;
+    }
+
+    if (position < end && position + 8 > end)
+        report(fsck_diagnostic_t::warning, "trailing_bytes", position, std::to_string(end - position) + " bytes too few for a chunk at the end of a list.");
+}
+
+void fsck_walker_t::check_fmt(uint32_t &block_align)
+{
+    block_align = 0;
+    if (m_fmt.empty())
+    {
+        report(fsck_diagnostic_t::error, "missing_fmt", 0, "No 'fmt ' chunk.");
+        return;
+    }
+    if (m_fmt.size() > 1)
+        report(fsck_diagnostic_t::warning, "duplicate_chunk", m_fmt[1].offset, "More than one 'fmt ' chunk, the first is used.");
+
+    const fsck_chunk_t &chunk = m_fmt.front();
+    uint8_t fmt[16];
+    if (chunk.size < 16 || !read(chunk.offset + 8, fmt, 16))
+    {
+        report(fsck_diagnostic_t::error, "bad_fmt", chunk.offset, "'fmt ' chunk shorter than 16 bytes.");
+        return;
+    }
+
+    uint16_t format, channels, align, bits;
+    uint32_t sample_rate, byte_rate;
+    memcpy(&format, fmt, 2);
+    memcpy(&channels, fmt + 2, 2);
+    memcpy(&sample_rate, fmt + 4, 4);
+    memcpy(&byte_rate, fmt + 8, 4);
+    memcpy(&align, fmt + 12, 2);
+    memcpy(&bits, fmt + 14, 2);
+
+    if (channels == 0 || sample_rate == 0 || align == 0 || bits == 0)
+    {
+        report(fsck_diagnostic_t::error, "bad_fmt", chunk.offset, "'fmt ' has zero channels, sample rate, block align or bits per sample.");
+        return;
+    }
+
+    // compressed formats have blocks of their own
+    block_align = align;
+    bool pcm = format == 1 || format == 3 || format == 0xfffe;
+    if (pcm && align != channels * ((bits + 7) / 8))
+        report(fsck_diagnostic_t::warning, "bad_block_align", chunk.offset,
+               "Block align " + std::to_string(align) + " doesn't match " + std::to_string(channels) + " channels of " +
+                   std::to_string(bits) + " bits.");
+    if (byte_rate != sample_rate * align)
+        report(fsck_diagnostic_t::warning, "bad_byte_rate", chunk.offset,
+               "Byte rate " + std::to_string(byte_rate) + " isn't sample rate times block align.");
+}
+
+void fsck_walker_t::check_cue(uint64_t frames)
+{
+    std::set<uint32_t> identifiers;
+    for (auto &chunk : m_cue)
+    {
+        uint32_t count;
+        if (chunk.size < 4 || !read(chunk.offset + 8, &count, 4))
+        {
+            report(fsck_diagnostic_t::error, "bad_cue", chunk.offset, "'cue ' chunk too short for its point count.");
+            continue;
+        }
+
+        uint64_t needed = 4 + static_cast<uint64_t>(count) * 24;
+        if (needed > chunk.size)
+        {
+            report(fsck_diagnostic_t::error, "bad_cue", chunk.offset,
+                   "'cue ' says " + std::to_string(count) + " points, which need " + std::to_string(needed) + " bytes, it has " +
+                       std::to_string(chunk.size) + ".");
+            count = (chunk.size - 4) / 24;
+        }
+        else if (needed < chunk.size)
+        {
+            report(fsck_diagnostic_t::warning, "bad_cue", chunk.offset, std::to_string(chunk.size - needed) + " unused bytes after the cue points.");
+        }
+
+        // the count and chunk size may both be corrupt, points are read a block at a time instead of all at once
+        std::vector<uint8_t> points(static_cast<size_t>(std::min(count, cue_block)) * 24);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint64_t offset = chunk.offset + 12 + static_cast<uint64_t>(i) * 24;
+            if (i % cue_block == 0 && !read(offset, points.data(), static_cast<size_t>(std::min(count - i, cue_block)) * 24))
+            {
+                report(fsck_diagnostic_t::error, "truncated", chunk.offset, "The file ends inside the cue points.");
+                break;
+            }
+
+            // identifier, position, chunk id, chunk start, block start, sample start
+            uint32_t point[6];
+            memcpy(point, &points[(i % cue_block) * 24], 24);
+
+            if (!identifiers.insert(point[0]).second)
+                report(fsck_diagnostic_t::warning, "duplicate_cue_id", offset, "Cue identifier " + std::to_string(point[0]) + " is used twice.");
+            if (memcmp(&point[2], "data", 4) != 0)
+                report(fsck_diagnostic_t::warning, "cue_chunk_id", offset,
+                       "Cue " + std::to_string(point[0]) + " points into '" + printable(reinterpret_cast<uint8_t *>(&point[2])) + "' instead of 'data'.");
+            if (!m_data.empty() && point[5] > frames)
+                report(fsck_diagnostic_t::error, "cue_past_data", offset,
+                       "Cue " + std::to_string(point[0]) + " at sample " + std::to_string(point[5]) + " is past the end of 'data' (" +
+                           std::to_string(frames) + " samples).");
+        }
+    }
+
+    for (auto &i : m_labels)
+    {
+        if (!identifiers.count(i.first))
+            report(fsck_diagnostic_t::warning, "label_without_cue", i.second, "Label for cue " + std::to_string(i.first) + ", which doesn't exist.");
+    }
+}
+
+void fsck_walker_t::run()
+{
+    uint8_t header[12];
+    if (!read(0, header, 12))
+    {
+        report(fsck_diagnostic_t::error, "truncated", 0, "Too short for a RIFF header.");
+        return;
+    }
+
+    if (memcmp(header, "RIFF", 4) != 0)
+    {
+        report(fsck_diagnostic_t::error, "not_riff", 0, "Starts with '" + printable(header) + "' instead of 'RIFF'.");
+        return;
+    }
+    if (memcmp(header + 8, "WAVE", 4) != 0)
+        report(fsck_diagnostic_t::error, "not_wave", 8, "Form type is '" + printable(header + 8) + "' instead of 'WAVE'.");
+
+    uint32_t riff_size;
+    memcpy(&riff_size, header + 4, 4);
+    uint64_t riff_end = 8 + static_cast<uint64_t>(riff_size);
+    if (riff_size < 4)
+    {
+        report(fsck_diagnostic_t::error, "bad_list_size", 4, "RIFF chunk too short for its form type.");
+        return;
+    }
+
+    if (riff_end > m_result.file_size)
+        report(fsck_diagnostic_t::error, "truncated", 4,
+               "RIFF size says " + std::to_string(riff_end) + " bytes, the file has " + std::to_string(m_result.file_size) + ".");
+    else if (riff_end + riff_size % 2 < m_result.file_size)
+        report(fsck_diagnostic_t::warning, "trailing_data", riff_end,
+               std::to_string(m_result.file_size - riff_end) + " bytes after the RIFF chunk.");
+
+    walk(12, riff_end, 1, std::string(reinterpret_cast<char *>(header + 8), 4));
+
+    uint32_t block_align;
+    check_fmt(block_align);
+
+    uint64_t frames{0};
+    if (m_data.empty())
+    {
+        report(fsck_diagnostic_t::error, "missing_data", 0, "No 'data' chunk.");
+    }
+    else
+    {
+        if (m_data.size() > 1)
+            report(fsck_diagnostic_t::warning, "duplicate_chunk", m_data[1].offset, "More than one 'data' chunk, the first is used.");
+
+        const fsck_chunk_t &data = m_data.front();
+        if (block_align)
+        {
+            frames = data.size / block_align;
+            if (data.size % block_align)
+                report(fsck_diagnostic_t::warning, "partial_frame", data.offset,
+                       "'data' ends with " + std::to_string(data.size % block_align) + " bytes of an incomplete sample frame.");
+        }
+    }
+
+    check_cue(frames);
+}
+
+// ====================================================================================================================
+size_t fsck_result_t::count(fsck_diagnostic_t::severity_t severity) const
+{
+    size_t n{0};
+    for (auto &i : diagnostics)
+        n += i.severity == severity;
+    return n;
+}
+
+std::string fsck_result_t::to_json() const
+{
+    std::string out;
+    std::string file = json_string(filename);
+    for (auto &i : diagnostics)
+    {
+        out += "{\"file\": " + file + ", \"severity\": \"" + (i.severity == fsck_diagnostic_t::error ? "error" : "warning") +
+               "\", \"code\": \"" + i.code + "\", \"offset\": " + std::to_string(i.offset) + ", \"message\": " + json_string(i.message) + "}\n";
+    }
+
+    size_t errors = count(fsck_diagnostic_t::error);
+    size_t warnings = count(fsck_diagnostic_t::warning);
+    const char *status = errors ? "error" : warnings ? "warning" : "ok";
+    out += "{\"file\": " + file + ", \"status\": \"" + status + "\", \"errors\": " + std::to_string(errors) +
+           ", \"warnings\": " + std::to_string(warnings) + ", \"chunks\": " + std::to_string(chunks) + ", \"bytes\": " +
+           std::to_string(file_size) + "}\n";
+    return out;
+}
+
+// ====================================================================================================================
+fsck_result_t WAV_fsck_t::check(const std::string &filename)
+{
+    fsck_result_t result;
+    result.filename = filename;
+
+    std::shared_ptr<RIFF_file_t> file;
+    struct stat st;
+    try
+    {
+        file = RIFF_file_t::open(filename);
+    }
+    catch (const std::exception &e)
+    {
+        result.diagnostics.push_back({fsck_diagnostic_t::error, "unreadable", 0, e.what()});
+        return result;
+    }
+
+    if (fstat(file->fd(), &st) == 0)
+        result.file_size = st.st_size;
+
+    fsck_walker_t walker(result, file);
+    walker.run();
+    return result;
+}
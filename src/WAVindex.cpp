@@ -0,0 +1,223 @@
+#include "WAVindex.h"
+#include "CRC32C.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char index_magic[8] = {'W', 'S', 'I', 'D', 'X', 0, 0, 1};
+
+// bytes hashed at each end of the file, covers the headers in front and any metadata appended behind 'data'
+static const size_t hashed_bytes = 4096;
+
+static void put(std::string &out, const void *src, size_t length)
+{
+    out.append(reinterpret_cast<const char *>(src), length);
+}
+
+// reads from the index buffer, fails instead of reading past its end
+static bool get(const std::string &in, size_t &pos, void *dst, size_t length)
+{
+    if (pos + length > in.size())
+        return false;
+
+    memcpy(dst, in.data() + pos, length);
+    pos += length;
+    return true;
+}
+
+// a count read from the index must describe records that are actually there, before anything is sized by it
+static bool fits(const std::string &in, size_t pos, uint64_t count, size_t record)
+{
+    return pos <= in.size() && count * record <= in.size() - pos;
+}
+
+std::string WAV_index_t::path_for(const std::string &filename)
+{
+    return filename + ".wsidx";
+}
+
+bool WAV_index_t::identify(const std::string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    file_size = st.st_size;
+    mtime_sec = st.st_mtim.tv_sec;
+    mtime_nsec = st.st_mtim.tv_nsec;
+
+    std::vector<uint8_t> bytes(hashed_bytes);
+    ssize_t n = pread(fd, bytes.data(), bytes.size(), 0);
+    header_hash = crc32c(0, bytes.data(), n > 0 ? n : 0);
+
+    if (file_size > hashed_bytes)
+    {
+        n = pread(fd, bytes.data(), bytes.size(), file_size - hashed_bytes);
+        header_hash = crc32c(header_hash, bytes.data(), n > 0 ? n : 0);
+    }
+
+    close(fd);
+    return true;
+}
+
+bool WAV_index_t::load(const std::string &filename)
+{
+    FILE *f = fopen(path_for(filename).c_str(), "rb");
+    if (!f)
+        return false;
+
+    std::string in;
+    char buffer[1 << 14];
+    for (size_t n; (n = fread(buffer, 1, sizeof(buffer), f)) > 0;)
+        in.append(buffer, n);
+    fclose(f);
+
+    WAV_index_t current;
+    if (!current.identify(filename))
+        return false;
+
+    size_t pos{0};
+    char magic[8];
+    if (!get(in, pos, magic, 8) || memcmp(magic, index_magic, 8) != 0)
+        return false;
+
+    if (!get(in, pos, &file_size, 8) || !get(in, pos, &mtime_sec, 8) || !get(in, pos, &mtime_nsec, 8) ||
+        !get(in, pos, &header_hash, 4))
+        return false;
+
+    // stale, the file changed since it was indexed
+    if (file_size != current.file_size || mtime_sec != current.mtime_sec || mtime_nsec != current.mtime_nsec ||
+        header_hash != current.header_hash)
+        return false;
+
+    uint32_t count;
+    if (!get(in, pos, &count, 4))
+        return false;
+    if (!fits(in, pos, count, 24))
+        return false;
+    chunks.resize(count);
+    for (auto &i : chunks)
+    {
+        if (!get(in, pos, i.identifier, 4) || !get(in, pos, i.form_type, 4) || !get(in, pos, &i.depth, 4) ||
+            !get(in, pos, &i.offset, 8) || !get(in, pos, &i.size, 4))
+            return false;
+    }
+
+    if (!get(in, pos, &count, 4))
+        return false;
+    if (!fits(in, pos, count, 1))
+        return false;
+    fmt.resize(count);
+    if (!get(in, pos, fmt.data(), count))
+        return false;
+
+    if (!get(in, pos, &count, 4))
+        return false;
+    if (!fits(in, pos, count, sizeof(cue_point_t)))
+        return false;
+    cues.resize(count);
+    if (!get(in, pos, cues.data(), count * sizeof(cue_point_t)))
+        return false;
+
+    if (!get(in, pos, &count, 4) || !fits(in, pos, count, 8))
+        return false;
+    labels.clear();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t id, length;
+        if (!get(in, pos, &id, 4) || !get(in, pos, &length, 4) || pos + length > in.size())
+            return false;
+
+        labels[id] = in.substr(pos, length);
+        pos += length;
+    }
+
+    return true;
+}
+
+void WAV_index_t::save(const std::string &filename) const
+{
+    std::string out;
+    put(out, index_magic, 8);
+    put(out, &file_size, 8);
+    put(out, &mtime_sec, 8);
+    put(out, &mtime_nsec, 8);
+    put(out, &header_hash, 4);
+
+    uint32_t count = chunks.size();
+    put(out, &count, 4);
+    for (auto &i : chunks)
+    {
+        put(out, i.identifier, 4);
+        put(out, i.form_type, 4);
+        put(out, &i.depth, 4);
+        put(out, &i.offset, 8);
+        put(out, &i.size, 4);
+    }
+
+    count = fmt.size();
+    put(out, &count, 4);
+    put(out, fmt.data(), fmt.size());
+
+    count = cues.size();
+    put(out, &count, 4);
+    put(out, cues.data(), cues.size() * sizeof(cue_point_t));
+
+    count = labels.size();
+    put(out, &count, 4);
+    for (auto &i : labels)
+    {
+        uint32_t length = i.second.size();
+        put(out, &i.first, 4);
+        put(out, &length, 4);
+        put(out, i.second.data(), length);
+    }
+
+    // write to a unique name next to the final one and rename, readers never see half an index and concurrent
+    // writers of the same index don't share a temporary file
+    std::string path = path_for(filename);
+    std::string temporary = path + ".XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0)
+        return;
+
+    // mkstemp() creates the file readable by its owner only
+    fchmod(fd, 0644);
+    FILE *f = fdopen(fd, "wb");
+    if (!f)
+    {
+        close(fd);
+        remove(temporary.c_str());
+        return;
+    }
+
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    ok = fclose(f) == 0 && ok;
+
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+        remove(temporary.c_str());
+}
+
+bool WAV_index_t::find(const char *id, uint64_t &payload_offset, uint32_t &size) const
+{
+    for (auto &i : chunks)
+    {
+        if (memcmp(i.identifier, id, 4) == 0)
+        {
+            payload_offset = i.offset + 8;
+            size = i.size;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,342 @@
+#include "WAVinspect.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+// hexdump lines are assembled from lookup tables instead of formatted, and written a block at a time
+static const size_t hexdump_block_size = 1 << 20;
+
+struct hexdump_tables_t
+{
+    char hex[256][2];
+    char text[256];
+
+    hexdump_tables_t()
+    {
+        const char *digits = "0123456789abcdef";
+        for (int i = 0; i < 256; i++)
+        {
+            hex[i][0] = digits[i >> 4];
+            hex[i][1] = digits[i & 15];
+            text[i] = i >= 0x20 && i < 0x7f ? i : '.';
+        }
+    }
+};
+
+static const hexdump_tables_t tables;
+
+// collect the layout depth first, as index_chunks does for the sidecar index
+static void collect_chunks(const RIFF_chunk_list_t &list, uint32_t depth, std::vector<inspect_chunk_t> &chunks)
+{
+    for (auto &i : list.get_subchunks())
+    {
+        inspect_chunk_t chunk{};
+        memcpy(chunk.identifier, i->get_identifier(), 4);
+        chunk.depth = depth;
+        chunk.offset = i->get_offset();
+        chunk.size = static_cast<uint32_t>(i->size());
+
+        RIFF_chunk_list_t *sublist = dynamic_cast<RIFF_chunk_list_t *>(i.get());
+        if (sublist)
+        {
+            memcpy(chunk.form_type, sublist->get_form_type(), 4);
+            chunk.size = static_cast<uint32_t>(sublist->total_size() - 8);
+        }
+        chunks.push_back(chunk);
+
+        if (sublist)
+            collect_chunks(*sublist, depth + 1, chunks);
+    }
+}
+
+// little endian fields of a payload, zero past its end so truncated chunks still decode
+static uint32_t field(const std::vector<uint8_t> &bytes, size_t offset, size_t size)
+{
+    uint32_t value{0};
+    if (offset + size <= bytes.size())
+        memcpy(&value, &bytes[offset], size);
+    return value;
+}
+
+// a fixed size text field, which may or may not be terminated
+static std::string text(const std::vector<uint8_t> &bytes, size_t offset, size_t size)
+{
+    if (offset >= bytes.size())
+        return "";
+
+    size = std::min(size, bytes.size() - offset);
+    const char *start = reinterpret_cast<const char *>(&bytes[offset]);
+    return std::string(start, strnlen(start, size));
+}
+
+static std::string four_cc(uint32_t value)
+{
+    char id[5]{0};
+    memcpy(id, &value, 4);
+    for (int i = 0; i < 4; i++)
+        id[i] = tables.text[static_cast<uint8_t>(id[i])];
+    return id;
+}
+
+WAV_inspector_t::WAV_inspector_t(const std::string &filename, FILE *out) : m_file(RIFF_file_t::open(filename)), m_out(out)
+{
+    struct stat st;
+    if (fstat(m_file->fd(), &st) == 0)
+        m_file_size = st.st_size;
+
+    // nothing is buffered, every payload stays in the file
+    RIFF_file_streambuf_t stream_buffer(m_file);
+    std::istream f(&stream_buffer);
+    RIFF_t riff(f, 0, m_file);
+
+    RIFF_chunk_list_t &root = riff.get_root_chunk();
+    inspect_chunk_t chunk{};
+    memcpy(chunk.identifier, root.get_identifier(), 4);
+    memcpy(chunk.form_type, root.get_form_type(), 4);
+    chunk.size = static_cast<uint32_t>(root.total_size() - 8);
+    m_chunks.push_back(chunk);
+
+    collect_chunks(root, 1, m_chunks);
+}
+
+const std::vector<inspect_chunk_t> &WAV_inspector_t::get_chunks() const
+{
+    return m_chunks;
+}
+
+size_t WAV_inspector_t::find(const std::string &chunk) const
+{
+    if (!chunk.empty() && chunk.find_first_not_of("0123456789") == std::string::npos)
+    {
+        size_t n = strtoull(chunk.c_str(), nullptr, 10);
+        if (n >= m_chunks.size())
+            throw std::out_of_range("No chunk number " + chunk + ".");
+        return n;
+    }
+
+    std::string id = chunk;
+    id.resize(4, ' ');
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        if (id == m_chunks[i].identifier)
+            return i;
+    }
+    throw std::out_of_range("No '" + id + "' chunk.");
+}
+
+std::vector<uint8_t> WAV_inspector_t::read_payload(const inspect_chunk_t &chunk, uint64_t max_size) const
+{
+    std::vector<uint8_t> bytes(std::min(chunk.size, max_size));
+    bytes.resize(m_file->read_some(chunk.offset + 8, bytes.data(), bytes.size()));
+    return bytes;
+}
+
+void WAV_inspector_t::print_tree()
+{
+    fprintf(m_out, "%5s  %12s  %12s  chunk\n", "#", "offset", "size");
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        const inspect_chunk_t &c = m_chunks[i];
+        fprintf(m_out, "%5zu  %12" PRIu64 "  %12" PRIu64 "  %*s'%s'", i, c.offset, c.size, c.depth * 2, "", c.identifier);
+        if (c.form_type[0])
+            fprintf(m_out, " '%s'", c.form_type);
+
+        // the payload and its padding byte should end where the parent says
+        uint64_t end = c.offset + 8 + c.size + c.size % 2;
+        if (end > m_file_size)
+            fprintf(m_out, "  (truncated, %" PRIu64 " bytes past the end)", end - m_file_size);
+        fprintf(m_out, "\n");
+    }
+}
+
+void WAV_inspector_t::print_decoded()
+{
+    for (size_t i = 0; i < m_chunks.size(); i++)
+    {
+        const inspect_chunk_t &c = m_chunks[i];
+        std::string id = c.identifier;
+
+        if (id != "fmt " && id != "cue " && id != "bext" && !(id == "LIST" && strcmp(c.form_type, "adtl") == 0))
+            continue;
+
+        fprintf(m_out, "\n[%zu] '%s'%s%s%s at %" PRIu64 ", %" PRIu64 " bytes\n", i, c.identifier, c.form_type[0] ? " '" : "",
+                c.form_type, c.form_type[0] ? "'" : "", c.offset, c.size);
+
+        if (id == "fmt ")
+            decode_fmt(c);
+        else if (id == "cue ")
+            decode_cue(c);
+        else if (id == "bext")
+            decode_bext(c);
+        else
+            decode_adtl(c);
+    }
+}
+
+void WAV_inspector_t::decode_fmt(const inspect_chunk_t &chunk)
+{
+    std::vector<uint8_t> fmt = read_payload(chunk, 64);
+    uint32_t format = field(fmt, 0, 2);
+    const char *name = format == 1 ? "PCM" : format == 3 ? "IEEE float" : format == 0xfffe ? "extensible" : "other";
+
+    fprintf(m_out, "  audio format       0x%04x (%s)\n", format, name);
+    fprintf(m_out, "  channels           %u\n", field(fmt, 2, 2));
+    fprintf(m_out, "  sample rate        %u\n", field(fmt, 4, 4));
+    fprintf(m_out, "  byte rate          %u\n", field(fmt, 8, 4));
+    fprintf(m_out, "  block align        %u\n", field(fmt, 12, 2));
+    fprintf(m_out, "  bits per sample    %u\n", field(fmt, 14, 2));
+
+    if (fmt.size() >= 18)
+        fprintf(m_out, "  extra size         %u\n", field(fmt, 16, 2));
+
+    if (format == 0xfffe && fmt.size() >= 40)
+    {
+        fprintf(m_out, "  valid bits         %u\n", field(fmt, 18, 2));
+        fprintf(m_out, "  channel mask       0x%08x\n", field(fmt, 20, 4));
+        fprintf(m_out, "  sub format         ");
+        for (int i = 24; i < 40; i++)
+            fprintf(m_out, "%c%c%s", tables.hex[fmt[i]][0], tables.hex[fmt[i]][1], i == 27 || i == 29 || i == 31 || i == 33 ? "-" : "");
+        fprintf(m_out, "\n");
+    }
+}
+
+void WAV_inspector_t::decode_cue(const inspect_chunk_t &chunk)
+{
+    std::vector<uint8_t> cue = read_payload(chunk, UINT64_MAX);
+    uint32_t count = field(cue, 0, 4);
+    fprintf(m_out, "  cue points         %u\n", count);
+    if (count == 0)
+        return;
+
+    fprintf(m_out, "  %10s  %10s  %6s  %11s  %11s  %12s\n", "id", "position", "chunk", "chunk start", "block start", "sample start");
+    for (uint32_t i = 0; i < count; i++)
+    {
+        size_t at = 4 + i * 24;
+        if (at + 24 > cue.size())
+        {
+            fprintf(m_out, "  (%u more cue points past the end of the chunk)\n", count - i);
+            break;
+        }
+
+        fprintf(m_out, "  %10u  %10u  '%s'  %11u  %11u  %12u\n", field(cue, at, 4), field(cue, at + 4, 4),
+                four_cc(field(cue, at + 8, 4)).c_str(), field(cue, at + 12, 4), field(cue, at + 16, 4), field(cue, at + 20, 4));
+    }
+}
+
+void WAV_inspector_t::decode_adtl(const inspect_chunk_t &chunk)
+{
+    // the list's own chunks follow it in the layout, until the depth drops back
+    for (size_t i = &chunk - m_chunks.data() + 1; i < m_chunks.size() && m_chunks[i].depth > chunk.depth; i++)
+    {
+        const inspect_chunk_t &c = m_chunks[i];
+        std::vector<uint8_t> bytes = read_payload(c, UINT64_MAX);
+        std::string id = c.identifier;
+
+        if (id == "labl" || id == "note")
+        {
+            fprintf(m_out, "  %s  %10u  \"%s\"\n", c.identifier, field(bytes, 0, 4), text(bytes, 4, bytes.size()).c_str());
+        }
+        else if (id == "ltxt")
+        {
+            fprintf(m_out, "  ltxt  %10u  length %u, purpose '%s', country %u, language %u, dialect %u, code page %u", field(bytes, 0, 4),
+                    field(bytes, 4, 4), four_cc(field(bytes, 8, 4)).c_str(), field(bytes, 12, 2), field(bytes, 14, 2),
+                    field(bytes, 16, 2), field(bytes, 18, 2));
+            if (bytes.size() > 20)
+                fprintf(m_out, "  \"%s\"", text(bytes, 20, bytes.size()).c_str());
+            fprintf(m_out, "\n");
+        }
+        else
+        {
+            fprintf(m_out, "  '%s'  %" PRIu64 " bytes\n", c.identifier, c.size);
+        }
+    }
+}
+
+void WAV_inspector_t::decode_bext(const inspect_chunk_t &chunk)
+{
+    // EBU Tech 3285 broadcast audio extension, fixed fields then free coding history
+    std::vector<uint8_t> bext = read_payload(chunk, UINT64_MAX);
+    uint64_t time_reference = field(bext, 338, 4) | static_cast<uint64_t>(field(bext, 342, 4)) << 32;
+    uint32_t version = field(bext, 346, 2);
+
+    fprintf(m_out, "  description        \"%s\"\n", text(bext, 0, 256).c_str());
+    fprintf(m_out, "  originator         \"%s\"\n", text(bext, 256, 32).c_str());
+    fprintf(m_out, "  originator ref     \"%s\"\n", text(bext, 288, 32).c_str());
+    fprintf(m_out, "  origination date   %s %s\n", text(bext, 320, 10).c_str(), text(bext, 330, 8).c_str());
+    fprintf(m_out, "  time reference     %" PRIu64 " samples\n", time_reference);
+    fprintf(m_out, "  version            %u\n", version);
+
+    if (version >= 2)
+    {
+        // loudness values are stored multiplied by 100
+        const char *names[] = {"loudness value", "loudness range", "max true peak", "max momentary", "max short term"};
+        for (int i = 0; i < 5; i++)
+        {
+            int16_t value = static_cast<int16_t>(field(bext, 412 + i * 2, 2));
+            fprintf(m_out, "  %-18s %.2f\n", names[i], value / 100.0);
+        }
+    }
+
+    if (bext.size() > 602)
+        fprintf(m_out, "  coding history     \"%s\"\n", text(bext, 602, bext.size()).c_str());
+}
+
+void WAV_inspector_t::hexdump(size_t chunk, uint64_t offset, uint64_t length)
+{
+    const inspect_chunk_t &c = m_chunks.at(chunk);
+    if (offset > c.size)
+        throw std::out_of_range("The offset is past the end of the chunk.");
+
+    length = std::min(length, c.size - offset);
+
+    // addresses are file offsets, wide enough for the whole file
+    int digits = m_file_size > 0xffffffff ? 12 : 8;
+    const size_t line_size = digits + 71;
+
+    std::vector<uint8_t> block(hexdump_block_size);
+    std::vector<char> out((hexdump_block_size / 16 + 1) * line_size);
+
+    uint64_t position = c.offset + 8 + offset;
+    uint64_t end = position + length;
+    while (position < end)
+    {
+        size_t n = m_file->read_some(position, block.data(), std::min<uint64_t>(block.size(), end - position));
+        if (n == 0)
+            throw std::runtime_error("Unexpected end of file while dumping the chunk.");
+
+        char *o = out.data();
+        for (size_t line = 0; line < n; line += 16)
+        {
+            uint64_t address = position + line;
+            for (int d = digits - 1; d >= 0; d--, address >>= 4)
+                o[d] = "0123456789abcdef"[address & 15];
+            o += digits;
+
+            // "  xx xx xx xx xx xx xx xx  xx xx xx xx xx xx xx xx  |................|"
+            memset(o, ' ', 52);
+            size_t count = std::min<size_t>(16, n - line);
+            for (size_t i = 0; i < count; i++)
+            {
+                const char *hex = tables.hex[block[line + i]];
+                char *at = o + 2 + i * 3 + (i >= 8);
+                at[0] = hex[0];
+                at[1] = hex[1];
+            }
+
+            o[52] = '|';
+            for (size_t i = 0; i < count; i++)
+                o[53 + i] = tables.text[block[line + i]];
+            o[53 + count] = '|';
+            o[54 + count] = '\n';
+            o += 55 + count;
+        }
+
+        if (fwrite(out.data(), 1, o - out.data(), m_out) != static_cast<size_t>(o - out.data()))
+            throw std::runtime_error("Unable to write the hexdump.");
+        position += n;
+    }
+}
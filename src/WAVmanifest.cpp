@@ -0,0 +1,431 @@
+#include "WAVmanifest.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+std::string json_string(const std::string &s)
+{
+    std::string out = "\"";
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+static std::string csv_string(const std::string &s)
+{
+    if (s.find_first_of(",\"\n") == std::string::npos)
+        return s;
+
+    std::string out = "\"";
+    for (char c : s)
+    {
+        if (c == '"')
+            out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// infinite levels (silence) have no JSON representation
+static std::string number(double value, const char *empty)
+{
+    if (!std::isfinite(value))
+        return empty;
+
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.3f", value);
+    return buffer;
+}
+
+static std::string hex(uint32_t value)
+{
+    char buffer[9];
+    snprintf(buffer, sizeof(buffer), "%08x", value);
+    return buffer;
+}
+
+// value of a key in one line of the JSON manifest, strings are unescaped
+static bool json_field(const std::string &line, const std::string &key, std::string &value)
+{
+    size_t pos = line.find("\"" + key + "\": ");
+    if (pos == std::string::npos)
+        return false;
+
+    pos += key.size() + 4;
+    value.clear();
+
+    if (line[pos] != '"')
+    {
+        size_t end = line.find_first_of(",}", pos);
+        value = line.substr(pos, end - pos);
+        return true;
+    }
+
+    for (pos++; pos < line.size() && line[pos] != '"'; pos++)
+    {
+        if (line[pos] == '\\' && pos + 1 < line.size())
+        {
+            pos++;
+            if (line[pos] == 'u' && pos + 4 < line.size())
+            {
+                value += static_cast<char>(strtol(line.substr(pos + 1, 4).c_str(), nullptr, 16));
+                pos += 4;
+                continue;
+            }
+        }
+        value += line[pos];
+    }
+    return true;
+}
+
+// inverse of number(), empty and null values are silence
+static double parse_number(const std::string &value)
+{
+    if (value.empty() || value == "null")
+        return -std::numeric_limits<double>::infinity();
+
+    return strtod(value.c_str(), nullptr);
+}
+
+// split one CSV line into fields, honouring quotes
+static std::vector<std::string> csv_fields(const std::string &line)
+{
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        char c = line[i];
+        if (quoted && c == '"' && i + 1 < line.size() && line[i + 1] == '"')
+            fields.back() += line[++i];
+        else if (c == '"')
+            quoted = !quoted;
+        else if (c == ',' && !quoted)
+            fields.emplace_back();
+        else
+            fields.back() += c;
+    }
+    return fields;
+}
+
+std::string split_manifest_t::filename(format_t format, const std::string &part)
+{
+    std::string name = part.empty() ? "manifest" : "manifest." + part;
+    return name + (format == csv ? ".csv" : ".json");
+}
+
+split_manifest_t::format_t split_manifest_t::parse_format(const std::string &name)
+{
+    if (name == "json")
+        return json;
+    if (name == "csv")
+        return csv;
+
+    throw std::invalid_argument("Manifest format must be json or csv.");
+}
+
+std::string split_manifest_t::serialize(format_t format) const
+{
+    switch (format)
+    {
+    case json:
+        return to_json();
+    case csv:
+        return to_csv();
+    default:
+        return "";
+    }
+}
+
+std::string split_manifest_t::to_json() const
+{
+    std::string out = "[\n";
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const manifest_entry_t &e = entries[i];
+        out += "  {\"name\": " + json_string(e.name) +
+               ", \"frame_offset\": " + std::to_string(e.frame_offset) +
+               ", \"frames\": " + std::to_string(e.frames) +
+               ", \"bytes\": " + std::to_string(e.bytes);
+
+        if (e.has_stats)
+        {
+            out += ", \"peak_db\": " + number(e.stats.peak_db, "null") +
+                   ", \"true_peak_db\": " + number(e.stats.true_peak_db, "null") +
+                   ", \"rms_db\": " + number(e.stats.rms_db, "null") +
+                   ", \"loudness_lufs\": " + number(e.stats.loudness_lufs, "null") +
+                   ", \"dc_offset\": " + number(e.stats.dc_offset, "null") +
+                   ", \"clipped_samples\": " + std::to_string(e.stats.clipped_samples);
+        }
+
+        if (e.has_checksum)
+            out += ", \"crc32c\": \"" + hex(e.crc32c) + "\", \"data_crc32c\": \"" + hex(e.data_crc32c) + "\"";
+
+        out += i + 1 < entries.size() ? "},\n" : "}\n";
+    }
+    return out + "]\n";
+}
+
+std::string split_manifest_t::to_csv() const
+{
+    bool stats = !entries.empty() && entries.front().has_stats;
+    bool checksum = !entries.empty() && entries.front().has_checksum;
+
+    std::string out = "name,frame_offset,frames,bytes";
+    if (stats)
+        out += ",peak_db,true_peak_db,rms_db,loudness_lufs,dc_offset,clipped_samples";
+    if (checksum)
+        out += ",crc32c,data_crc32c";
+    out += "\n";
+
+    for (const manifest_entry_t &e : entries)
+    {
+        out += csv_string(e.name) + "," + std::to_string(e.frame_offset) + "," + std::to_string(e.frames) + "," +
+               std::to_string(e.bytes);
+
+        if (stats)
+        {
+            out += "," + number(e.stats.peak_db, "") + "," + number(e.stats.true_peak_db, "") + "," +
+                   number(e.stats.rms_db, "") + "," + number(e.stats.loudness_lufs, "") + "," +
+                   number(e.stats.dc_offset, "") + "," + std::to_string(e.stats.clipped_samples);
+        }
+        if (checksum)
+            out += "," + hex(e.crc32c) + "," + hex(e.data_crc32c);
+        out += "\n";
+    }
+    return out;
+}
+
+split_manifest_t split_manifest_t::read(const std::string &filename)
+{
+    std::ifstream f(filename);
+    if (!f.is_open())
+        throw std::runtime_error("Unable to open manifest: " + filename);
+
+    split_manifest_t manifest;
+    std::string line;
+
+    if (f.peek() == '[')
+    {
+        // one entry per line, as written by to_json()
+        while (std::getline(f, line))
+        {
+            manifest_entry_t e;
+            std::string value;
+            if (!json_field(line, "name", e.name))
+                continue;
+
+            if (json_field(line, "frame_offset", value))
+                e.frame_offset = strtoul(value.c_str(), nullptr, 10);
+            if (json_field(line, "frames", value))
+                e.frames = strtoul(value.c_str(), nullptr, 10);
+            if (json_field(line, "bytes", value))
+                e.bytes = strtoull(value.c_str(), nullptr, 10);
+            if (json_field(line, "peak_db", value))
+            {
+                e.has_stats = true;
+                e.stats.peak_db = parse_number(value);
+                json_field(line, "true_peak_db", value);
+                e.stats.true_peak_db = parse_number(value);
+                json_field(line, "rms_db", value);
+                e.stats.rms_db = parse_number(value);
+                json_field(line, "loudness_lufs", value);
+                e.stats.loudness_lufs = parse_number(value);
+                json_field(line, "dc_offset", value);
+                e.stats.dc_offset = strtod(value.c_str(), nullptr);
+                json_field(line, "clipped_samples", value);
+                e.stats.clipped_samples = strtoull(value.c_str(), nullptr, 10);
+            }
+            if (json_field(line, "crc32c", value))
+            {
+                e.crc32c = strtoul(value.c_str(), nullptr, 16);
+                e.has_checksum = json_field(line, "data_crc32c", value);
+                e.data_crc32c = strtoul(value.c_str(), nullptr, 16);
+            }
+            manifest.entries.push_back(e);
+        }
+        return manifest;
+    }
+
+    // CSV, columns are found by their header names
+    std::getline(f, line);
+    std::vector<std::string> header = csv_fields(line);
+    auto column = [&header](const char *name) {
+        for (size_t i = 0; i < header.size(); i++)
+            if (header[i] == name)
+                return static_cast<int>(i);
+        return -1;
+    };
+    int name = column("name");
+    int offset = column("frame_offset");
+    int frames = column("frames");
+    int bytes = column("bytes");
+    int crc = column("crc32c");
+    int data_crc = column("data_crc32c");
+    int peak = column("peak_db");
+
+    if (name < 0 || offset < 0 || frames < 0)
+        throw std::runtime_error("Manifest is missing required columns: " + filename);
+
+    while (std::getline(f, line))
+    {
+        std::vector<std::string> fields = csv_fields(line);
+        if (fields.size() != header.size())
+            continue;
+
+        manifest_entry_t e;
+        e.name = fields[name];
+        e.frame_offset = strtoul(fields[offset].c_str(), nullptr, 10);
+        e.frames = strtoul(fields[frames].c_str(), nullptr, 10);
+        if (bytes >= 0)
+            e.bytes = strtoull(fields[bytes].c_str(), nullptr, 10);
+        if (peak >= 0 && peak + 5 < static_cast<int>(fields.size()))
+        {
+            // the statistics columns are always written together, in this order
+            e.has_stats = true;
+            e.stats.peak_db = parse_number(fields[peak]);
+            e.stats.true_peak_db = parse_number(fields[peak + 1]);
+            e.stats.rms_db = parse_number(fields[peak + 2]);
+            e.stats.loudness_lufs = parse_number(fields[peak + 3]);
+            e.stats.dc_offset = strtod(fields[peak + 4].c_str(), nullptr);
+            e.stats.clipped_samples = strtoull(fields[peak + 5].c_str(), nullptr, 10);
+        }
+        if (crc >= 0 && data_crc >= 0)
+        {
+            e.has_checksum = true;
+            e.crc32c = strtoul(fields[crc].c_str(), nullptr, 16);
+            e.data_crc32c = strtoul(fields[data_crc].c_str(), nullptr, 16);
+        }
+        manifest.entries.push_back(e);
+    }
+    return manifest;
+}
+
+// ====================================================================================================================
+std::string split_plan_t::to_json() const
+{
+    std::string extra;
+    for (uint8_t b : format.extra_params)
+    {
+        char digits[3];
+        snprintf(digits, sizeof(digits), "%02x", b);
+        extra += digits;
+    }
+
+    std::string out = "{\n";
+    out += "  \"source\": " + json_string(source) + ",\n";
+    out += "  \"source_frames\": " + std::to_string(source_frames) + ",\n";
+    out += "  \"data_offset\": " + std::to_string(data_offset) + ",\n";
+    out += "  \"format\": {\"audio_format\": " + std::to_string(format.audio_format) +
+           ", \"channels\": " + std::to_string(format.num_channels) +
+           ", \"sample_rate\": " + std::to_string(format.sample_rate) +
+           ", \"byte_rate\": " + std::to_string(format.byte_rate) +
+           ", \"block_align\": " + std::to_string(format.block_align) +
+           ", \"bits_per_sample\": " + std::to_string(format.bits_per_sample) +
+           ", \"extra_params\": \"" + extra + "\"},\n";
+    out += "  \"header_bytes\": " + std::to_string(header_bytes) + ",\n";
+    out += std::string("  \"output\": ") + (flac ? "\"flac\"" : "\"wav\"") + ",\n";
+    if (!part.empty())
+        out += "  \"part\": " + json_string(part) + ",\n";
+
+    out += "  \"regions\": [\n";
+    for (size_t i = 0; i < regions.size(); i++)
+    {
+        const plan_region_t &r = regions[i];
+        out += "    {\"index\": " + std::to_string(r.index) +
+               ", \"name\": " + json_string(r.name) +
+               ", \"frame_offset\": " + std::to_string(r.frame_offset) +
+               ", \"frames\": " + std::to_string(r.frames) +
+               ", \"source_offset\": " + std::to_string(r.source_offset) +
+               ", \"source_bytes\": " + std::to_string(r.source_bytes);
+        if (!flac)
+            out += ", \"bytes\": " + std::to_string(r.bytes);
+        out += i + 1 < regions.size() ? "},\n" : "}\n";
+    }
+    return out + "  ]\n}\n";
+}
+
+split_plan_t split_plan_t::read(const std::string &filename)
+{
+    std::ifstream f(filename);
+    if (!f.is_open())
+        throw std::runtime_error("Unable to open plan: " + filename);
+
+    // the top level fields and every region are on lines of their own, as written by to_json()
+    split_plan_t plan;
+    std::string line;
+    std::string value;
+    while (std::getline(f, line))
+    {
+        if (json_field(line, "index", value))
+        {
+            plan_region_t r;
+            r.index = strtoul(value.c_str(), nullptr, 10);
+            json_field(line, "name", r.name);
+            if (json_field(line, "frame_offset", value))
+                r.frame_offset = strtoul(value.c_str(), nullptr, 10);
+            if (json_field(line, "frames", value))
+                r.frames = strtoul(value.c_str(), nullptr, 10);
+            if (json_field(line, "source_offset", value))
+                r.source_offset = strtoull(value.c_str(), nullptr, 10);
+            if (json_field(line, "source_bytes", value))
+                r.source_bytes = strtoull(value.c_str(), nullptr, 10);
+            if (json_field(line, "bytes", value))
+                r.bytes = strtoull(value.c_str(), nullptr, 10);
+            plan.regions.push_back(r);
+        }
+        else if (json_field(line, "audio_format", value))
+        {
+            plan.format.audio_format = strtoul(value.c_str(), nullptr, 10);
+            if (json_field(line, "channels", value))
+                plan.format.num_channels = strtoul(value.c_str(), nullptr, 10);
+            if (json_field(line, "sample_rate", value))
+                plan.format.sample_rate = strtoul(value.c_str(), nullptr, 10);
+            if (json_field(line, "byte_rate", value))
+                plan.format.byte_rate = strtoul(value.c_str(), nullptr, 10);
+            if (json_field(line, "block_align", value))
+                plan.format.block_align = strtoul(value.c_str(), nullptr, 10);
+            if (json_field(line, "bits_per_sample", value))
+                plan.format.bits_per_sample = strtoul(value.c_str(), nullptr, 10);
+            if (json_field(line, "extra_params", value))
+            {
+                for (size_t i = 0; i + 1 < value.size(); i += 2)
+                    plan.format.extra_params.push_back(strtoul(value.substr(i, 2).c_str(), nullptr, 16));
+                plan.format.extra_params_size = plan.format.extra_params.size();
+            }
+        }
+        else if (json_field(line, "source", value))
+            plan.source = value;
+        else if (json_field(line, "source_frames", value))
+            plan.source_frames = strtoul(value.c_str(), nullptr, 10);
+        else if (json_field(line, "data_offset", value))
+            plan.data_offset = strtoull(value.c_str(), nullptr, 10);
+        else if (json_field(line, "header_bytes", value))
+            plan.header_bytes = strtoul(value.c_str(), nullptr, 10);
+        else if (json_field(line, "output", value))
+            plan.flac = value == "flac";
+        else if (json_field(line, "part", value))
+            plan.part = value;
+    }
+    return plan;
+}
@@ -0,0 +1,78 @@
+#include "WAVmemory.h"
+#include "WAVscheduler.h"
+
+struct atomic_counters_t
+{
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> total_bytes{0};
+    std::atomic<int64_t> bytes{0};
+    std::atomic<int64_t> peak_bytes{0};
+};
+
+static atomic_counters_t counters[static_cast<int>(memory_subsystem_t::count)];
+
+void memory_stats_t::allocated(memory_subsystem_t subsystem, size_t bytes)
+{
+    atomic_counters_t &c = counters[static_cast<int>(subsystem)];
+    c.allocations.fetch_add(1, std::memory_order_relaxed);
+    c.total_bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+    int64_t now = c.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = c.peak_bytes.load(std::memory_order_relaxed);
+    while (now > peak && !c.peak_bytes.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+    {
+    }
+}
+
+void memory_stats_t::released(memory_subsystem_t subsystem, size_t bytes)
+{
+    counters[static_cast<int>(subsystem)].bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+const char *memory_stats_t::name(memory_subsystem_t subsystem)
+{
+    switch (subsystem)
+    {
+    case memory_subsystem_t::riff:
+        return "riff chunks";
+    case memory_subsystem_t::samples:
+        return "wav samples";
+    case memory_subsystem_t::split:
+        return "split buffers";
+    case memory_subsystem_t::encode:
+        return "encode";
+    default:
+        return "other";
+    }
+}
+
+memory_stats_t::counters_t memory_stats_t::get(memory_subsystem_t subsystem)
+{
+    atomic_counters_t &c = counters[static_cast<int>(subsystem)];
+    return {c.allocations.load(), c.total_bytes.load(), c.bytes.load(), c.peak_bytes.load()};
+}
+
+void memory_stats_t::report(FILE *out)
+{
+    const double mib = 1 << 20;
+
+    fprintf(out, "%-14s %12s %12s %12s %12s\n", "memory", "allocations", "total MiB", "peak MiB", "held MiB");
+    for (int i = 0; i < static_cast<int>(memory_subsystem_t::count); i++)
+    {
+        counters_t c = get(static_cast<memory_subsystem_t>(i));
+        fprintf(out, "%-14s %12llu %12.2f %12.2f %12.2f\n", name(static_cast<memory_subsystem_t>(i)),
+                static_cast<unsigned long long>(c.allocations), c.total_bytes / mib, c.peak_bytes / mib, c.bytes / mib);
+    }
+    fprintf(out, "%-14s %12s %12s %12.2f\n", "process (RSS)", "", "", peak_rss() / mib);
+}
+
+// ====================================================================================================================
+memory_stats_session_t::memory_stats_session_t(bool enabled) : m_enabled(enabled)
+{
+}
+
+memory_stats_session_t::~memory_stats_session_t()
+{
+    if (m_enabled)
+        memory_stats_t::report(stderr);
+}
@@ -0,0 +1,662 @@
+#include "WAVoutput.h"
+#include "CRC32C.h"
+#include "WAVtrace.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+
+// tar streams are made of 512 byte blocks
+static const int tar_block_size = 512;
+
+// ====================================================================================================================
+/**
+ *  Forwards everything written to another stream buffer, checksumming it on the way.
+ */
+class crc32c_streambuf_t : public std::streambuf
+{
+private:
+    std::streambuf *m_target;
+
+public:
+    uint32_t crc{0};
+
+    crc32c_streambuf_t(std::streambuf *target) : m_target(target)
+    {
+    }
+
+protected:
+    std::streamsize xsputn(const char *s, std::streamsize n)
+    {
+        crc = crc32c(crc, reinterpret_cast<const uint8_t *>(s), n);
+        return m_target->sputn(s, n);
+    }
+
+    int_type overflow(int_type c)
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+
+        char ch = traits_type::to_char_type(c);
+        return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+    }
+
+    int sync()
+    {
+        return m_target->pubsync();
+    }
+};
+
+// write all of a buffer to a descriptor
+static bool write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// ====================================================================================================================
+/**
+ *  Buffered output to a file descriptor, which std::ofstream can't be opened on.
+ */
+class fd_streambuf_t : public std::streambuf
+{
+private:
+    int m_fd;
+    std::vector<char> m_buffer;
+
+    bool flush_buffer()
+    {
+        bool ok = write_all(m_fd, pbase(), pptr() - pbase());
+        setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+        return ok;
+    }
+
+public:
+    fd_streambuf_t(int fd) : m_fd(fd), m_buffer(1 << 16)
+    {
+        setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+    }
+
+protected:
+    std::streamsize xsputn(const char *s, std::streamsize n)
+    {
+        if (n <= epptr() - pptr())
+        {
+            memcpy(pptr(), s, n);
+            pbump(n);
+            return n;
+        }
+
+        // blocks larger than the buffer go straight to the file
+        if (!flush_buffer() || !write_all(m_fd, s, n))
+            return 0;
+        return n;
+    }
+
+    int_type overflow(int_type c)
+    {
+        if (!flush_buffer())
+            return traits_type::eof();
+
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync()
+    {
+        return flush_buffer() ? 0 : -1;
+    }
+};
+
+// create a directory and any missing parents
+static void make_directories(const std::string &path)
+{
+    for (size_t slash = path.find('/', 1);; slash = path.find('/', slash + 1))
+    {
+        std::string directory = path.substr(0, slash);
+        if (!directory.empty() && mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST)
+            throw std::runtime_error("Unable to create directory: " + directory);
+
+        if (slash == std::string::npos)
+            break;
+    }
+}
+
+// ====================================================================================================================
+shard_options_t shard_options_t::parse(const std::string &option)
+{
+    shard_options_t shard;
+    std::string mode = option.substr(0, option.find(':'));
+    if (mode == "hash")
+        shard.mode = hashed;
+    else if (mode == "number")
+        shard.mode = numbered;
+    else
+        throw std::invalid_argument("Unknown shard mode: " + mode);
+
+    if (option.find(':') != std::string::npos)
+        shard.fan_out = strtoul(option.c_str() + option.find(':') + 1, nullptr, 10);
+    if (shard.fan_out == 0)
+        throw std::invalid_argument("The shard fan-out must be at least 1.");
+
+    return shard;
+}
+
+std::string shard_options_t::subdirectory(const std::string &name, size_t index, size_t count) const
+{
+    char directory[32];
+    if (mode == hashed)
+    {
+        // as many hex digits as the largest bucket needs
+        int digits = snprintf(nullptr, 0, "%x", fan_out - 1);
+        snprintf(directory, sizeof(directory), "%0*x/", digits, crc32c(0, reinterpret_cast<const uint8_t *>(name.data()), name.size()) % fan_out);
+        return directory;
+    }
+
+    if (mode == numbered)
+    {
+        int digits = snprintf(nullptr, 0, "%zu", count > 0 ? (count - 1) / fan_out : 0);
+        snprintf(directory, sizeof(directory), "%0*zu/", digits, index / fan_out);
+        return directory;
+    }
+
+    return "";
+}
+
+// bytes requested from a region reader at a time
+static const size_t region_block_size = 1 << 20;
+
+// header, samples from the reader, then the padding byte
+static uint64_t write_region_bytes(std::ostream &out, const std::vector<uint8_t> &header, uint64_t data_size,
+                                   const split_output_t::region_reader_t &read)
+{
+    out.write(reinterpret_cast<const char *>(header.data()), header.size());
+
+    byte_vector_t block(data_size < region_block_size ? data_size : region_block_size, 0, memory_subsystem_t::split);
+    for (uint64_t done = 0; done < data_size;)
+    {
+        size_t capacity = data_size - done < block.size() ? data_size - done : block.size();
+        size_t n = read(block.data(), capacity);
+        if (n == 0 || n > capacity)
+            throw std::runtime_error("Region data ended early.");
+
+        out.write(reinterpret_cast<const char *>(block.data()), n);
+        done += n;
+    }
+
+    if (data_size % 2)
+        out.put('\0');
+
+    return header.size() + data_size + data_size % 2;
+}
+
+// everything the reader supplies
+static uint64_t write_stream_bytes(std::ostream &out, const split_output_t::region_reader_t &read)
+{
+    byte_vector_t block(region_block_size, 0, memory_subsystem_t::split);
+    uint64_t bytes{0};
+    for (size_t n; (n = read(block.data(), block.size())) > 0; bytes += n)
+    {
+        if (n > block.size())
+            throw std::runtime_error("Split data overran its buffer.");
+        out.write(reinterpret_cast<const char *>(block.data()), n);
+    }
+    return bytes;
+}
+
+// write through a buffered stream, checksummed only when a checksum was asked for
+static uint64_t write_buffered(int fd, const std::function<uint64_t(std::ostream &)> &contents, uint32_t *crc)
+{
+    fd_streambuf_t file(fd);
+    crc32c_streambuf_t checksum(&file);
+    std::ostream out(crc ? static_cast<std::streambuf *>(&checksum) : &file);
+    uint64_t bytes = contents(out);
+
+    out.flush();
+    if (!out || file.pubsync() != 0)
+        throw std::runtime_error("Unable to write split.");
+
+    if (crc)
+        *crc = checksum.crc;
+    return bytes;
+}
+
+// write all of the buffers to a descriptor at offset, picking up where a short write left off
+static bool pwrite_all(int fd, iovec *parts, int count, uint64_t offset)
+{
+    while (count > 0)
+    {
+        ssize_t n = pwritev(fd, parts, count, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+
+        offset += n;
+        for (; count > 0 && static_cast<size_t>(n) >= parts->iov_len; parts++, count--)
+            n -= parts->iov_len;
+        if (count > 0)
+        {
+            parts->iov_base = static_cast<uint8_t *>(parts->iov_base) + n;
+            parts->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+// ====================================================================================================================
+split_output_t::~split_output_t() {}
+
+void split_output_t::finish()
+{
+}
+
+// ====================================================================================================================
+split_directory_output_t::split_directory_output_t(const std::string &directory, bool atomic)
+    : m_directory(directory), m_atomic(atomic)
+{
+    if (m_directory.empty())
+        m_directory = "./";
+
+    m_fd = open(m_directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (m_fd < 0 && errno == ENOENT)
+    {
+        make_directories(m_directory);
+        m_fd = open(m_directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    if (m_fd < 0)
+        throw std::runtime_error("Unable to open output directory: " + m_directory);
+}
+
+split_directory_output_t::~split_directory_output_t()
+{
+    for (auto &i : m_subdirectories)
+        close(i.second);
+    close(m_fd);
+}
+
+int split_directory_output_t::directory_for(const std::string &name, std::string &base)
+{
+    size_t slash = name.rfind('/');
+    if (slash == std::string::npos)
+    {
+        base = name;
+        return m_fd;
+    }
+
+    base = name.substr(slash + 1);
+    std::string path = name.substr(0, slash);
+    auto known = m_subdirectories.find(path);
+    if (known != m_subdirectories.end())
+        return known->second;
+
+    // created relative to the output directory, one component at a time
+    int fd = m_fd;
+    for (size_t start = 0; start <= path.size();)
+    {
+        size_t end = std::min(path.find('/', start), path.size());
+        std::string component = path.substr(start, end - start);
+        start = end + 1;
+        if (component.empty())
+            continue;
+
+        if (mkdirat(fd, component.c_str(), 0777) != 0 && errno != EEXIST)
+            fd = -1;
+        int next = fd < 0 ? -1 : openat(fd, component.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd != m_fd && fd >= 0)
+            close(fd);
+
+        fd = next;
+        if (fd < 0)
+            throw std::runtime_error("Unable to create directory: " + m_directory + path);
+    }
+
+    m_subdirectories[path] = fd;
+    return fd;
+}
+
+uint64_t split_directory_output_t::write(const std::string &name, WAV_t &wav, uint32_t *crc)
+{
+    wav.set_filepath(m_directory + name);
+    return write_split(name, [&](int fd) { return write_buffered(fd, [&wav](std::ostream &out) { return wav.write(out); }, crc); });
+}
+
+uint64_t split_directory_output_t::write_region(const std::string &name, const std::vector<uint8_t> &header,
+                                                uint64_t data_size, const region_reader_t &read, uint32_t *crc)
+{
+    size_t block_size = data_size < region_block_size ? data_size : region_block_size;
+    if (m_block.size() < block_size)
+        m_block.resize(block_size);
+
+    // no stream in between: every block goes out in one pwritev, the first with the header in front and the last
+    // with the padding byte behind, so a region of up to a block is a single system call
+    return write_split(name, [&](int fd) {
+        static const uint8_t padding{0};
+        uint32_t sum{0};
+        uint64_t offset{0};
+        uint64_t done{0};
+        do
+        {
+            size_t capacity = data_size - done < block_size ? data_size - done : block_size;
+            size_t n = 0;
+            if (capacity > 0)
+            {
+                n = read(m_block.data(), capacity);
+                if (n == 0 || n > capacity)
+                    throw std::runtime_error("Region data ended early.");
+            }
+
+            iovec parts[3];
+            int count = 0;
+            if (done == 0)
+                parts[count++] = {const_cast<uint8_t *>(header.data()), header.size()};
+            parts[count++] = {m_block.data(), n};
+            done += n;
+            if (done == data_size && data_size % 2)
+                parts[count++] = {const_cast<uint8_t *>(&padding), 1};
+
+            size_t length{0};
+            for (int i = 0; i < count; i++)
+            {
+                if (crc)
+                    sum = crc32c(sum, static_cast<const uint8_t *>(parts[i].iov_base), parts[i].iov_len);
+                length += parts[i].iov_len;
+            }
+
+            if (!pwrite_all(fd, parts, count, offset))
+                throw std::runtime_error("Unable to write split.");
+            offset += length;
+        } while (done < data_size);
+
+        if (crc)
+            *crc = sum;
+        return offset;
+    });
+}
+
+uint64_t split_directory_output_t::write_stream(const std::string &name, const region_reader_t &read, uint32_t *crc)
+{
+    return write_split(name, [&](int fd) { return write_buffered(fd, [&](std::ostream &out) { return write_stream_bytes(out, read); }, crc); });
+}
+
+uint64_t split_directory_output_t::write_split(const std::string &name, const std::function<uint64_t(int fd)> &contents)
+{
+    std::string base;
+    int directory = directory_for(name, base);
+    std::string target = m_atomic ? base + ".part" : base;
+
+    int fd;
+    {
+        TRACE_SPAN("create");
+        fd = openat(directory, target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    }
+    if (fd < 0)
+        throw std::runtime_error("Unable to open specified file for writing.");
+
+    uint64_t bytes;
+    try
+    {
+        TRACE_SPAN("write");
+        bytes = contents(fd);
+    }
+    catch (...)
+    {
+        close(fd);
+        unlinkat(directory, target.c_str(), 0);
+        throw;
+    }
+
+    bool written;
+    {
+        TRACE_SPAN("close");
+        written = close(fd) == 0;
+    }
+
+    if (!written)
+    {
+        unlinkat(directory, target.c_str(), 0);
+        throw std::runtime_error("Unable to write split.");
+    }
+
+    if (m_atomic)
+    {
+        TRACE_SPAN("rename");
+        if (renameat(directory, target.c_str(), directory, base.c_str()) != 0)
+        {
+            unlinkat(directory, target.c_str(), 0);
+            throw std::runtime_error("Unable to move split into place.");
+        }
+    }
+
+    return bytes;
+}
+
+void split_directory_output_t::write_file(const std::string &name, const std::string &contents)
+{
+    std::string base;
+    int directory = directory_for(name, base);
+    std::string target = m_atomic ? base + ".part" : base;
+
+    int fd = openat(directory, target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+        throw std::runtime_error("Unable to open specified file for writing.");
+
+    bool written = write_all(fd, contents.data(), contents.size());
+    written = close(fd) == 0 && written;
+
+    if (!written || (m_atomic && renameat(directory, target.c_str(), directory, base.c_str()) != 0))
+    {
+        unlinkat(directory, target.c_str(), 0);
+        throw std::runtime_error("Unable to write " + m_directory + name);
+    }
+}
+
+bool split_directory_output_t::is_current(const std::string &name, const std::vector<uint8_t> &header, uint64_t size, const uint32_t *crc)
+{
+    std::string base;
+    int directory = directory_for(name, base);
+
+    // the cheap checks first, most reruns stop here
+    struct stat st;
+    if (fstatat(directory, base.c_str(), &st, 0) != 0 || static_cast<uint64_t>(st.st_size) != size)
+        return false;
+
+    int fd = openat(directory, base.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    RIFF_file_t file(fd);
+
+    std::vector<uint8_t> existing(header.size());
+    if (file.read_some(0, existing.data(), existing.size()) != existing.size() || existing != header)
+        return false;
+
+    if (!crc)
+        return true;
+
+    uint32_t file_crc = crc32c(0, existing.data(), existing.size());
+    std::vector<uint8_t> block(1 << 20);
+    uint64_t position = existing.size();
+    while (size_t n = file.read_some(position, block.data(), block.size()))
+    {
+        file_crc = crc32c(file_crc, block.data(), n);
+        position += n;
+    }
+
+    return file_crc == *crc;
+}
+
+// ====================================================================================================================
+split_tar_output_t::split_tar_output_t(const std::string &filename, const std::string &directory)
+{
+    // "./" adds nothing to member names
+    if (directory != "./")
+        m_directory = directory;
+
+    if (filename == "-")
+    {
+        m_stream = &std::cout;
+        return;
+    }
+
+    m_file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!m_file.is_open())
+        throw std::runtime_error("Unable to open specified archive for writing.");
+
+    m_stream = &m_file;
+}
+
+void split_tar_output_t::write_header(const std::string &name, uint64_t size)
+{
+    char block[tar_block_size]{0};
+
+    // names longer than 100 characters are split into the 155 character prefix field at a '/'
+    std::string prefix;
+    std::string member = name;
+    if (member.size() > 100)
+    {
+        size_t slash = member.rfind('/', 155);
+        if (slash == std::string::npos || member.size() - slash - 1 > 100 || slash == 0)
+            throw std::runtime_error("Split name is too long for a tar archive: " + name);
+
+        prefix = member.substr(0, slash);
+        member = member.substr(slash + 1);
+    }
+
+    memcpy(block, member.data(), member.size());
+    snprintf(block + 100, 8, "%07o", 0644);
+    snprintf(block + 108, 8, "%07o", 0);
+    snprintf(block + 116, 8, "%07o", 0);
+    snprintf(block + 124, 12, "%011llo", static_cast<unsigned long long>(size));
+    snprintf(block + 136, 12, "%011llo", static_cast<unsigned long long>(time(nullptr)));
+    block[156] = '0';
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+    memcpy(block + 345, prefix.data(), prefix.size());
+
+    // checksum is calculated with the checksum field filled with spaces
+    memset(block + 148, ' ', 8);
+    unsigned int checksum{0};
+    for (int i = 0; i < tar_block_size; i++)
+        checksum += static_cast<uint8_t>(block[i]);
+    snprintf(block + 148, 8, "%06o", checksum);
+
+    m_stream->write(block, tar_block_size);
+}
+
+uint64_t split_tar_output_t::write(const std::string &name, WAV_t &wav, uint32_t *crc)
+{
+    // the member size goes in front of the data, serialize the split first
+    std::ostringstream member;
+    {
+        TRACE_SPAN("encode");
+        wav.write(member);
+    }
+    const std::string &bytes = member.str();
+
+    if (crc)
+        *crc = crc32c(0, reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size());
+
+    return write_member(name, bytes);
+}
+
+uint64_t split_tar_output_t::write_region(const std::string &name, const std::vector<uint8_t> &header, uint64_t data_size,
+                                          const region_reader_t &read, uint32_t *crc)
+{
+    TRACE_SPAN("write");
+
+    // the member size is known up front, the samples can go straight to the archive
+    uint64_t size = header.size() + data_size + data_size % 2;
+    write_header(m_directory + name, size);
+
+    crc32c_streambuf_t checksum(m_stream->rdbuf());
+    std::ostream out(crc ? static_cast<std::streambuf *>(&checksum) : m_stream->rdbuf());
+    write_region_bytes(out, header, data_size, read);
+
+    // the samples bypass m_stream, its state says nothing about them
+    out.flush();
+    if (!out)
+        throw std::runtime_error("Unable to write to archive.");
+
+    if (crc)
+        *crc = checksum.crc;
+
+    return tar_block_size + size + write_padding(size);
+}
+
+uint64_t split_tar_output_t::write_stream(const std::string &name, const region_reader_t &read, uint32_t *crc)
+{
+    // the member size goes in front of the data, collect the whole file first
+    std::ostringstream member;
+    write_stream_bytes(member, read);
+    const std::string &bytes = member.str();
+
+    if (crc)
+        *crc = crc32c(0, reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size());
+
+    return write_member(name, bytes);
+}
+
+void split_tar_output_t::write_file(const std::string &name, const std::string &contents)
+{
+    write_member(name, contents);
+}
+
+uint64_t split_tar_output_t::write_member(const std::string &name, const std::string &bytes)
+{
+    TRACE_SPAN("write");
+    write_header(m_directory + name, bytes.size());
+    m_stream->write(bytes.data(), bytes.size());
+
+    return tar_block_size + bytes.size() + write_padding(bytes.size());
+}
+
+int split_tar_output_t::write_padding(uint64_t size)
+{
+    // pad the member to a whole number of blocks
+    int padding = (tar_block_size - size % tar_block_size) % tar_block_size;
+    const char zeros[tar_block_size]{0};
+    m_stream->write(zeros, padding);
+
+    if (!*m_stream)
+        throw std::runtime_error("Unable to write to archive.");
+
+    return padding;
+}
+
+void split_tar_output_t::finish()
+{
+    if (m_finished)
+        return;
+
+    // end of archive is marked by two empty blocks
+    const char zeros[tar_block_size * 2]{0};
+    m_stream->write(zeros, sizeof(zeros));
+    {
+        TRACE_SPAN("flush");
+        m_stream->flush();
+    }
+    m_finished = true;
+
+    if (!*m_stream)
+        throw std::runtime_error("Unable to write to archive.");
+}
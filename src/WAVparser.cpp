@@ -1,5 +1,7 @@
 #include "WAVparser.h"
 
+#include <algorithm>
+
 WAV_t::WAV_t()
 {
     m_riff.get_root_chunk().set_form_type("WAVE");
@@ -8,9 +10,29 @@ WAV_t::WAV_t()
     std::vector<std::unique_ptr<RIFF_chunk_t>> &chunks = m_riff.get_root_chunk().get_subchunks();
     chunks.push_back(std::make_unique<RIFF_chunk_data_t>("fmt "));
     chunks.push_back(std::make_unique<RIFF_chunk_data_t>("data"));
+    m_riff.get_root_chunk().update_sizes();
+}
+
+WAV_t::WAV_t(std::string filename, uint32_t max_buffered) : m_riff(filename, max_buffered)
+{
+    load();
+}
+
+WAV_t::WAV_t(std::istream &f, uint32_t max_buffered, std::shared_ptr<RIFF_file_t> file) : m_riff(f, max_buffered, file)
+{
+    load();
 }
 
-WAV_t::WAV_t(std::string filename) : m_riff(filename)
+WAV_t::WAV_t(WAV_t &&other)
+    : m_riff(std::move(other.m_riff)), m_fmt_chunk(other.m_fmt_chunk), m_data_chunk(other.m_data_chunk),
+      header(std::move(other.header)), samples(std::move(other.samples))
+{
+    // the chunks themselves didn't move, only the tree owning them
+    other.m_fmt_chunk = nullptr;
+    other.m_data_chunk = nullptr;
+}
+
+void WAV_t::load()
 {
     if (strcmp(m_riff.get_root_chunk().get_form_type(), "WAVE") != 0)
         throw std::runtime_error("File is not a valid WAVE file.");
@@ -22,17 +44,38 @@ WAV_t::WAV_t(std::string filename) : m_riff(filename)
         throw std::runtime_error("File does not have a 'data' chunk.");
 
     load_fmt();
-    load_data();
+
+    // leave large payloads on disk until they are asked for
+    if (m_data()->is_buffered())
+        load_data();
+
+    // loading went through the non-const get_data(), cache the sizes again before the file is shared
+    m_riff.get_root_chunk().update_sizes();
 }
 
 RIFF_chunk_data_t *WAV_t::m_data()
 {
-    return reinterpret_cast<RIFF_chunk_data_t *>(m_riff.get_chunk_with_id("data"));
+    if (!m_data_chunk)
+        m_data_chunk = dynamic_cast<RIFF_chunk_data_t *>(m_riff.get_chunk_with_id("data"));
+    return m_data_chunk;
 }
 
 RIFF_chunk_data_t *WAV_t::m_fmt()
 {
-    return reinterpret_cast<RIFF_chunk_data_t *>(m_riff.get_chunk_with_id("fmt "));
+    if (!m_fmt_chunk)
+        m_fmt_chunk = dynamic_cast<RIFF_chunk_data_t *>(m_riff.get_chunk_with_id("fmt "));
+    return m_fmt_chunk;
+}
+
+// const lookups only read the cache, a tree that was changed is searched every time until a non-const lookup
+const RIFF_chunk_data_t *WAV_t::m_data() const
+{
+    return m_data_chunk ? m_data_chunk : dynamic_cast<const RIFF_chunk_data_t *>(m_riff.get_chunk_with_id("data"));
+}
+
+const RIFF_chunk_data_t *WAV_t::m_fmt() const
+{
+    return m_fmt_chunk ? m_fmt_chunk : dynamic_cast<const RIFF_chunk_data_t *>(m_riff.get_chunk_with_id("fmt "));
 }
 
 int WAV_t::write_fmt()
@@ -43,7 +86,7 @@ int WAV_t::write_fmt()
 
     // directly write all bytes to a vector
     const uint8_t *fmt_bytes = reinterpret_cast<const uint8_t *>(&header);
-    std::vector<uint8_t> bytes(16, 0);
+    byte_vector_t bytes(16, 0, memory_subsystem_t::encode);
     memcpy(&bytes.front(), fmt_bytes, 16);
     bytes_written += 16;
 
@@ -71,7 +114,7 @@ int WAV_t::write_data()
     // determine size of each sample
     int bytes_per_sample = header.bits_per_sample / 8;
 
-    std::vector<uint8_t> bytes;
+    byte_vector_t bytes(memory_subsystem_t::encode);
     bytes.reserve(bytes_per_sample * samples.size());
 
     for(auto i : samples)
@@ -92,12 +135,28 @@ int WAV_t::write_data()
 
 void WAV_t::load_fmt()
 {
-    memcpy(reinterpret_cast<uint8_t *>(&header), &m_fmt()->get_data().front(), m_fmt()->size());
+    // the 16 bytes every 'fmt ' chunk has are laid out like the header, an extension goes into extra_params
+    const RIFF_chunk_data_t *chunk = m_fmt();
+    std::vector<uint8_t> fmt(chunk->size());
+    chunk->read_data(0, fmt.size(), fmt.data());
+    const size_t fixed = 16;
+    if (fmt.size() < fixed)
+        throw std::runtime_error("Malformed 'fmt ' chunk.");
+    memcpy(reinterpret_cast<uint8_t *>(&header), fmt.data(), fixed);
+
+    header.extra_params_size = 0;
+    header.extra_params.clear();
+    if (fmt.size() >= fixed + 2)
+    {
+        memcpy(&header.extra_params_size, fmt.data() + fixed, 2);
+        size_t extra = std::min<size_t>(header.extra_params_size, fmt.size() - fixed - 2);
+        header.extra_params.assign(fmt.begin() + fixed + 2, fmt.begin() + fixed + 2 + extra);
+    }
 }
 
 void WAV_t::load_data()
 {
-    std::vector<uint8_t> &d = m_data()->get_data();
+    byte_vector_t &d = m_data()->get_data();
 
     // determine size for sample vector
     int bytes_per_sample = header.bits_per_sample / 8;
@@ -119,22 +178,64 @@ void WAV_t::load_data()
     samples.push_back(smp);
 }
 
-std::vector<uint8_t> &WAV_t::get_fmt()
+byte_vector_t &WAV_t::get_fmt()
+{
+    return m_fmt()->get_data();
+}
+
+const byte_vector_t &WAV_t::get_fmt() const
 {
     return m_fmt()->get_data();
 }
 
-std::vector<uint8_t> &WAV_t::get_data()
+byte_vector_t &WAV_t::get_data()
+{
+    return m_data()->get_data();
+}
+
+const byte_vector_t &WAV_t::get_data() const
 {
     return m_data()->get_data();
 }
 
+uint32_t WAV_t::frames() const
+{
+    // a 'data' chunk holds up to 4 GiB, so bytes and frames are counted in 64 bits
+    uint64_t bytes = m_data()->size();
+    return header.block_align ? bytes / header.block_align : 0;
+}
+
+void WAV_t::read_frames(uint32_t offset, uint32_t count, uint8_t *dst) const
+{
+    if (static_cast<uint64_t>(offset) + count > frames())
+        throw std::out_of_range("Requested frames exceed the 'data' chunk.");
+
+    // inside the chunk, so both fit its 32 bit size
+    uint64_t start = static_cast<uint64_t>(offset) * header.block_align;
+    uint64_t length = static_cast<uint64_t>(count) * header.block_align;
+    m_data()->read_data(start, length, dst);
+}
+
+std::vector<uint8_t> WAV_t::read_frames(uint32_t offset, uint32_t count) const
+{
+    std::vector<uint8_t> bytes(static_cast<size_t>(count) * header.block_align);
+    read_frames(offset, count, bytes.data());
+    return bytes;
+}
+
 RIFF_t &WAV_t::get_riff()
+{
+    m_fmt_chunk = nullptr;
+    m_data_chunk = nullptr;
+    return m_riff;
+}
+
+const RIFF_t &WAV_t::get_riff() const
 {
     return m_riff;
 }
 
-int WAV_t::sample_size()
+int WAV_t::sample_size() const
 {
     return header.bits_per_sample / 8;
 }
@@ -147,6 +248,14 @@ uint64_t &WAV_t::get_sample(int i, int channel)
     return samples[i + channel];
 }
 
+uint64_t WAV_t::get_sample(int i, int channel) const
+{
+    if(channel > (header.num_channels - 1))
+        throw std::runtime_error("Requested access to audio channel that does not exist");
+
+    return samples[i + channel];
+}
+
 uint32_t WAV_t::calculate_byte_rate()
 {
     header.byte_rate = header.sample_rate * header.num_channels * sample_size();
@@ -161,7 +270,8 @@ uint16_t WAV_t::calculate_block_align()
 
 void WAV_t::clear_data()
 {
-    samples.clear();
+    // release the memory as well, split regions are cleared after they are written
+    sample_vector_t(samples.get_allocator()).swap(samples);
     write_data();
 }
 
@@ -170,7 +280,7 @@ void WAV_t::set_filepath(std::string new_file_path)
     m_riff.set_filepath(new_file_path);
 }
 
-int WAV_t::write()
+uint64_t WAV_t::write()
 {
     write_data();
     write_fmt();
@@ -178,7 +288,15 @@ int WAV_t::write()
     return m_riff.write();
 }
 
-void WAV_t::print_header()
+uint64_t WAV_t::write(std::ostream &f)
+{
+    write_data();
+    write_fmt();
+
+    return m_riff.write(f);
+}
+
+void WAV_t::print_header() const
 {
     printf("*** %s header ***\n", m_riff.get_filepath().c_str());
     printf("audio format: %d\n", header.audio_format);
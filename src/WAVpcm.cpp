@@ -0,0 +1,237 @@
+#include "WAVpcm.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// independent accumulators per lane, lets the compiler keep them in one vector register
+static const int lanes = 8;
+
+// WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT, also when given as the sub format of WAVE_FORMAT_EXTENSIBLE, 0 otherwise
+static uint16_t sample_format(const WAV_fmt_t &fmt)
+{
+    if (fmt.audio_format == 1 || fmt.audio_format == 3)
+        return fmt.audio_format;
+
+    // the sub format GUID follows the valid bits and channel mask, the rest of it is the same for every format
+    static const uint8_t guid_tail[14]{0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+    if (fmt.audio_format != 0xFFFE || fmt.extra_params.size() < 22 || memcmp(&fmt.extra_params[8], guid_tail, 14) != 0)
+        return 0;
+
+    uint16_t format = fmt.extra_params[6] | (fmt.extra_params[7] << 8);
+    return format == 1 || format == 3 ? format : 0;
+}
+
+int pcm_container_size(const WAV_fmt_t &fmt)
+{
+    if (fmt.num_channels == 0)
+        throw std::runtime_error("WAV format has no channels.");
+
+    int container = fmt.block_align / fmt.num_channels;
+
+    uint16_t format = sample_format(fmt);
+    if (format == 3 && (container == 4 || container == 8))
+        return container;
+
+    if (format == 1 && container >= 1 && container <= 4)
+        return container;
+
+    throw std::runtime_error("Unsupported sample format.");
+}
+
+bool pcm_is_float(const WAV_fmt_t &fmt)
+{
+    return sample_format(fmt) == 3;
+}
+
+void pcm_to_float(const uint8_t *src, size_t samples, const WAV_fmt_t &fmt, float *dst)
+{
+    int container = pcm_container_size(fmt);
+
+    if (pcm_is_float(fmt) && container == 4)
+    {
+        memcpy(dst, src, samples * 4);
+        return;
+    }
+
+    if (pcm_is_float(fmt))
+    {
+        for (size_t i = 0; i < samples; i++)
+        {
+            double d;
+            memcpy(&d, src + i * 8, 8);
+            dst[i] = static_cast<float>(d);
+        }
+        return;
+    }
+
+    switch (container)
+    {
+    case 1:
+        // 8 bit PCM is unsigned
+        for (size_t i = 0; i < samples; i++)
+            dst[i] = (static_cast<int>(src[i]) - 128) * (1.0f / 128);
+        break;
+
+    case 2:
+        for (size_t i = 0; i < samples; i++)
+        {
+            int16_t v = static_cast<int16_t>(src[i * 2] | (src[i * 2 + 1] << 8));
+            dst[i] = v * (1.0f / 32768);
+        }
+        break;
+
+    case 3:
+        for (size_t i = 0; i < samples; i++)
+        {
+            // place the 24 bits at the top of an int32 so the sign extends
+            int32_t v = static_cast<int32_t>((static_cast<uint32_t>(src[i * 3]) << 8) |
+                                             (static_cast<uint32_t>(src[i * 3 + 1]) << 16) |
+                                             (static_cast<uint32_t>(src[i * 3 + 2]) << 24));
+            dst[i] = v * (1.0f / 2147483648.0f);
+        }
+        break;
+
+    case 4:
+        for (size_t i = 0; i < samples; i++)
+        {
+            int32_t v;
+            memcpy(&v, src + i * 4, 4);
+            dst[i] = v * (1.0f / 2147483648.0f);
+        }
+        break;
+    }
+}
+
+void pcm_to_int(const uint8_t *src, size_t samples, const WAV_fmt_t &fmt, int32_t *dst)
+{
+    int container = pcm_container_size(fmt);
+    if (pcm_is_float(fmt))
+        throw std::runtime_error("Float samples can't be converted to integers.");
+
+    switch (container)
+    {
+    case 1:
+        for (size_t i = 0; i < samples; i++)
+            dst[i] = static_cast<int>(src[i]) - 128;
+        break;
+
+    case 2:
+        for (size_t i = 0; i < samples; i++)
+            dst[i] = static_cast<int16_t>(src[i * 2] | (src[i * 2 + 1] << 8));
+        break;
+
+    case 3:
+        for (size_t i = 0; i < samples; i++)
+        {
+            int32_t v = static_cast<int32_t>((static_cast<uint32_t>(src[i * 3]) << 8) |
+                                             (static_cast<uint32_t>(src[i * 3 + 1]) << 16) |
+                                             (static_cast<uint32_t>(src[i * 3 + 2]) << 24));
+            dst[i] = v >> 8;
+        }
+        break;
+
+    case 4:
+        memcpy(dst, src, samples * 4);
+        break;
+    }
+}
+
+void float_to_pcm(const float *src, size_t samples, const WAV_fmt_t &fmt, uint8_t *dst)
+{
+    int container = pcm_container_size(fmt);
+
+    if (pcm_is_float(fmt) && container == 4)
+    {
+        memcpy(dst, src, samples * 4);
+        return;
+    }
+
+    if (pcm_is_float(fmt))
+    {
+        for (size_t i = 0; i < samples; i++)
+        {
+            double d = src[i];
+            memcpy(dst + i * 8, &d, 8);
+        }
+        return;
+    }
+
+    switch (container)
+    {
+    case 1:
+        for (size_t i = 0; i < samples; i++)
+        {
+            float v = src[i] * 128;
+            v = v < -128 ? -128 : (v > 127 ? 127 : v);
+            dst[i] = static_cast<uint8_t>(lrintf(v) + 128);
+        }
+        break;
+
+    case 2:
+        for (size_t i = 0; i < samples; i++)
+        {
+            float v = src[i] * 32768;
+            v = v < -32768 ? -32768 : (v > 32767 ? 32767 : v);
+            int32_t s = lrintf(v);
+            dst[i * 2] = s & 0xff;
+            dst[i * 2 + 1] = (s >> 8) & 0xff;
+        }
+        break;
+
+    case 3:
+        for (size_t i = 0; i < samples; i++)
+        {
+            float v = src[i] * 8388608;
+            v = v < -8388608 ? -8388608 : (v > 8388607 ? 8388607 : v);
+            int32_t s = lrintf(v);
+            dst[i * 3] = s & 0xff;
+            dst[i * 3 + 1] = (s >> 8) & 0xff;
+            dst[i * 3 + 2] = (s >> 16) & 0xff;
+        }
+        break;
+
+    case 4:
+        for (size_t i = 0; i < samples; i++)
+        {
+            // full scale doesn't fit a float's mantissa, clamp in double
+            double v = src[i] * 2147483648.0;
+            v = v < -2147483648.0 ? -2147483648.0 : (v > 2147483647.0 ? 2147483647.0 : v);
+            int32_t s = static_cast<int32_t>(lrint(v));
+            memcpy(dst + i * 4, &s, 4);
+        }
+        break;
+    }
+}
+
+void pcm_accumulate(const float *src, size_t count, double &sum_squares, float &peak)
+{
+    float sums[lanes]{0};
+    float peaks[lanes]{0};
+
+    size_t i = 0;
+    for (; i + lanes <= count; i += lanes)
+    {
+        for (int l = 0; l < lanes; l++)
+        {
+            float v = src[i + l];
+            sums[l] += v * v;
+            float a = v < 0 ? -v : v;
+            peaks[l] = a > peaks[l] ? a : peaks[l];
+        }
+    }
+
+    for (int l = 0; i < count; i++, l++)
+    {
+        float v = src[i];
+        sums[l] += v * v;
+        float a = v < 0 ? -v : v;
+        peaks[l] = a > peaks[l] ? a : peaks[l];
+    }
+
+    for (int l = 0; l < lanes; l++)
+    {
+        sum_squares += sums[l];
+        peak = peaks[l] > peak ? peaks[l] : peak;
+    }
+}
@@ -0,0 +1,224 @@
+#include "WAVpipeline.h"
+#include "WAVtrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+// spin briefly, then give up the core, then sleep: stages wait on each other only when one is much slower
+static void backoff(unsigned &spins)
+{
+    spins++;
+    if (spins < 64)
+        return;
+    if (spins < 256)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+split_pipeline_t::split_pipeline_t(size_t depth, size_t block_size) : m_buffers(depth ? depth : 1), m_block_size(block_size)
+{
+    for (auto &i : m_buffers)
+        i = byte_vector_t(memory_subsystem_t::split);
+}
+
+uint64_t split_pipeline_t::buffer_bytes() const
+{
+    return static_cast<uint64_t>(m_buffers.size()) * m_block_size;
+}
+
+void split_pipeline_t::fail(std::exception_ptr error)
+{
+    std::lock_guard<std::mutex> lock(m_error_mutex);
+    if (!m_error)
+        m_error = error;
+    m_stop = true;
+}
+
+template <typename T>
+bool split_pipeline_t::push(spsc_queue_t<T> &queue, const T &value)
+{
+    for (unsigned spins = 0; !queue.try_push(value); backoff(spins))
+        if (m_stop.load(std::memory_order_relaxed))
+            return false;
+    return true;
+}
+
+template <typename T>
+bool split_pipeline_t::pop(spsc_queue_t<T> &queue, T &value)
+{
+    for (unsigned spins = 0; !queue.try_pop(value); backoff(spins))
+        if (m_stop.load(std::memory_order_relaxed))
+            return false;
+    return true;
+}
+
+void split_pipeline_t::read_stage(const read_t &read, uint32_t frame_size, const std::vector<region_t> &regions,
+                                  spsc_queue_t<size_t> &recycled, spsc_queue_t<block_t> &filled)
+{
+    trace_t::name_thread("pipeline reader");
+
+    uint32_t block_frames = frame_size ? m_block_size / frame_size : m_block_size;
+    block_frames = std::max<uint32_t>(block_frames, 1);
+
+    for (size_t r = 0; r < regions.size(); r++)
+    {
+        // an empty region still gets its (empty) last block so the later stages see it
+        uint32_t frame = regions[r].frame_offset;
+        uint32_t end = frame + regions[r].frames;
+        do
+        {
+            size_t buffer;
+            if (!pop(recycled, buffer))
+                return;
+
+            uint32_t frames = std::min(block_frames, end - frame);
+            size_t size = static_cast<size_t>(frames) * frame_size;
+            m_buffers[buffer].resize(std::max(size, m_buffers[buffer].size()));
+            {
+                TRACE_SPAN("read");
+                read(frame, frames, m_buffers[buffer].data());
+            }
+            frame += frames;
+
+            if (!push(filled, {r, buffer, size, frame == end}))
+                return;
+        } while (frame < end);
+    }
+}
+
+void split_pipeline_t::transform_stage(const transform_t &transform, spsc_queue_t<block_t> &filled,
+                                       spsc_queue_t<block_t> &transformed)
+{
+    trace_t::name_thread("pipeline transform");
+
+    block_t block;
+    while (pop(filled, block))
+    {
+        {
+            TRACE_SPAN("analyze");
+            transform(block.region, m_buffers[block.buffer].data(), block.size, block.last);
+        }
+        if (!push(transformed, block))
+            return;
+    }
+}
+
+void split_pipeline_t::write_stage(const std::vector<region_t> &regions, const write_t &write,
+                                   spsc_queue_t<block_t> &transformed, spsc_queue_t<size_t> &recycled)
+{
+    for (size_t r = 0; r < regions.size(); r++)
+    {
+        block_t block;
+        bool holding{false};
+        bool done{false};
+        size_t offset{0};
+
+        // the block after the last one read is taken on demand, a consumed block goes back to the reader
+        auto next = [&]() {
+            if (!pop(transformed, block))
+                throw std::runtime_error("Split pipeline stopped.");
+            holding = true;
+            offset = 0;
+        };
+        auto release = [&]() {
+            holding = false;
+            done = block.last;
+            if (!push(recycled, block.buffer))
+                throw std::runtime_error("Split pipeline stopped.");
+        };
+
+        auto read = [&](uint8_t *dst, size_t capacity) {
+            size_t n{0};
+            while (n < capacity && !done)
+            {
+                if (!holding)
+                    next();
+
+                size_t count = std::min(capacity - n, block.size - offset);
+                memcpy(dst + n, m_buffers[block.buffer].data() + offset, count);
+                n += count;
+                offset += count;
+                if (offset == block.size)
+                    release();
+            }
+            return n;
+        };
+
+        write(r, read);
+
+        // only an empty region's last block may be left, anything else was not written
+        while (!done)
+        {
+            if (!holding)
+                next();
+            if (offset != block.size)
+                throw std::runtime_error("Region data was not fully written.");
+            release();
+        }
+    }
+}
+
+void split_pipeline_t::run(const read_t &read, uint32_t frame_size, const std::vector<region_t> &regions,
+                           const transform_t &transform, const write_t &write)
+{
+    m_stop = false;
+    m_error = nullptr;
+
+    // every buffer fits in every queue, so only an empty queue makes a stage wait
+    spsc_queue_t<size_t> recycled(m_buffers.size());
+    spsc_queue_t<block_t> filled(m_buffers.size());
+    spsc_queue_t<block_t> transformed(m_buffers.size());
+    for (size_t i = 0; i < m_buffers.size(); i++)
+        recycled.try_push(i);
+
+    // without a transform the reader feeds the writer directly
+    spsc_queue_t<block_t> &read_to = transform ? filled : transformed;
+
+    std::thread reader([&]() {
+        try
+        {
+            read_stage(read, frame_size, regions, recycled, read_to);
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+    });
+
+    std::thread transformer;
+    if (transform)
+    {
+        transformer = std::thread([&]() {
+            try
+            {
+                transform_stage(transform, filled, transformed);
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+        });
+    }
+
+    try
+    {
+        write_stage(regions, write, transformed, recycled);
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+
+    // the transform stage waits for blocks that will never come once everything was written
+    m_stop = true;
+    reader.join();
+    if (transformer.joinable())
+        transformer.join();
+
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
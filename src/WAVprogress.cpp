@@ -0,0 +1,198 @@
+#include "WAVprogress.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+std::atomic<bool> progress_t::s_enabled{false};
+
+std::atomic<uint64_t> progress_t::s_input_total{0};
+std::atomic<uint64_t> progress_t::s_input_done{0};
+std::atomic<uint64_t> progress_t::s_split_total{0};
+std::atomic<uint64_t> progress_t::s_split_done{0};
+std::atomic<uint64_t> progress_t::s_regions_total{0};
+std::atomic<uint64_t> progress_t::s_regions_done{0};
+std::atomic<uint64_t> progress_t::s_active[2]{{0}, {0}};
+
+void progress_t::enable()
+{
+    s_enabled = true;
+}
+
+progress_t::snapshot_t progress_t::get()
+{
+    snapshot_t s;
+    s.input_total = s_input_total.load(std::memory_order_relaxed);
+    s.input_done = s_input_done.load(std::memory_order_relaxed);
+    s.split_total = s_split_total.load(std::memory_order_relaxed);
+    s.split_done = s_split_done.load(std::memory_order_relaxed);
+    s.regions_total = s_regions_total.load(std::memory_order_relaxed);
+    s.regions_done = s_regions_done.load(std::memory_order_relaxed);
+    s.parsing = s_active[parsing].load(std::memory_order_relaxed);
+    s.splitting = s_active[splitting].load(std::memory_order_relaxed);
+    return s;
+}
+
+// ====================================================================================================================
+// a terminal is redrawn a few times a second, machines reading JSON lines get one a second
+static const std::chrono::milliseconds terminal_interval(500);
+static const std::chrono::milliseconds json_interval(1000);
+
+// weight of the latest interval in the smoothed rate
+static const double rate_weight = 0.3;
+
+static void write_all(int fd, const std::string &text)
+{
+    // progress is best effort, a closed descriptor doesn't stop the run
+    size_t done{0};
+    while (done < text.size())
+    {
+        ssize_t n = ::write(fd, text.data() + done, text.size() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        done += n;
+    }
+}
+
+static std::string format(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static std::string format(const char *fmt, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+    return buffer;
+}
+
+static std::string duration(double seconds)
+{
+    unsigned long s = seconds + 0.5;
+    if (s >= 3600)
+        return format("%lu:%02lu:%02lu", s / 3600, s / 60 % 60, s % 60);
+    return format("%lu:%02lu", s / 60, s % 60);
+}
+
+static double now()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+progress_session_t::progress_session_t(int fd, bool json) : m_fd(fd), m_json(json)
+{
+    if (m_fd < 0)
+        return;
+
+    progress_t::enable();
+    m_last_time = now();
+
+    m_thread = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_wake.wait_for(lock, m_json ? json_interval : terminal_interval, [this]() { return m_stop; }))
+        {
+            lock.unlock();
+            report(now(), false);
+            lock.lock();
+        }
+    });
+}
+
+progress_session_t::~progress_session_t()
+{
+    if (m_fd < 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+
+    report(now(), true);
+}
+
+void progress_session_t::report(double elapsed, bool last)
+{
+    progress_t::snapshot_t p = progress_t::get();
+
+    // the phase follows what the inputs are doing now, an input parsed while another one is split is counted but
+    // the split is what the run is waiting for, and rate and ETA only ever compare bytes of the same kind
+    bool splitting = p.splitting > 0 || (p.parsing == 0 && p.regions_total > 0);
+    uint64_t done = splitting ? p.split_done : p.input_done;
+    uint64_t total = splitting ? p.split_total : p.input_total;
+
+    const char *phase = "parse";
+    if (last)
+        phase = "done";
+    else if (p.splitting > 0)
+        phase = "split";
+    else if (splitting)
+        phase = "idle";
+
+    // the counters are totals over all inputs, both kinds are remembered so the rate of a new phase is measured
+    // from the last report on, and not smoothed with the rate of the other kind
+    if (strcmp(phase, m_phase) != 0)
+    {
+        m_phase = phase;
+        m_rate = 0;
+    }
+
+    double interval = elapsed - m_last_time;
+    if (interval > 0)
+    {
+        double rate = (done - (splitting ? m_last_split : m_last_input)) / interval;
+        m_rate = m_rate == 0 ? rate : rate_weight * rate + (1 - rate_weight) * m_rate;
+    }
+    m_last_time = elapsed;
+    m_last_input = p.input_done;
+    m_last_split = p.split_done;
+
+    // the last report has the average over the whole run instead of the current rate
+    double rate = last ? (elapsed > 0 ? done / elapsed : 0) : m_rate;
+    double eta = -1;
+    if (total > 0 && done >= total)
+        eta = 0;
+    else if (total > 0 && rate > 0)
+        eta = (total - done) / rate;
+
+    std::string line;
+    if (m_json)
+    {
+        line = format("{\"elapsed_s\": %.3f, \"phase\": \"%s\", \"input_bytes\": %llu, \"parsed_bytes\": %llu, "
+                      "\"bytes\": %llu, \"total_bytes\": %llu, \"regions\": %llu, \"total_regions\": %llu, "
+                      "\"mb_per_s\": %.2f, \"eta_s\": ",
+                      elapsed, phase, static_cast<unsigned long long>(p.input_total),
+                      static_cast<unsigned long long>(p.input_done), static_cast<unsigned long long>(p.split_done),
+                      static_cast<unsigned long long>(p.split_total), static_cast<unsigned long long>(p.regions_done),
+                      static_cast<unsigned long long>(p.regions_total), rate / 1e6);
+        line += eta < 0 ? "null}\n" : format("%.1f}\n", eta);
+        write_all(m_fd, line);
+        return;
+    }
+
+    line = phase;
+    if (splitting)
+        line += format(" %llu/%llu regions,", static_cast<unsigned long long>(p.regions_done),
+                       static_cast<unsigned long long>(p.regions_total));
+    line += total > 0 ? format(" %.1f/%.1f MB", done / 1e6, total / 1e6) : format(" %.1f MB", done / 1e6);
+    line += format(", %.1f MB/s", rate / 1e6);
+    if (last)
+        line += ", " + duration(elapsed);
+    else
+        line += eta < 0 ? ", ETA --:--" : ", ETA " + duration(eta);
+
+    // redrawn in place on a terminal, one line per report anywhere else
+    if (isatty(m_fd))
+        write_all(m_fd, "\r" + line + "\x1b[K" + (last ? "\n" : ""));
+    else
+        write_all(m_fd, line + "\n");
+}
@@ -0,0 +1,123 @@
+#include "WAVscheduler.h"
+#include "WAVtrace.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <sys/resource.h>
+
+uint64_t peak_rss()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    // kilobytes on Linux
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+// ====================================================================================================================
+memory_budget_t::memory_budget_t(uint64_t limit) : m_limit(limit)
+{
+}
+
+bool memory_budget_t::try_acquire(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_used + bytes > m_limit)
+        return false;
+
+    m_used += bytes;
+    return true;
+}
+
+void memory_budget_t::acquire(uint64_t bytes)
+{
+    // it would wait forever
+    if (bytes > m_limit)
+        throw std::runtime_error("Needs " + std::to_string(bytes >> 20) + " MiB, more than the memory budget of " +
+                                 std::to_string(m_limit >> 20) + " MiB.");
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_released.wait(lock, [&] { return m_used + bytes <= m_limit; });
+    m_used += bytes;
+}
+
+void memory_budget_t::release(uint64_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_used -= bytes;
+    }
+    m_released.notify_all();
+}
+
+uint64_t memory_budget_t::limit() const
+{
+    return m_limit;
+}
+
+// ====================================================================================================================
+split_scheduler_t::split_scheduler_t(uint64_t max_memory, unsigned workers, const std::string &output_root,
+                                     const std::function<void(WAVsplitter &)> &configure)
+    : m_output_root(output_root), m_configure(configure),
+      m_budget(max_memory > peak_rss() ? max_memory - peak_rss() : 0), m_pool(workers)
+{
+    if (!m_output_root.empty() && *m_output_root.rbegin() != '/')
+        m_output_root.append("/");
+}
+
+void split_scheduler_t::add(const std::string &filename)
+{
+    m_pool.submit([this, filename](unsigned) { process(filename); });
+}
+
+void split_scheduler_t::process(const std::string &filename)
+{
+    TRACE_SPAN("file", filename);
+
+    try
+    {
+        WAVsplitter split;
+        m_configure(split);
+
+        // headers only, region bytes are read from the file when they are written
+        split.set_max_buffered(0);
+        split.open(filename);
+
+        if (!m_output_root.empty())
+        {
+            std::string name = filename.substr(filename.rfind('/') + 1);
+            split.set_output_directory(m_output_root + name.substr(0, name.find('.')) + "/");
+        }
+
+        // split normally if the whole footprint fits now, stream otherwise instead of waiting for room
+        uint64_t reserved = split.estimate_memory(false);
+        if (split.get_streaming() || !m_budget.try_acquire(reserved))
+        {
+            reserved = split.estimate_memory(true);
+            split.set_streaming(true);
+            m_budget.acquire(reserved);
+        }
+
+        try
+        {
+            split.split();
+        }
+        catch (...)
+        {
+            m_budget.release(reserved);
+            throw;
+        }
+        m_budget.release(reserved);
+    }
+    catch (const std::exception &e)
+    {
+        m_failed++;
+        std::cerr << filename << ": " << e.what() << std::endl;
+    }
+}
+
+int split_scheduler_t::wait()
+{
+    m_pool.wait();
+    return m_failed;
+}
@@ -0,0 +1,107 @@
+#include "WAVsilence.h"
+#include "WAVpcm.h"
+
+#include <cmath>
+
+// frames converted per call to the conversion kernel
+static const uint32_t block_frames = 1 << 14;
+
+silence_detector_t::silence_detector_t(const WAV_fmt_t &fmt, const silence_options_t &options) : m_fmt(fmt)
+{
+    // throws for formats the conversion kernels don't handle
+    pcm_container_size(fmt);
+
+    double window_frames = std::floor(options.window * fmt.sample_rate);
+    m_window_frames = window_frames < 1 ? 1 : static_cast<uint32_t>(window_frames);
+
+    double silent_windows = std::ceil(options.min_silence * fmt.sample_rate / m_window_frames);
+    m_min_silent_windows = silent_windows < 1 ? 1 : static_cast<uint32_t>(silent_windows);
+
+    // compare mean squares instead of taking a root per window
+    m_threshold = std::pow(10.0, options.threshold_db / 10.0);
+    m_peak_threshold = static_cast<float>(std::pow(10.0, options.peak_db / 20.0));
+
+    m_buffer.resize(static_cast<size_t>(block_frames) * fmt.num_channels);
+}
+
+void silence_detector_t::end_window()
+{
+    double mean_square = m_sum_squares / (static_cast<double>(m_window_fill) * m_fmt.num_channels);
+    bool silent = mean_square < m_threshold && m_peak < m_peak_threshold;
+
+    if (silent)
+    {
+        if (m_silent_windows != UINT32_MAX)
+            m_silent_windows++;
+    }
+    else
+    {
+        // sound after a long enough gap starts a new region
+        if (m_silent_windows >= m_min_silent_windows)
+            m_onsets.push_back(m_window_start);
+        m_silent_windows = 0;
+    }
+
+    m_window_start += m_window_fill;
+    m_window_fill = 0;
+    m_sum_squares = 0;
+    m_peak = 0;
+}
+
+void silence_detector_t::process(const uint8_t *bytes, size_t length)
+{
+    size_t frames = length / m_fmt.block_align;
+
+    while (frames > 0)
+    {
+        uint32_t n = frames < block_frames ? frames : block_frames;
+        pcm_to_float(bytes, static_cast<size_t>(n) * m_fmt.num_channels, m_fmt, m_buffer.data());
+
+        // split the converted block into windows
+        for (uint32_t done = 0; done < n;)
+        {
+            uint32_t take = m_window_frames - m_window_fill;
+            if (take > n - done)
+                take = n - done;
+
+            pcm_accumulate(m_buffer.data() + static_cast<size_t>(done) * m_fmt.num_channels,
+                           static_cast<size_t>(take) * m_fmt.num_channels, m_sum_squares, m_peak);
+            m_window_fill += take;
+            done += take;
+
+            if (m_window_fill == m_window_frames)
+                end_window();
+        }
+
+        bytes += static_cast<size_t>(n) * m_fmt.block_align;
+        frames -= n;
+    }
+}
+
+const std::vector<uint32_t> &silence_detector_t::finish()
+{
+    if (m_window_fill > 0)
+        end_window();
+
+    return m_onsets;
+}
+
+std::vector<uint32_t> silence_detector_t::scan(const RIFF_chunk_data_t &data, const WAV_fmt_t &fmt, const silence_options_t &options)
+{
+    silence_detector_t detector(fmt, options);
+
+    // read whole frames only
+    uint32_t block = (1 << 20) / fmt.block_align * fmt.block_align;
+    uint32_t total = data.size() / fmt.block_align * fmt.block_align;
+
+    std::vector<uint8_t> bytes(block);
+    for (uint32_t offset = 0; offset < total;)
+    {
+        uint32_t n = total - offset < block ? total - offset : block;
+        data.read_data(offset, n, bytes.data());
+        detector.process(bytes.data(), n);
+        offset += n;
+    }
+
+    return detector.finish();
+}
@@ -1,19 +1,188 @@
 #include "WAVsplit.h"
+#include "WAVindex.h"
+#include "CRC32C.h"
+#include "WAVtrace.h"
+#include "WAVprogress.h"
+#include "FLACencoder.h"
+#include "WorkerPool.h"
 
-void WAVsplitter::read_wav(const std::string &filename)
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
+
+// the bytes WAV_t::write() puts in front of the samples, for a split without samples
+static std::vector<uint8_t> header_template(const WAV_fmt_t &header)
 {
-    WAV_t wav(filename);
-    wav_header = wav.header;
+    WAV_t empty;
+    empty.header = header;
+
+    std::ostringstream f;
+    empty.write(f);
+    const std::string &bytes = f.str();
+    return std::vector<uint8_t>(bytes.begin(), bytes.end());
+}
+
+// a header template with the RIFF and 'data' sizes set for a payload, which must fit the 32 bit RIFF size
+static std::vector<uint8_t> region_header(const std::vector<uint8_t> &header_template, uint64_t data_bytes)
+{
+    std::vector<uint8_t> header = header_template;
+
+    uint32_t template_size;
+    memcpy(&template_size, &header[4], 4);
+    uint64_t riff_size = template_size + data_bytes + data_bytes % 2;
+    if (riff_size > UINT32_MAX)
+        throw std::runtime_error("Region is too large for a WAV file.");
+
+    uint32_t size = riff_size;
+    memcpy(&header[4], &size, 4);
+    size = data_bytes;
+    memcpy(&header[header.size() - 4], &size, 4);
+
+    return header;
+}
+
+void WAVsplitter::parse_wav(const std::string &filename)
+{
+    // identify the file before parsing so a change during the parse makes the index stale
+    TRACE_SPAN("parse", filename);
+
+    WAV_index_t index;
+    bool indexable = use_index && filename != "-" && index.identify(filename);
+
+    source = std::make_unique<WAV_t>(filename, max_buffered);
+    read_source();
+
+    if (indexable)
+        save_index(filename, index);
+}
+
+void WAVsplitter::read_source()
+{
+    WAV_t &wav = *source;
+
+    // regions are copied from the raw 'data' bytes, decoded samples are not needed
+    sample_vector_t(wav.samples.get_allocator()).swap(wav.samples);
+
     read_labl(wav);
     read_cue(wav);
 
+    data_start = wav.get_riff().get_chunk_with_id("data")->get_offset() + 8;
+}
+
+// copy a chunk's whole payload, whether it is held in memory or was left on disk
+static std::vector<uint8_t> read_payload(const RIFF_chunk_data_t &chunk)
+{
+    std::vector<uint8_t> payload(chunk.size());
+    chunk.read_data(0, payload.size(), payload.data());
+    return payload;
+}
+
+// collect the chunk offset table depth first
+static void index_chunks(const RIFF_chunk_list_t &list, uint32_t depth, std::vector<index_chunk_t> &chunks)
+{
+    for (auto &i : list.get_subchunks())
+    {
+        index_chunk_t chunk{};
+        memcpy(chunk.identifier, i->get_identifier(), 4);
+        chunk.depth = depth;
+        chunk.offset = i->get_offset();
+        chunk.size = i->size();
+
+        RIFF_chunk_list_t *sublist = dynamic_cast<RIFF_chunk_list_t *>(i.get());
+        if (sublist)
+        {
+            memcpy(chunk.form_type, sublist->get_form_type(), 4);
+            chunk.size = sublist->total_size() - 8;
+        }
+        chunks.push_back(chunk);
+
+        if (sublist)
+            index_chunks(*sublist, depth + 1, chunks);
+    }
+}
+
+void WAVsplitter::save_index(const std::string &filename, WAV_index_t &index)
+{
+    TRACE_SPAN("save index", filename);
+
+    index_chunks(source->get_riff().get_root_chunk(), 0, index.chunks);
+    index.fmt.assign(source->get_fmt().begin(), source->get_fmt().end());
+    index.cues = cue_chunk.data;
+    index.labels = labl_identifiers;
+    index.save(filename);
+}
+
+bool WAVsplitter::load_index(const std::string &filename)
+{
+    TRACE_SPAN("load index", filename);
+
+    WAV_index_t index;
+    uint64_t data_offset;
+    uint32_t data_size;
+    if (!index.load(filename) || !index.find("data", data_offset, data_size) || index.fmt.empty())
+        return false;
+
+    // an empty WAV_t already has 'fmt ' and 'data' chunks, fill them from the index
+    source = std::make_unique<WAV_t>();
+    source->get_fmt().assign(index.fmt.begin(), index.fmt.end());
+    source->load_fmt();
+    dynamic_cast<RIFF_chunk_data_t *>(source->get_riff().get_chunk_with_id("data"))->set_file(RIFF_file_t::open(filename), data_offset, data_size);
+    source->get_riff().set_filepath(filename);
+    data_start = data_offset;
+
+    cue_chunk.data = index.cues;
+    cue_chunk.cue_points = index.cues.size();
+    labl_identifiers = index.labels;
+    return true;
+}
+
+void WAVsplitter::read_wav(const std::string &filename)
+{
+    reset();
+    progress_t::stage_scope_t stage(progress_t::parsing);
+
+    if (!use_index || filename == "-" || !load_index(filename))
+        parse_wav(filename);
+
+    plan_splits();
+}
+
+void WAVsplitter::reset()
+{
+    // a splitter can be opened again for another file
+    labl_identifiers.clear();
+    cue_chunk = cue_chunk_t{};
+    split_wavs.clear();
+    selected = false;
+    selection.clear();
+    part.clear();
+}
+
+void WAVsplitter::plan_splits()
+{
+    const WAV_t &wav = *source;
     wav_header = wav.header;
+
+    if (cue_chunk.data.empty() && auto_split)
+        detect_silence(wav);
+
+    uint32_t frames = wav.frames();
+
+    // regions run from one cue point to the next, cue points may be stored in any order and past the end of 'data'
+    std::stable_sort(cue_chunk.data.begin(), cue_chunk.data.end(),
+                     [](const cue_point_t &a, const cue_point_t &b) { return a.sample_start < b.sample_start; });
+
     // create splitWAV structs =======================================================================================
     split_wavs.reserve(cue_chunk.data.size());
     for (auto &i : cue_chunk.data)
     {
         // lookup string name by identifier
-        split_wavs.push_back({labl_identifiers[i.identifier], i.sample_start});
+        split_wavs.push_back({labl_identifiers[i.identifier], std::min(i.sample_start, frames)});
 
         // assign header data to each WAV_t
         split_wavs.back().wav.header = wav_header;
@@ -51,31 +220,27 @@ void WAVsplitter::read_wav(const std::string &filename)
     for (auto i = split_wavs.rbegin(); i != split_wavs.rend(); i++)
     {
         if (i == split_wavs.rbegin())
-            i->byte_length = (wav.samples.size() / (wav_header.bits_per_sample / 8)) - i->byte_offset;
+            i->byte_length = frames - i->byte_offset;
         else
             i->byte_length = (i - 1)->byte_offset - i->byte_offset;
     }
 
-    // populate WAV_t objects =======================================================================================
-    for (auto &i : split_wavs)
-    {
-        // by samples
-        std::vector<uint64_t>::iterator start = wav.samples.begin() + (i.byte_offset * wav_header.num_channels);
-        std::vector<uint64_t>::iterator end = start + (i.byte_length * wav_header.num_channels);
-        i.wav.samples.assign(start, end);
-    }
+    // WAV_t objects are populated one at a time in split() so only a single region is held in memory
     // for (auto &i : split_wavs)
     //     printf("%s:\t\tbyte offset: %d,\t\tbyte length: %d,\t\tsamples: %d\n", i.file_name.c_str(), i.byte_offset, i.byte_length, i.wav.samples.size());
 }
 
-void WAVsplitter::read_labl(WAV_t &wav)
+void WAVsplitter::read_labl(const WAV_t &wav)
 {
-    const std::vector<std::unique_ptr<RIFF_chunk_t>> &riff_lists = wav.get_riff().get_root_chunk().get_subchunks();
+    TRACE_SPAN("decode labels");
+
+    const RIFF_chunk_list_t &root = wav.get_riff().get_root_chunk();
+    const std::vector<std::unique_ptr<RIFF_chunk_t>> &riff_lists = root.get_subchunks();
 
     // find all list chunks
     for (auto &i : riff_lists)
     {
-        RIFF_chunk_list_t *list = dynamic_cast<RIFF_chunk_list_t *>(i.get());
+        const RIFF_chunk_list_t *list = dynamic_cast<const RIFF_chunk_list_t *>(i.get());
         if (list != nullptr)
         {
             // find the list chunk with form type 'adtl' (associated data list)
@@ -86,14 +251,18 @@ void WAVsplitter::read_labl(WAV_t &wav)
             const std::vector<std::unique_ptr<RIFF_chunk_t>> &adtl_chunks = list->get_subchunks();
             for (auto &j : adtl_chunks)
             {
-                RIFF_chunk_data_t *adtl = dynamic_cast<RIFF_chunk_data_t *>(j.get());
+                const RIFF_chunk_data_t *adtl = dynamic_cast<const RIFF_chunk_data_t *>(j.get());
                 if (adtl != nullptr && (strcmp(adtl->get_identifier(), "labl") == 0 || strcmp(adtl->get_identifier(), "note") == 0))
                 {
                     // this is an 'adtl' or 'note' chunk
+                    std::vector<uint8_t> payload = read_payload(*adtl);
+                    if (payload.size() < 4)
+                        continue;
+
                     uint32_t adtl_id;
-                    memcpy(&adtl_id, &adtl->get_data().front(), sizeof(adtl_id));
-                    char *identifier = reinterpret_cast<char *>(&adtl->get_data().front()) + 4;
-                    labl_identifiers[adtl_id] = std::string(identifier, strlen(identifier));
+                    memcpy(&adtl_id, payload.data(), sizeof(adtl_id));
+                    const char *identifier = reinterpret_cast<const char *>(payload.data()) + 4;
+                    labl_identifiers[adtl_id] = std::string(identifier, strnlen(identifier, payload.size() - 4));
                 }
             }
         }
@@ -104,23 +273,28 @@ void WAVsplitter::read_labl(WAV_t &wav)
     // }
 }
 
-void WAVsplitter::read_cue(WAV_t &wav)
+void WAVsplitter::read_cue(const WAV_t &wav)
 {
-    RIFF_chunk_data_t *cue_data = dynamic_cast<RIFF_chunk_data_t *>(wav.get_riff().get_chunk_with_id("cue "));
+    TRACE_SPAN("decode cues");
+
+    const RIFF_chunk_data_t *cue_data = dynamic_cast<const RIFF_chunk_data_t *>(wav.get_riff().get_chunk_with_id("cue "));
     if (cue_data != nullptr)
     {
-        std::vector<uint8_t> cue_v = cue_data->get_data();
+        const std::vector<uint8_t> cue_v = read_payload(*cue_data);
+        if (cue_v.size() < sizeof(cue_chunk.cue_points))
+            throw std::runtime_error("Malformed 'cue ' chunk.");
 
         // copy length
-        memcpy(&cue_chunk.cue_points, &cue_v.front(), sizeof(cue_chunk.cue_points));
-        cue_v.erase(cue_v.begin(), cue_v.begin() + sizeof(cue_chunk.cue_points));
+        memcpy(&cue_chunk.cue_points, cue_v.data(), sizeof(cue_chunk.cue_points));
+        if ((cue_v.size() - sizeof(cue_chunk.cue_points)) / sizeof(cue_point_t) < cue_chunk.cue_points)
+            throw std::runtime_error("Malformed 'cue ' chunk.");
 
-        // grab each cue chunk
-        for (int i = 0; i < cue_chunk.cue_points; i++)
+        // grab each cue chunk in place instead of copying the payload
+        const uint8_t *point = cue_v.data() + sizeof(cue_chunk.cue_points);
+        for (uint32_t i = 0; i < cue_chunk.cue_points; i++, point += sizeof(cue_point_t))
         {
             cue_point_t cue_point;
-            memcpy(&cue_point, &cue_v.front(), sizeof(cue_point));
-            cue_v.erase(cue_v.begin(), cue_v.begin() + sizeof(cue_point));
+            memcpy(&cue_point, point, sizeof(cue_point));
             cue_chunk.data.push_back(cue_point);
         }
     }
@@ -135,8 +309,32 @@ void WAVsplitter::read_cue(WAV_t &wav)
     // }
 }
 
+void WAVsplitter::detect_silence(const WAV_t &wav)
+{
+    TRACE_SPAN("detect silence");
+
+    const RIFF_chunk_data_t *data = dynamic_cast<const RIFF_chunk_data_t *>(wav.get_riff().get_chunk_with_id("data"));
+    std::vector<uint32_t> onsets = silence_detector_t::scan(*data, wav.header, silence);
+
+    // one cue point per region, all labelled "region" so duplicate renaming numbers them
+    cue_chunk.cue_points = onsets.size();
+    for (uint32_t i = 0; i < onsets.size(); i++)
+    {
+        cue_point_t cue_point{i + 1, i, 0x61746164, 0, 0, onsets[i]}; // 'data'
+        cue_chunk.data.push_back(cue_point);
+        labl_identifiers[cue_point.identifier] = "region";
+    }
+}
+
 void WAVsplitter::output_dir_from_filename(const std::string &filename)
 {
+    // stdin has no name to derive a directory from
+    if (filename == "-")
+    {
+        set_output_directory("./");
+        return;
+    }
+
     std::string dir = filename.substr(filename.rfind('/') + 1);
     dir = dir.substr(0, dir.find('.'));
 
@@ -158,6 +356,34 @@ void WAVsplitter::open(const std::string &filename)
     output_dir_from_filename(filename);
 }
 
+void WAVsplitter::open(std::istream &f, std::shared_ptr<RIFF_file_t> file)
+{
+    reset();
+    progress_t::stage_scope_t stage(progress_t::parsing);
+    {
+        TRACE_SPAN("parse");
+        source = std::make_unique<WAV_t>(f, max_buffered, file);
+        read_source();
+    }
+    plan_splits();
+    output_dir_from_filename("-");
+}
+
+WAV_t &WAVsplitter::get_source()
+{
+    return *source;
+}
+
+const WAV_t &WAVsplitter::get_source() const
+{
+    return *source;
+}
+
+std::vector<uint8_t> WAVsplitter::get_header(const splitWAV &region) const
+{
+    return region_header(header_template(wav_header), static_cast<uint64_t>(region.byte_length) * wav_header.block_align);
+}
+
 void WAVsplitter::set_prefix(const std::string &new_prefix)
 {
     prefix = new_prefix;
@@ -190,17 +416,768 @@ const std::string &WAVsplitter::get_output_directory() const
     return output_directory;
 }
 
+void WAVsplitter::set_archive(const std::string &new_archive)
+{
+    archive = new_archive;
+}
+
+const std::string &WAVsplitter::get_archive() const
+{
+    return archive;
+}
+
+void WAVsplitter::set_shard(const shard_options_t &new_shard)
+{
+    shard = new_shard;
+}
+
+const shard_options_t &WAVsplitter::get_shard() const
+{
+    return shard;
+}
+
+void WAVsplitter::set_auto_split(bool new_auto_split)
+{
+    auto_split = new_auto_split;
+}
+
+bool WAVsplitter::get_auto_split() const
+{
+    return auto_split;
+}
+
+void WAVsplitter::set_silence_options(const silence_options_t &new_silence)
+{
+    silence = new_silence;
+}
+
+const silence_options_t &WAVsplitter::get_silence_options() const
+{
+    return silence;
+}
+
+void WAVsplitter::set_analyze(bool new_analyze)
+{
+    analyze = new_analyze;
+}
+
+bool WAVsplitter::get_analyze() const
+{
+    return analyze;
+}
+
+void WAVsplitter::set_manifest_format(split_manifest_t::format_t new_manifest_format)
+{
+    manifest_format = new_manifest_format;
+}
+
+split_manifest_t::format_t WAVsplitter::get_manifest_format() const
+{
+    return manifest_format;
+}
+
+const split_manifest_t &WAVsplitter::get_manifest() const
+{
+    return manifest;
+}
+
+void WAVsplitter::set_checksum(bool new_checksum)
+{
+    checksum = new_checksum;
+}
+
+bool WAVsplitter::get_checksum() const
+{
+    return checksum;
+}
+
+void WAVsplitter::set_use_index(bool new_use_index)
+{
+    use_index = new_use_index;
+}
+
+bool WAVsplitter::get_use_index() const
+{
+    return use_index;
+}
+
+void WAVsplitter::set_incremental(bool new_incremental, bool compare_hash)
+{
+    incremental = new_incremental;
+    incremental_hash = new_incremental && compare_hash;
+}
+
+bool WAVsplitter::get_incremental() const
+{
+    return incremental;
+}
+
+bool WAVsplitter::get_incremental_hash() const
+{
+    return incremental_hash;
+}
+
+void WAVsplitter::set_streaming(bool new_streaming)
+{
+    streaming = new_streaming;
+}
+
+bool WAVsplitter::get_streaming() const
+{
+    return streaming;
+}
+
+void WAVsplitter::set_flac(bool new_flac, unsigned threads)
+{
+    flac = new_flac;
+    encode_threads = threads;
+}
+
+bool WAVsplitter::get_flac() const
+{
+    return flac;
+}
+
+unsigned WAVsplitter::get_encode_threads() const
+{
+    return encode_threads;
+}
+
+void WAVsplitter::set_channel_map(const channel_map_t &new_channel_map)
+{
+    channel_map = new_channel_map;
+}
+
+const channel_map_t &WAVsplitter::get_channel_map() const
+{
+    return channel_map;
+}
+
+void WAVsplitter::set_max_buffered(uint32_t new_max_buffered)
+{
+    max_buffered = new_max_buffered;
+}
+
+uint32_t WAVsplitter::get_max_buffered() const
+{
+    return max_buffered;
+}
+
 std::vector<splitWAV> &WAVsplitter::get_splits()
 {
     return split_wavs;
 }
 
-void WAVsplitter::split()
+uint64_t WAVsplitter::estimate_memory(bool streaming) const
+{
+    const WAV_t &wav = *source;
+    const RIFF_chunk_data_t *data = dynamic_cast<const RIFF_chunk_data_t *>(wav.get_riff().get_chunk_with_id("data"));
+
+    // parsing and per-split bookkeeping, manifests, stream buffers
+    uint64_t bytes = (1 << 20) + split_wavs.size() * 1024;
+    if (data->is_buffered())
+        bytes += data->size();
+
+    // the 1 MiB block of write_region() and its copy in the output stream, then the blocks in flight in the pipeline
+    bytes += 2 << 20;
+    if (flac)
+    {
+        // write_flac() keeps two batches per encoder thread in flight, each with its source bytes and a
+        // compressed copy that is at worst about as large
+        unsigned threads = encode_threads ? encode_threads : std::max(std::thread::hardware_concurrency(), 1u);
+        return bytes + 2ull * threads * 2 * 16 * FLAC_encoder_t::block_size * wav_header.block_align;
+    }
+    return streaming ? bytes : bytes + pipeline.buffer_bytes();
+}
+
+void WAVsplitter::select_range(uint32_t start, uint32_t end)
 {
-    // set filepaths and write
+    if (start >= end || end > source->frames())
+        throw std::out_of_range("The range must be inside the 'data' chunk and not empty.");
+
+    split_wavs.clear();
+    split_wavs.push_back({"range_" + std::to_string(start) + "_" + std::to_string(end), start, end - start, {}});
+    split_wavs.back().wav.header = wav_header;
+}
+
+std::string WAVsplitter::output_name(size_t index) const
+{
+    std::string name = prefix + split_wavs[index].file_name + suffix + (flac ? ".flac" : ".wav");
+    return shard.subdirectory(name, index, split_wavs.size()) + name;
+}
+
+std::vector<size_t> WAVsplitter::regions_to_write() const
+{
+    if (selected)
+        return selection;
+
+    std::vector<size_t> all(split_wavs.size());
+    for (size_t i = 0; i < all.size(); i++)
+        all[i] = i;
+    return all;
+}
+
+split_plan_t WAVsplitter::get_plan() const
+{
+    channel_mixer_t planned_mixer(wav_header, channel_map);
+    const WAV_fmt_t &format = planned_mixer.format();
+    std::vector<uint8_t> header = header_template(format);
+
+    split_plan_t plan;
+    plan.source = source->get_riff().get_filepath();
+    plan.source_frames = source->frames();
+    plan.data_offset = data_start;
+    plan.format = format;
+    plan.header_bytes = header.size();
+    plan.flac = flac;
+    plan.part = part;
+
+    for (size_t index : regions_to_write())
+    {
+        const splitWAV &i = split_wavs[index];
+        uint64_t data_bytes = static_cast<uint64_t>(i.byte_length) * format.block_align;
+
+        plan_region_t region;
+        region.index = index;
+        region.name = output_name(index);
+        region.frame_offset = i.byte_offset;
+        region.frames = i.byte_length;
+        region.source_offset = data_start + static_cast<uint64_t>(i.byte_offset) * wav_header.block_align;
+        region.source_bytes = static_cast<uint64_t>(i.byte_length) * wav_header.block_align;
+        region.bytes = flac ? 0 : header.size() + data_bytes + data_bytes % 2;
+        plan.regions.push_back(region);
+    }
+    return plan;
+}
+
+std::vector<size_t> WAVsplitter::part_regions(uint32_t k, uint32_t n) const
+{
+    if (k < 1 || k > n)
+        throw std::invalid_argument("The part must be K/N with 1 <= K <= N.");
+
+    uint64_t total{0};
     for (auto &i : split_wavs)
+        total += i.byte_length;
+
+    // a region belongs to the part its middle falls into, so every part is one stretch of the input
+    std::vector<size_t> regions;
+    uint64_t before{0};
+    for (size_t i = 0; i < split_wavs.size(); i++)
+    {
+        uint64_t middle = before + split_wavs[i].byte_length / 2;
+        if (total > 0 && std::min<uint64_t>(middle * n / total, n - 1) == k - 1)
+            regions.push_back(i);
+        before += split_wavs[i].byte_length;
+    }
+    return regions;
+}
+
+void WAVsplitter::select_part(uint32_t k, uint32_t n)
+{
+    selection = part_regions(k, n);
+    selected = true;
+    part = std::to_string(k) + "/" + std::to_string(n);
+}
+
+void WAVsplitter::select_plan(const split_plan_t &plan)
+{
+    if (plan.source_frames != source->frames())
+        throw std::runtime_error("The plan was made for another input.");
+
+    selection.clear();
+    for (auto &r : plan.regions)
+    {
+        // the names depend on the options as well, they must be the same as when the plan was made
+        if (r.index >= split_wavs.size() || split_wavs[r.index].byte_offset != r.frame_offset ||
+            split_wavs[r.index].byte_length != r.frames || output_name(r.index) != r.name)
+            throw std::runtime_error("The plan doesn't match this input and options: " + r.name);
+
+        selection.push_back(r.index);
+    }
+
+    selected = true;
+
+    // an edited plan no longer is the part it was made as, its manifest must not take that part's name
+    uint32_t k, n;
+    part.clear();
+    if (sscanf(plan.part.c_str(), "%u/%u", &k, &n) == 2 && k >= 1 && k <= n && part_regions(k, n) == selection)
+        part = plan.part;
+}
+
+void WAVsplitter::split()
+{
+    progress_t::stage_scope_t stage(progress_t::splitting);
+
+    // existing files are recognized by their WAV header
+    if (incremental && flac)
+        throw std::runtime_error("Incremental splitting writes WAV files only.");
+
+    // every write path reads the source through it and writes splits in its format
+    mixer = std::make_unique<channel_mixer_t>(wav_header, channel_map);
+    const WAV_fmt_t &format = mixer->format();
+
+    std::unique_ptr<split_output_t> output;
+    split_directory_output_t *directory{nullptr};
+    if (archive.empty())
+    {
+        // incremental runs replace files atomically so an interrupted run never leaves a half written split
+        std::unique_ptr<split_directory_output_t> d = std::make_unique<split_directory_output_t>(output_directory, incremental);
+        directory = d.get();
+        output = std::move(d);
+    }
+    else
+    {
+        if (incremental)
+            throw std::runtime_error("Incremental splitting needs a directory output.");
+        output = std::make_unique<split_tar_output_t>(archive, output_directory);
+    }
+
+    // runs writing different parts into one directory each keep their own manifest
+    std::string manifest_part;
+    if (!part.empty())
+        manifest_part = "part-" + part.substr(0, part.find('/')) + "-of-" + part.substr(part.find('/') + 1);
+    else if (selected)
+        manifest_part = selection.empty() ? "regions-none" : "regions-" + std::to_string(selection.front()) + "-" + std::to_string(selection.back());
+
+    // the manifest of the previous run tells which byte range each existing file came from
+    std::unordered_map<std::string, manifest_entry_t> previous;
+    std::vector<uint8_t> header;
+    if (incremental)
+    {
+        header = header_template(format);
+
+        for (split_manifest_t::format_t manifest : {split_manifest_t::json, split_manifest_t::csv})
+        {
+            struct stat st;
+            std::string path = output_directory + split_manifest_t::filename(manifest, manifest_part);
+            if (stat(path.c_str(), &st) != 0)
+                continue;
+
+            for (auto &e : split_manifest_t::read(path).entries)
+                previous[e.name] = e;
+            break;
+        }
+    }
+
+    // decide which regions need writing first, so the pipeline can run over all of them at once
+    std::vector<manifest_entry_t> entries(split_wavs.size());
+    std::vector<size_t> pending;
+    std::vector<size_t> regions = regions_to_write();
+    for (size_t r : regions)
+    {
+        splitWAV &i = split_wavs[r];
+
+        manifest_entry_t &entry = entries[r];
+        entry.name = output_name(r);
+        entry.frame_offset = i.byte_offset;
+        entry.frames = i.byte_length;
+
+        // checked before any header is written, a region past the end would fail halfway through its file
+        if (static_cast<uint64_t>(i.byte_offset) + i.byte_length > source->frames())
+            throw std::runtime_error("Region exceeds the 'data' chunk: " + entry.name);
+
+        if (incremental)
+        {
+            uint64_t data_bytes = static_cast<uint64_t>(i.byte_length) * format.block_align;
+            std::vector<uint8_t> planned = region_header(header, data_bytes);
+            uint64_t size = planned.size() + data_bytes + data_bytes % 2;
+
+            // a file from an earlier run is kept if it covers the same byte range and looks the same, a file the
+            // manifest doesn't list may be left over from anything and is rewritten
+            auto old = previous.find(entry.name);
+            bool known = old != previous.end();
+            bool current = known && old->second.frame_offset == entry.frame_offset && old->second.frames == entry.frames &&
+                           (!analyze || old->second.has_stats) && (!checksum || old->second.has_checksum);
+
+            uint32_t expected_crc{0};
+            if (current && incremental_hash)
+            {
+                if (old->second.has_checksum)
+                {
+                    expected_crc = old->second.crc32c;
+                }
+                else
+                {
+                    // nothing recorded, hash what would be written
+                    std::vector<uint8_t> bytes(data_bytes);
+                    byte_vector_t scratch(memory_subsystem_t::split);
+                    read_frames(i.byte_offset, i.byte_length, bytes.data(), scratch);
+                    const uint8_t pad{0};
+                    expected_crc = crc32c(0, planned.data(), planned.size());
+                    expected_crc = crc32c(expected_crc, bytes.data(), bytes.size());
+                    expected_crc = crc32c(expected_crc, &pad, data_bytes % 2);
+                }
+            }
+
+            TRACE_SPAN("check existing", entry.name);
+            if (current && directory->is_current(entry.name, planned, size, incremental_hash ? &expected_crc : nullptr))
+            {
+                entry = old->second;
+                entry.bytes = size;
+                continue;
+            }
+        }
+
+        pending.push_back(r);
+    }
+
+    if (progress_t::enabled())
     {
-        i.wav.set_filepath(output_directory + prefix + i.file_name + suffix + ".wav");
-        i.wav.write();
+        uint64_t bytes{0};
+        for (size_t r : pending)
+            bytes += static_cast<uint64_t>(split_wavs[r].byte_length) * wav_header.block_align;
+        progress_t::add_split(bytes, pending.size());
     }
-}
\ No newline at end of file
+
+    if (flac)
+        write_flac(*output, pending, entries);
+    else if (streaming)
+        write_streaming(*output, pending, entries);
+    else
+        write_pipelined(*output, pending, entries);
+
+    manifest.entries.clear();
+    for (size_t r : regions)
+        manifest.entries.push_back(std::move(entries[r]));
+
+    // statistics without a format still need somewhere to go, incremental runs need it next time
+    split_manifest_t::format_t manifest_as = manifest_format;
+    if (manifest_as == split_manifest_t::none && (analyze || checksum || incremental))
+        manifest_as = split_manifest_t::json;
+
+    if (manifest_as != split_manifest_t::none)
+    {
+        TRACE_SPAN("manifest");
+        output->write_file(split_manifest_t::filename(manifest_as, manifest_part), manifest.serialize(manifest_as));
+    }
+
+    TRACE_SPAN("finish");
+    output->finish();
+}
+
+void WAVsplitter::read_frames(uint32_t frame, uint32_t frames, uint8_t *dst, byte_vector_t &scratch)
+{
+    if (mixer->identity())
+    {
+        source->read_frames(frame, frames, dst);
+        return;
+    }
+
+    scratch.resize(std::max<size_t>(scratch.size(), static_cast<size_t>(frames) * wav_header.block_align));
+    source->read_frames(frame, frames, scratch.data());
+
+    TRACE_SPAN("mix");
+    mixer->apply(scratch.data(), frames, dst);
+}
+
+void WAVsplitter::write_streaming(split_output_t &output, const std::vector<size_t> &pending, std::vector<manifest_entry_t> &entries)
+{
+    const WAV_fmt_t &format = mixer->format();
+    std::vector<uint8_t> header = header_template(format);
+    byte_vector_t scratch(memory_subsystem_t::split);
+
+    for (size_t k : pending)
+    {
+        splitWAV &i = split_wavs[k];
+        manifest_entry_t &entry = entries[k];
+        TRACE_SPAN("region", entry.name);
+
+        // statistics and checksums are fed block by block as the samples pass through
+        std::unique_ptr<stats_accumulator_t> stats;
+        if (analyze)
+            stats = std::make_unique<stats_accumulator_t>(format);
+
+        uint32_t frame = i.byte_offset;
+        uint32_t data_crc{0};
+        auto read = [&](uint8_t *dst, size_t capacity) {
+            uint32_t frames = std::min<size_t>(capacity / format.block_align, i.byte_offset + i.byte_length - frame);
+            read_frames(frame, frames, dst, scratch);
+            frame += frames;
+            progress_t::split_read(static_cast<uint64_t>(frames) * wav_header.block_align);
+
+            size_t n = static_cast<size_t>(frames) * format.block_align;
+            if (stats)
+                stats->process(dst, n);
+            if (checksum)
+                data_crc = crc32c(data_crc, dst, n);
+            return n;
+        };
+
+        uint64_t data_bytes = static_cast<uint64_t>(i.byte_length) * format.block_align;
+        entry.bytes = output.write_region(entry.name, region_header(header, data_bytes), data_bytes, read,
+                                          checksum ? &entry.crc32c : nullptr);
+        progress_t::region_done();
+
+        if (stats)
+        {
+            entry.stats = stats->finish();
+            entry.has_stats = true;
+        }
+        if (checksum)
+        {
+            entry.data_crc32c = data_crc;
+            entry.has_checksum = true;
+        }
+    }
+}
+
+void WAVsplitter::write_pipelined(split_output_t &output, const std::vector<size_t> &pending, std::vector<manifest_entry_t> &entries)
+{
+    const WAV_fmt_t &format = mixer->format();
+    std::vector<uint8_t> header = header_template(format);
+
+    std::vector<split_pipeline_t::region_t> regions;
+    for (size_t k : pending)
+        regions.push_back({split_wavs[k].byte_offset, split_wavs[k].byte_length});
+
+    // statistics and checksums on the transform thread, they only touch fields the writer leaves alone
+    std::unique_ptr<stats_accumulator_t> stats;
+    uint32_t data_crc{0};
+    split_pipeline_t::transform_t transform;
+    if (analyze || checksum)
+    {
+        transform = [&](size_t r, const uint8_t *data, size_t size, bool last) {
+            manifest_entry_t &entry = entries[pending[r]];
+            if (analyze)
+            {
+                if (!stats)
+                    stats = std::make_unique<stats_accumulator_t>(format);
+                stats->process(data, size);
+                if (last)
+                {
+                    entry.stats = stats->finish();
+                    entry.has_stats = true;
+                    stats.reset();
+                }
+            }
+            if (checksum)
+            {
+                data_crc = crc32c(data_crc, data, size);
+                if (last)
+                {
+                    entry.data_crc32c = data_crc;
+                    entry.has_checksum = true;
+                    data_crc = 0;
+                }
+            }
+        };
+    }
+
+    // only the reader thread reads, it keeps the unmixed frames here
+    byte_vector_t scratch(memory_subsystem_t::split);
+    auto read_source = [&](uint32_t frame, uint32_t count, uint8_t *dst) {
+        read_frames(frame, count, dst, scratch);
+        progress_t::split_read(static_cast<uint64_t>(count) * wav_header.block_align);
+    };
+
+    pipeline.run(read_source, format.block_align, regions, transform, [&](size_t r, const split_output_t::region_reader_t &read) {
+        manifest_entry_t &entry = entries[pending[r]];
+        TRACE_SPAN("region", entry.name);
+
+        uint64_t data_bytes = static_cast<uint64_t>(regions[r].frames) * format.block_align;
+        entry.bytes = output.write_region(entry.name, region_header(header, data_bytes), data_bytes, read,
+                                          checksum ? &entry.crc32c : nullptr);
+        progress_t::region_done();
+    });
+}
+
+void WAVsplitter::write_flac(split_output_t &output, const std::vector<size_t> &pending, std::vector<manifest_entry_t> &entries)
+{
+    const WAV_fmt_t &format = mixer->format();
+    FLAC_encoder_t encoder(format);
+
+    // a job encodes this many FLAC frames of one region, enough to keep a core busy for a while
+    const uint32_t batch_frames = 16 * FLAC_encoder_t::block_size;
+
+    struct batch_t
+    {
+        uint32_t frame;
+        uint32_t frames;
+        uint64_t first_block;
+
+        // the source bytes are kept for statistics and checksums, which need them in order
+        byte_vector_t pcm{memory_subsystem_t::split};
+        std::vector<uint8_t> encoded;
+        std::exception_ptr error;
+        bool done{false};
+    };
+
+    auto batches = [&](size_t k) { return (split_wavs[pending[k]].byte_length + batch_frames - 1) / batch_frames; };
+
+    // batches are encoded in any order and written in file order, at most window of them in flight
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::shared_ptr<batch_t>> window;
+    size_t submit_region{0};
+    uint32_t submit_batch{0};
+    bool keep_pcm = analyze || checksum;
+
+    worker_pool_t pool(encode_threads);
+    const size_t window_size = 2 * pool.size();
+
+    auto submit = [&]() {
+        while (submit_region < pending.size() && submit_batch == batches(submit_region))
+        {
+            submit_region++;
+            submit_batch = 0;
+        }
+        if (submit_region == pending.size())
+            return;
+
+        const splitWAV &region = split_wavs[pending[submit_region]];
+        std::shared_ptr<batch_t> batch = std::make_shared<batch_t>();
+        batch->frame = region.byte_offset + submit_batch * batch_frames;
+        batch->frames = std::min(batch_frames, region.byte_offset + region.byte_length - batch->frame);
+        batch->first_block = submit_batch * (batch_frames / FLAC_encoder_t::block_size);
+        submit_batch++;
+        window.push_back(batch);
+
+        pool.submit([&, batch](unsigned) {
+            try
+            {
+                TRACE_SPAN("encode");
+                byte_vector_t pcm(static_cast<size_t>(batch->frames) * format.block_align, 0, memory_subsystem_t::split);
+                byte_vector_t scratch(memory_subsystem_t::split);
+                read_frames(batch->frame, batch->frames, pcm.data(), scratch);
+                encoder.encode(pcm.data(), batch->frames, batch->first_block, batch->encoded);
+                if (keep_pcm)
+                    batch->pcm.swap(pcm);
+            }
+            catch (...)
+            {
+                batch->error = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            batch->done = true;
+            ready.notify_all();
+        });
+    };
+
+    while (window.size() < window_size && submit_region < pending.size())
+        submit();
+
+    for (size_t k = 0; k < pending.size(); k++)
+    {
+        const splitWAV &region = split_wavs[pending[k]];
+        manifest_entry_t &entry = entries[pending[k]];
+        TRACE_SPAN("region", entry.name);
+
+        std::unique_ptr<stats_accumulator_t> stats;
+        if (analyze)
+            stats = std::make_unique<stats_accumulator_t>(format);
+        uint32_t data_crc{0};
+
+        // the stream header, then each batch as it is done
+        std::vector<uint8_t> header = encoder.stream_header(region.byte_length);
+        const std::vector<uint8_t> *current = &header;
+        std::shared_ptr<batch_t> batch;
+        size_t offset{0};
+        uint32_t remaining = batches(k);
+
+        auto read = [&](uint8_t *dst, size_t capacity) {
+            size_t n{0};
+            while (n < capacity)
+            {
+                if (offset == current->size())
+                {
+                    if (remaining == 0)
+                        break;
+
+                    batch = window.front();
+                    window.pop_front();
+                    remaining--;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        ready.wait(lock, [&]() { return batch->done; });
+                    }
+                    if (batch->error)
+                        std::rethrow_exception(batch->error);
+                    progress_t::split_read(static_cast<uint64_t>(batch->frames) * wav_header.block_align);
+
+                    if (stats)
+                        stats->process(batch->pcm.data(), batch->pcm.size());
+                    if (checksum)
+                        data_crc = crc32c(data_crc, batch->pcm.data(), batch->pcm.size());
+
+                    current = &batch->encoded;
+                    offset = 0;
+                    submit();
+                }
+
+                size_t count = std::min(capacity - n, current->size() - offset);
+                memcpy(dst + n, current->data() + offset, count);
+                n += count;
+                offset += count;
+            }
+            return n;
+        };
+
+        entry.bytes = output.write_stream(entry.name, read, checksum ? &entry.crc32c : nullptr);
+        progress_t::region_done();
+
+        if (stats)
+        {
+            entry.stats = stats->finish();
+            entry.has_stats = true;
+        }
+        if (checksum)
+        {
+            entry.data_crc32c = data_crc;
+            entry.has_checksum = true;
+        }
+    }
+}
+
+int WAVsplitter::verify(const std::string &manifest_file)
+{
+    split_manifest_t expected = split_manifest_t::read(manifest_file);
+    mixer = std::make_unique<channel_mixer_t>(wav_header, channel_map);
+    const WAV_t &wav = *source;
+    const RIFF_chunk_data_t *data = dynamic_cast<const RIFF_chunk_data_t *>(wav.get_riff().get_chunk_with_id("data"));
+
+    // visit the regions in file order so the source is read front to back
+    std::sort(expected.entries.begin(), expected.entries.end(), [](const manifest_entry_t &a, const manifest_entry_t &b) {
+        return a.frame_offset < b.frame_offset;
+    });
+
+    // the recorded checksums are of the samples as written, with the same channel map applied
+    const WAV_fmt_t &format = mixer->format();
+    uint32_t block_frames = std::max((1 << 20) / format.block_align, 1);
+    std::vector<uint8_t> block(static_cast<size_t>(block_frames) * format.block_align);
+    byte_vector_t scratch(memory_subsystem_t::split);
+
+    int mismatches{0};
+    for (auto &i : expected.entries)
+    {
+        if (!i.has_checksum)
+        {
+            printf("%s: NO CHECKSUM\n", i.name.c_str());
+            mismatches++;
+            continue;
+        }
+
+        uint64_t offset = static_cast<uint64_t>(i.frame_offset) * wav_header.block_align;
+        uint64_t length = static_cast<uint64_t>(i.frames) * wav_header.block_align;
+        if (offset + length > static_cast<uint64_t>(data->size()))
+        {
+            printf("%s: OUT OF RANGE\n", i.name.c_str());
+            mismatches++;
+            continue;
+        }
+
+        uint32_t crc{0};
+        for (uint32_t done = 0; done < i.frames;)
+        {
+            uint32_t n = std::min(block_frames, i.frames - done);
+            read_frames(i.frame_offset + done, n, block.data(), scratch);
+            crc = crc32c(crc, block.data(), static_cast<size_t>(n) * format.block_align);
+            done += n;
+        }
+
+        bool ok = crc == i.data_crc32c;
+        printf("%s: %s\n", i.name.c_str(), ok ? "OK" : "FAILED");
+        mismatches += ok ? 0 : 1;
+    }
+    return mismatches;
+}
@@ -0,0 +1,255 @@
+#include "WAVstats.h"
+#include "WAVpcm.h"
+
+#include <cmath>
+#include <limits>
+
+// frames converted per call to the conversion kernel
+static const uint32_t block_frames = 4096;
+
+// true peak is measured by 4x oversampling through a 48 tap polyphase interpolator
+static const int phases = 4;
+static const int taps = 12;
+static const int history = taps - 1;
+
+// windowed sinc interpolation filter, split by phase
+struct interpolation_taps_t
+{
+    float h[phases][taps];
+
+    interpolation_taps_t()
+    {
+        const int length = phases * taps;
+        for (int n = 0; n < length; n++)
+        {
+            double t = (n - (length - 1) / 2.0) / phases;
+            double sinc = t == 0 ? 1.0 : std::sin(M_PI * t) / (M_PI * t);
+            double window = 0.5 - 0.5 * std::cos(2 * M_PI * (n + 0.5) / length);
+            h[n % phases][n / phases] = static_cast<float>(sinc * window);
+        }
+    }
+};
+
+static const interpolation_taps_t &interpolation_taps()
+{
+    static const interpolation_taps_t t;
+    return t;
+}
+
+static double to_db(double power)
+{
+    return power > 0 ? 10 * std::log10(power) : -std::numeric_limits<double>::infinity();
+}
+
+stats_accumulator_t::stats_accumulator_t(const WAV_fmt_t &fmt) : m_fmt(fmt)
+{
+    int container = pcm_container_size(fmt);
+    m_channels = fmt.num_channels;
+
+    // integer formats clip at the largest positive code
+    if (!pcm_is_float(fmt))
+        m_clip_level = 1.0f - 1.0f / static_cast<float>(1u << (container * 8 - 1));
+
+    m_buffer.resize(static_cast<size_t>(block_frames) * m_channels);
+    m_channel.resize(history + block_frames * 2);
+    m_history.assign(static_cast<size_t>(history) * m_channels, 0.0f);
+    m_sums.assign(m_channels, 0.0);
+    m_biquad.assign(static_cast<size_t>(m_channels) * 4, 0.0);
+    m_block_sums.assign(m_channels, 0.0);
+
+    // 5.1 layouts skip the LFE channel and weight the surrounds, everything else is weighted equally
+    m_weights.assign(m_channels, 1.0);
+    if (m_channels == 6)
+    {
+        m_weights[3] = 0.0;
+        m_weights[4] = 1.41;
+        m_weights[5] = 1.41;
+    }
+
+    // ITU-R BS.1770 K-weighting, coefficients derived for the file's sample rate
+    double rate = fmt.sample_rate;
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = std::tan(M_PI * f0 / rate);
+    double vh = std::pow(10.0, gain / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    m_shelf_b[0] = (vh + vb * k / q + k * k) / a0;
+    m_shelf_b[1] = 2.0 * (k * k - vh) / a0;
+    m_shelf_b[2] = (vh - vb * k / q + k * k) / a0;
+    m_shelf_a[0] = 1.0;
+    m_shelf_a[1] = 2.0 * (k * k - 1.0) / a0;
+    m_shelf_a[2] = (1.0 - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = std::tan(M_PI * f0 / rate);
+    a0 = 1.0 + k / q + k * k;
+    m_highpass_b[0] = 1.0;
+    m_highpass_b[1] = -2.0;
+    m_highpass_b[2] = 1.0;
+    m_highpass_a[0] = 1.0;
+    m_highpass_a[1] = 2.0 * (k * k - 1.0) / a0;
+    m_highpass_a[2] = (1.0 - k / q + k * k) / a0;
+
+    m_subblock_frames = fmt.sample_rate / 10 > 0 ? fmt.sample_rate / 10 : 1;
+}
+
+void stats_accumulator_t::process_channel(int channel, uint32_t frames)
+{
+    float *x = m_channel.data();
+    float *y = x + history + block_frames;
+
+    // deinterleave behind the previous block's last samples
+    for (int i = 0; i < history; i++)
+        x[i] = m_history[channel * history + i];
+    for (uint32_t i = 0; i < frames; i++)
+        x[history + i] = m_buffer[static_cast<size_t>(i) * m_channels + channel];
+
+    double dc{0};
+    for (uint32_t i = 0; i < frames; i++)
+        dc += x[history + i];
+    m_sums[channel] += dc;
+
+    // oversampled peak, one phase at a time so the inner loop runs over contiguous samples
+    const float (&h)[phases][taps] = interpolation_taps().h;
+    for (int p = 0; p < phases; p++)
+    {
+        for (uint32_t i = 0; i < frames; i++)
+            y[i] = 0.0f;
+
+        for (int k = 0; k < taps; k++)
+        {
+            const float c = h[p][k];
+            const float *src = x + history - k;
+            for (uint32_t i = 0; i < frames; i++)
+                y[i] += c * src[i];
+        }
+
+        double unused{0};
+        pcm_accumulate(y, frames, unused, m_true_peak);
+    }
+
+    for (int i = 0; i < history; i++)
+        m_history[channel * history + i] = x[frames + i];
+
+    // K-weighted energy for loudness, transposed direct form II
+    double *s = &m_biquad[channel * 4];
+    double sum{0};
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        double in = x[history + i];
+        double shelf = m_shelf_b[0] * in + s[0];
+        s[0] = m_shelf_b[1] * in - m_shelf_a[1] * shelf + s[1];
+        s[1] = m_shelf_b[2] * in - m_shelf_a[2] * shelf;
+
+        double out = m_highpass_b[0] * shelf + s[2];
+        s[2] = m_highpass_b[1] * shelf - m_highpass_a[1] * out + s[3];
+        s[3] = m_highpass_b[2] * shelf - m_highpass_a[2] * out;
+
+        sum += out * out;
+    }
+    m_block_sums[channel] += sum;
+}
+
+void stats_accumulator_t::process(const uint8_t *bytes, size_t length)
+{
+    size_t frames = length / m_fmt.block_align;
+
+    while (frames > 0)
+    {
+        // never cross a loudness sub-block boundary within one block
+        uint32_t n = frames < block_frames ? frames : block_frames;
+        if (n > m_subblock_frames - m_subblock_fill)
+            n = m_subblock_frames - m_subblock_fill;
+
+        size_t samples = static_cast<size_t>(n) * m_channels;
+        pcm_to_float(bytes, samples, m_fmt, m_buffer.data());
+        pcm_accumulate(m_buffer.data(), samples, m_sum_squares, m_peak);
+
+        uint64_t clipped{0};
+        for (size_t i = 0; i < samples; i++)
+        {
+            float v = m_buffer[i];
+            clipped += (v >= m_clip_level) | (v <= -m_clip_level);
+        }
+        m_clipped += clipped;
+
+        for (int c = 0; c < m_channels; c++)
+            process_channel(c, n);
+
+        m_subblock_fill += n;
+        if (m_subblock_fill == m_subblock_frames)
+        {
+            double energy{0};
+            for (int c = 0; c < m_channels; c++)
+            {
+                energy += m_weights[c] * m_block_sums[c] / m_subblock_frames;
+                m_block_sums[c] = 0;
+            }
+            m_subblocks.push_back(energy);
+            m_subblock_fill = 0;
+        }
+
+        m_frames += n;
+        bytes += static_cast<size_t>(n) * m_fmt.block_align;
+        frames -= n;
+    }
+}
+
+split_stats_t stats_accumulator_t::finish()
+{
+    split_stats_t stats;
+
+    float true_peak = m_true_peak > m_peak ? m_true_peak : m_peak;
+    stats.peak_db = to_db(static_cast<double>(m_peak) * m_peak);
+    stats.true_peak_db = to_db(static_cast<double>(true_peak) * true_peak);
+    stats.rms_db = m_frames ? to_db(m_sum_squares / (static_cast<double>(m_frames) * m_channels)) : to_db(0);
+    stats.clipped_samples = m_clipped;
+
+    stats.dc_offset = 0;
+    for (int c = 0; c < m_channels && m_frames; c++)
+    {
+        double dc = m_sums[c] / m_frames;
+        if (std::fabs(dc) > std::fabs(stats.dc_offset))
+            stats.dc_offset = dc;
+    }
+
+    // 400ms blocks overlapping by 75%, gated at -70 LUFS and then 10 LU below the ungated mean
+    std::vector<double> blocks;
+    for (size_t j = 0; j + 4 <= m_subblocks.size(); j++)
+        blocks.push_back((m_subblocks[j] + m_subblocks[j + 1] + m_subblocks[j + 2] + m_subblocks[j + 3]) / 4);
+
+    const double absolute_gate = std::pow(10.0, (-70.0 + 0.691) / 10.0);
+    double sum{0};
+    size_t count{0};
+    for (double b : blocks)
+    {
+        if (b > absolute_gate)
+        {
+            sum += b;
+            count++;
+        }
+    }
+
+    stats.loudness_lufs = to_db(0);
+    if (count > 0)
+    {
+        double relative_gate = sum / count * std::pow(10.0, -10.0 / 10.0);
+        sum = 0;
+        count = 0;
+        for (double b : blocks)
+        {
+            if (b > absolute_gate && b > relative_gate)
+            {
+                sum += b;
+                count++;
+            }
+        }
+        if (count > 0)
+            stats.loudness_lufs = -0.691 + to_db(sum / count);
+    }
+
+    return stats;
+}
@@ -0,0 +1,141 @@
+#include "WAVtrace.h"
+#include "WAVmanifest.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+std::atomic<bool> trace_t::s_enabled{false};
+
+struct trace_event_t
+{
+    const char *name;
+    std::string detail;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// spans of one thread, only that thread appends so the lock is never contended while tracing
+struct trace_thread_t
+{
+    long tid;
+    std::string name;
+    std::mutex mutex;
+    std::vector<trace_event_t> events;
+};
+
+// buffers outlive their threads, a worker pool may be gone before the trace is written
+static std::mutex threads_mutex;
+static std::vector<std::unique_ptr<trace_thread_t>> threads;
+
+static trace_thread_t &this_thread()
+{
+    thread_local trace_thread_t *thread{nullptr};
+    if (!thread)
+    {
+        std::unique_ptr<trace_thread_t> t = std::make_unique<trace_thread_t>();
+        t->tid = syscall(SYS_gettid);
+        thread = t.get();
+
+        std::lock_guard<std::mutex> lock(threads_mutex);
+        threads.push_back(std::move(t));
+    }
+    return *thread;
+}
+
+void trace_t::enable()
+{
+    now();
+    s_enabled = true;
+    name_thread("main");
+}
+
+uint64_t trace_t::now()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void trace_t::name_thread(const std::string &name)
+{
+    if (!enabled())
+        return;
+
+    trace_thread_t &thread = this_thread();
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    thread.name = name;
+}
+
+void trace_t::record(const char *name, const std::string &detail, uint64_t begin, uint64_t end)
+{
+    trace_thread_t &thread = this_thread();
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    thread.events.push_back({name, detail, begin, end});
+}
+
+void trace_t::write(const std::string &filename)
+{
+    FILE *f = fopen(filename.c_str(), "w");
+    if (!f)
+        throw std::runtime_error("Unable to open trace file for writing: " + filename);
+
+    // complete ("X") events with timestamps in microseconds, one per line
+    long pid = getpid();
+    const char *separator = "";
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    std::lock_guard<std::mutex> threads_lock(threads_mutex);
+    for (auto &t : threads)
+    {
+        std::lock_guard<std::mutex> lock(t->mutex);
+        if (!t->name.empty())
+        {
+            fprintf(f, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": %ld, \"tid\": %ld, \"args\": {\"name\": %s}}",
+                    separator, pid, t->tid, json_string(t->name).c_str());
+            separator = ",\n";
+        }
+
+        for (auto &e : t->events)
+        {
+            fprintf(f, "%s{\"ph\": \"X\", \"cat\": \"wavsplit\", \"name\": %s, \"pid\": %ld, \"tid\": %ld, \"ts\": %.3f, \"dur\": %.3f",
+                    separator, json_string(e.name).c_str(), pid, t->tid, e.begin / 1e3, (e.end - e.begin) / 1e3);
+            if (!e.detail.empty())
+                fprintf(f, ", \"args\": {\"detail\": %s}", json_string(e.detail).c_str());
+            fprintf(f, "}");
+            separator = ",\n";
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0)
+        throw std::runtime_error("Unable to write trace file: " + filename);
+}
+
+// ====================================================================================================================
+trace_session_t::trace_session_t(const std::string &filename) : m_filename(filename)
+{
+    if (!m_filename.empty())
+        trace_t::enable();
+}
+
+trace_session_t::~trace_session_t()
+{
+    if (m_filename.empty())
+        return;
+
+    // a destructor must not throw, a trace that can't be written is reported and dropped
+    try
+    {
+        trace_t::write(m_filename);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,251 @@
+#include "WAVwatch.h"
+#include "WAVtrace.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stop_requested = 0;
+
+// the throughput in the status file is measured over this many seconds
+static const double rate_window = 10;
+
+static void request_stop(int)
+{
+    stop_requested = 1;
+}
+
+// writers are expected to use hidden names for files in progress, only finished *.wav files are split
+static bool is_candidate(const std::string &name)
+{
+    if (name.empty() || name[0] == '.' || name.size() < 5)
+        return false;
+
+    std::string extension = name.substr(name.size() - 4);
+    for (auto &c : extension)
+        c = tolower(c);
+    return extension == ".wav";
+}
+
+static void make_directory(const std::string &path)
+{
+    if (mkdir(path.c_str(), 0777) != 0 && errno != EEXIST)
+        throw std::runtime_error("Unable to create directory: " + path);
+}
+
+WAV_watcher_t::WAV_watcher_t(const std::string &directory, const std::string &output_root, unsigned workers,
+                             const std::function<void(WAVsplitter &)> &configure)
+    : m_directory(directory), m_output_root(output_root), m_start(std::chrono::steady_clock::now()), m_pool(workers)
+{
+    if (m_directory.empty() || *m_directory.rbegin() != '/')
+        m_directory.append("/");
+    if (m_output_root.empty())
+        m_output_root = "./";
+    if (*m_output_root.rbegin() != '/')
+        m_output_root.append("/");
+
+    struct stat st;
+    if (stat(m_directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        throw std::runtime_error("Not a directory: " + directory);
+
+    make_directory(m_directory + "done");
+    make_directory(m_directory + "failed");
+
+    m_splitters.resize(m_pool.size());
+    for (auto &i : m_splitters)
+    {
+        i = std::make_unique<WAVsplitter>();
+        configure(*i);
+    }
+
+    m_rate_samples.push_back({0, 0, 0});
+}
+
+watch_status_t WAV_watcher_t::status() const
+{
+    watch_status_t s;
+    s.queued = m_pool.queued();
+    s.active = m_pool.active();
+    s.done = m_done;
+    s.failed = m_failed;
+    s.bytes = m_bytes;
+    s.uptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    return s;
+}
+
+void WAV_watcher_t::enqueue(const std::string &name)
+{
+    if (!is_candidate(name))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_pending.insert(name).second)
+            return;
+    }
+
+    m_pool.submit([this, name](unsigned worker) { process(worker, name); });
+}
+
+void WAV_watcher_t::process(unsigned worker, const std::string &name)
+{
+    TRACE_SPAN("file", name);
+
+    std::string path = m_directory + name;
+    auto started = std::chrono::steady_clock::now();
+
+    // a file gets several events when it is written and renamed in, a late one may come after it was moved
+    struct stat st;
+    bool exists = stat(path.c_str(), &st) == 0;
+    if (!exists && errno == ENOENT)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.erase(name);
+        return;
+    }
+    uint64_t size = exists ? st.st_size : 0;
+
+    // the worker's splitter is reused, its buffers stay allocated from the previous file
+    WAVsplitter &split = *m_splitters[worker];
+    std::string error;
+    try
+    {
+        split.open(path);
+
+        split.set_output_directory(m_output_root + name.substr(0, name.find('.')) + "/");
+
+        split.split();
+    }
+    catch (const std::exception &e)
+    {
+        error = e.what();
+    }
+
+    std::string destination = m_directory + (error.empty() ? "done/" : "failed/") + name;
+    if (rename(path.c_str(), destination.c_str()) != 0 && error.empty())
+        error = "unable to move to done/";
+
+    if (error.empty())
+    {
+        m_done++;
+        m_bytes += size;
+    }
+    else
+    {
+        m_failed++;
+
+        // keep the reason next to the file for whoever looks at failed/
+        FILE *f = fopen((m_directory + "failed/" + name + ".error").c_str(), "w");
+        if (f)
+        {
+            fprintf(f, "%s\n", error.c_str());
+            fclose(f);
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.erase(name);
+    if (error.empty())
+        fprintf(stderr, "done: %s (%.1f MB in %.2f s)\n", name.c_str(), size / 1e6, seconds);
+    else
+        fprintf(stderr, "failed: %s: %s\n", name.c_str(), error.c_str());
+}
+
+void WAV_watcher_t::write_status()
+{
+    watch_status_t s = status();
+
+    // the rate is measured from the newest sample that is at least rate_window old, so it follows the current load
+    uint64_t files = s.done + s.failed;
+    m_rate_samples.push_back({s.uptime, files, s.bytes});
+    while (m_rate_samples.size() > 2 && s.uptime - m_rate_samples[1].time >= rate_window)
+        m_rate_samples.pop_front();
+
+    const rate_sample_t &from = m_rate_samples.front();
+    double rate = s.uptime > from.time ? 1 / (s.uptime - from.time) : 0;
+
+    std::string path = m_directory + ".wavsplit-status.json";
+    std::string temporary = path + ".tmp";
+    FILE *f = fopen(temporary.c_str(), "w");
+    if (!f)
+        return;
+
+    fprintf(f,
+            "{\"queued\": %zu, \"active\": %zu, \"done\": %llu, \"failed\": %llu, \"bytes\": %llu, "
+            "\"uptime\": %.1f, \"files_per_second\": %.3f, \"megabytes_per_second\": %.3f}\n",
+            s.queued, s.active, static_cast<unsigned long long>(s.done), static_cast<unsigned long long>(s.failed),
+            static_cast<unsigned long long>(s.bytes), s.uptime, (files - from.files) * rate,
+            (s.bytes - from.bytes) / 1e6 * rate);
+
+    if (fclose(f) != 0 || rename(temporary.c_str(), path.c_str()) != 0)
+        remove(temporary.c_str());
+}
+
+void WAV_watcher_t::run()
+{
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("Unable to initialize inotify.");
+
+    // watch before scanning, a file arriving in between is seen twice and queued once
+    if (inotify_add_watch(fd, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        close(fd);
+        throw std::runtime_error("Unable to watch directory: " + m_directory);
+    }
+
+    if (DIR *d = opendir(m_directory.c_str()))
+    {
+        while (dirent *e = readdir(d))
+        {
+            if (e->d_type == DT_REG || e->d_type == DT_UNKNOWN)
+                enqueue(e->d_name);
+        }
+        closedir(d);
+    }
+
+    stop_requested = 0;
+    struct sigaction action {};
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::cerr << "watching " << m_directory << " with " << m_pool.size() << " workers" << std::endl;
+
+    alignas(inotify_event) char buffer[1 << 14];
+    while (!stop_requested)
+    {
+        pollfd p{fd, POLLIN, 0};
+        if (poll(&p, 1, 1000) > 0)
+        {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            for (ssize_t i = 0; i < n;)
+            {
+                inotify_event *e = reinterpret_cast<inotify_event *>(buffer + i);
+                if (e->len > 0 && !(e->mask & IN_ISDIR))
+                    enqueue(e->name);
+                i += sizeof(inotify_event) + e->len;
+            }
+        }
+
+        write_status();
+    }
+
+    close(fd);
+
+    size_t dropped = m_pool.cancel();
+    write_status();
+
+    watch_status_t s = status();
+    std::cerr << "stopped: " << s.done << " done, " << s.failed << " failed, " << dropped << " left queued" << std::endl;
+}
@@ -0,0 +1,99 @@
+#include "WorkerPool.h"
+#include "WAVtrace.h"
+
+worker_pool_t::worker_pool_t(unsigned threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    m_threads.reserve(threads);
+    for (unsigned i = 0; i < threads; i++)
+        m_threads.emplace_back(&worker_pool_t::run, this, i);
+}
+
+worker_pool_t::~worker_pool_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.clear();
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (auto &i : m_threads)
+        i.join();
+}
+
+void worker_pool_t::run(unsigned worker)
+{
+    trace_t::name_thread("worker " + std::to_string(worker));
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+        if (m_jobs.empty())
+            return;
+
+        job_t job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_active++;
+
+        lock.unlock();
+        try
+        {
+            job(worker);
+        }
+        catch (...)
+        {
+        }
+        lock.lock();
+
+        m_active--;
+        if (m_active == 0 && m_jobs.empty())
+            m_idle.notify_all();
+    }
+}
+
+unsigned worker_pool_t::size() const
+{
+    return m_threads.size();
+}
+
+void worker_pool_t::submit(job_t job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_wake.notify_one();
+}
+
+size_t worker_pool_t::queued() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jobs.size();
+}
+
+size_t worker_pool_t::active() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_active;
+}
+
+void worker_pool_t::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_active == 0 && m_jobs.empty(); });
+}
+
+size_t worker_pool_t::cancel()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    size_t dropped = m_jobs.size();
+    m_jobs.clear();
+    m_idle.wait(lock, [this] { return m_active == 0; });
+    return dropped;
+}
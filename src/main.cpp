@@ -1,15 +1,520 @@
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <malloc.h>
+#include <mutex>
 
 #include "./WAVsplit.h"
+#include "./WAVwatch.h"
+#include "./WAVscheduler.h"
+#include "./WAVtrace.h"
+#include "./WAVmemory.h"
+#include "./WAVprogress.h"
+#include "./WAVinspect.h"
+#include "./WAVfsck.h"
+
+static int usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [options] [input_file.wav... | -]\n"
+              << "       " << name << " fsck [-j N] [--files-from LIST|-] [file.wav...]\n"
+              << "       " << name << " inspect [--tree] [--decode] [--chunk ID|N [--offset N] [--length N]] file.wav\n"
+              << "  -o DIR                    output directory\n"
+              << "  -t FILE                   write all splits into one tar archive (- for stdout)\n"
+              << "  --shard hash|number[:N]   spread splits over subdirectories: N by name hash, or N splits each in order\n"
+              << "  -s                        split on silence when the file has no cue points\n"
+              << "  --silence-threshold DB    RMS level below which audio counts as silence (default -50)\n"
+              << "  --silence-duration SEC    shortest gap that separates two regions (default 0.5)\n"
+              << "  --analyze                 measure peak, true peak, RMS, loudness, DC offset and clipping per split\n"
+              << "  --manifest json|csv       write a manifest of the splits next to them (default json with --analyze)\n"
+              << "  --checksum                record a CRC-32C of every split and its source region in the manifest\n"
+              << "  --index                   cache parsed headers in file.wav.wsidx and reuse them while still current\n"
+              << "  --incremental             only write splits that are missing or changed, replacing files atomically\n"
+              << "  --incremental-hash        like --incremental, also compare the contents of existing splits\n"
+              << "  --range START:END         write only frames START to END (or START-END), in samples or [[HH:]MM:]SS[.fff]\n"
+              << "  --watch DIR               split every WAV written or moved into DIR until interrupted\n"
+              << "  -j N                      number of files split at once with --watch or several inputs (default one per CPU)\n"
+              << "  --max-memory SIZE         keep peak memory of several inputs under SIZE (K, M or G suffix), streaming when tight\n"
+              << "  --channels LIST           write only these input channels, in this order (1 based, \"3,4\")\n"
+              << "  --mix mono|MATRIX         mix the channels: to their average, or one row of gains per output (\"1,0.5;0,0.5\")\n"
+              << "  --flac                    write splits as FLAC, encoded on -j N threads (default one per core)\n"
+              << "  --stream                  write splits block by block on one thread instead of pipelining read, analysis and write\n"
+              << "  --trace FILE              record a timeline of the run as Chrome trace-event JSON (chrome://tracing, Perfetto)\n"
+              << "  --stats                   print allocations and peak memory per subsystem to stderr when done\n"
+              << "  --progress                show bytes and splits done, MB/s and time left on stderr while running\n"
+              << "  --progress-fd N           write the progress as a JSON object per line to descriptor N instead, once a second\n"
+              << "  --plan FILE               write the names, source offsets and formats of the splits as JSON (- for stdout)\n"
+              << "  --part K/N                only write part K of N, consecutive splits with about the same size in each\n"
+              << "  --plan-in FILE            only write the splits listed in a plan (made with the same options)\n"
+              << "  --verify MANIFEST         check the source regions against a manifest's checksums instead of splitting"
+              << std::endl;
+    return 1;
+}
+
+// a bad option value, reported with the usage text instead of ending the process with an uncaught exception
+static int option_error(const std::exception &e, const char *name)
+{
+    std::cerr << e.what() << std::endl;
+    return usage(name);
+}
+
+// an input that can't be read or split, reported like the scheduler reports one of several inputs
+static int input_error(const std::exception &e, const std::string &input)
+{
+    std::cerr << input << ": " << e.what() << std::endl;
+    return 1;
+}
+
+// an option that wasn't recognized, or one missing its value, a lone "-" is stdin
+static bool is_option(const char *arg)
+{
+    return arg[0] == '-' && arg[1] != 0;
+}
+
+// a position in sample frames, or a timecode ([[HH:]MM:]SS[.fff]) if it contains ':' or '.'
+static uint32_t parse_position(const std::string &position, uint32_t sample_rate)
+{
+    if (position.find_first_of(":.") == std::string::npos)
+        return strtoul(position.c_str(), nullptr, 10);
+
+    double seconds{0};
+    for (size_t start = 0;;)
+    {
+        size_t colon = position.find(':', start);
+        seconds = seconds * 60 + atof(position.substr(start, colon - start).c_str());
+        if (colon == std::string::npos)
+            break;
+        start = colon + 1;
+    }
+    return llround(seconds * sample_rate);
+}
+
+// a byte count with an optional K, M or G suffix
+static uint64_t parse_size(const std::string &size)
+{
+    char *end;
+    double value = strtod(size.c_str(), &end);
+    switch (toupper(*end))
+    {
+    case 'G':
+        value *= 1024;
+        [[fallthrough]];
+    case 'M':
+        value *= 1024;
+        [[fallthrough]];
+    case 'K':
+        value *= 1024;
+    }
+    return value;
+}
+
+// wavsplit inspect: chunk tree, decoded headers, or a hexdump of part of one chunk
+static int inspect(int argc, char *argv[], const char *name)
+{
+    std::string input;
+    std::string chunk;
+    uint64_t offset{0};
+    uint64_t length{UINT64_MAX};
+    bool tree{false};
+    bool decode{false};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--tree") == 0)
+            tree = true;
+        else if (strcmp(argv[i], "--decode") == 0)
+            decode = true;
+        else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc)
+            chunk = argv[++i];
+        else if (strcmp(argv[i], "--offset") == 0 && i + 1 < argc)
+            offset = parse_size(argv[++i]);
+        else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc)
+            length = parse_size(argv[++i]);
+        else if (input.empty() && !is_option(argv[i]))
+            input = argv[i];
+        else
+            return usage(name);
+    }
+
+    if (input.empty() || input == "-")
+        return usage(name);
+
+    // the tree and the decoded headers unless something else was asked for
+    if (chunk.empty() && !tree && !decode)
+        tree = decode = true;
+
+    WAV_inspector_t inspector(input);
+    if (tree)
+        inspector.print_tree();
+    if (decode)
+        inspector.print_decoded();
+    if (!chunk.empty())
+        inspector.hexdump(inspector.find(chunk), offset, length);
+    return 0;
+}
+
+// wavsplit fsck: structural check of many files in parallel, diagnostics as JSON lines on stdout
+static int fsck(int argc, char *argv[], const char *name)
+{
+    std::vector<std::string> inputs;
+    std::string files_from;
+    unsigned workers{0};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--files-from") == 0 && i + 1 < argc)
+            files_from = argv[++i];
+        else if (is_option(argv[i]))
+            return usage(name);
+        else
+            inputs.push_back(argv[i]);
+    }
+
+    if (inputs.empty() && files_from.empty())
+        return usage(name);
+
+    std::mutex output;
+    std::atomic<size_t> failed{0};
+    worker_pool_t pool(workers);
+    auto check = [&](const std::string &filename) {
+        pool.submit([&, filename](unsigned) {
+            fsck_result_t result = WAV_fsck_t::check(filename);
+            if (result.count(fsck_diagnostic_t::error))
+                failed++;
+
+            // a file's lines stay together
+            std::string lines = result.to_json();
+            std::lock_guard<std::mutex> lock(output);
+            fwrite(lines.data(), 1, lines.size(), stdout);
+        });
+    };
+
+    for (auto &i : inputs)
+        check(i);
+
+    // one name per line, for more files than fit on a command line
+    if (!files_from.empty())
+    {
+        std::ifstream list;
+        if (files_from != "-")
+            list.open(files_from);
+        std::istream &in = files_from == "-" ? std::cin : list;
+        if (!in)
+        {
+            std::cerr << "Unable to open " << files_from << std::endl;
+            return 1;
+        }
+
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (!line.empty())
+                check(line);
+        }
+    }
+
+    pool.wait();
+    fflush(stdout);
+    return failed == 0 ? 0 : 1;
+}
+
+// the watcher's and scheduler's workers each get a splitter with the options given on the command line
+static void copy_options(const WAVsplitter &from, WAVsplitter &to)
+{
+    to.set_prefix(from.get_prefix());
+    to.set_suffix(from.get_suffix());
+    to.set_auto_split(from.get_auto_split());
+    to.set_silence_options(from.get_silence_options());
+    to.set_analyze(from.get_analyze());
+    to.set_manifest_format(from.get_manifest_format());
+    to.set_checksum(from.get_checksum());
+    to.set_use_index(from.get_use_index());
+    to.set_incremental(from.get_incremental(), from.get_incremental_hash());
+    to.set_max_buffered(from.get_max_buffered());
+    to.set_streaming(from.get_streaming());
+    to.set_shard(from.get_shard());
+    to.set_flac(from.get_flac(), from.get_encode_threads());
+    to.set_channel_map(from.get_channel_map());
+}
 
 int main(int argc, char *argv[])
 {
-    if(argc < 2)
+    if (argc > 1 && strcmp(argv[1], "inspect") == 0)
+        return inspect(argc - 1, argv + 1, argv[0]);
+    if (argc > 1 && strcmp(argv[1], "fsck") == 0)
+        return fsck(argc - 1, argv + 1, argv[0]);
+
+    std::vector<std::string> inputs;
+    std::string output_directory;
+    std::string verify;
+    std::string watch;
+    std::string range;
+    std::string trace;
+    std::string channels;
+    std::string mix;
+    std::string plan;
+    std::string plan_in;
+    unsigned part_index{0};
+    unsigned part_count{0};
+    bool stats{false};
+    int progress_fd{-1};
+    bool progress_json{false};
+    bool flac{false};
+    unsigned workers{0};
+    uint64_t max_memory{0};
+    WAVsplitter split;
+    silence_options_t silence;
+
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+                output_directory = argv[++i];
+            else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+                split.set_archive(argv[++i]);
+            else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc)
+                split.set_shard(shard_options_t::parse(argv[++i]));
+            else if (strcmp(argv[i], "-s") == 0)
+                split.set_auto_split(true);
+            else if (strcmp(argv[i], "--silence-threshold") == 0 && i + 1 < argc)
+                silence.threshold_db = atof(argv[++i]);
+            else if (strcmp(argv[i], "--silence-duration") == 0 && i + 1 < argc)
+                silence.min_silence = atof(argv[++i]);
+            else if (strcmp(argv[i], "--analyze") == 0)
+                split.set_analyze(true);
+            else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc)
+                split.set_manifest_format(split_manifest_t::parse_format(argv[++i]));
+            else if (strcmp(argv[i], "--checksum") == 0)
+                split.set_checksum(true);
+            else if (strcmp(argv[i], "--index") == 0)
+                split.set_use_index(true);
+            else if (strcmp(argv[i], "--incremental") == 0)
+                split.set_incremental(true);
+            else if (strcmp(argv[i], "--incremental-hash") == 0)
+                split.set_incremental(true, true);
+            else if (strcmp(argv[i], "--range") == 0 && i + 1 < argc)
+                range = argv[++i];
+            else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc)
+                watch = argv[++i];
+            else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+                workers = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc)
+                max_memory = parse_size(argv[++i]);
+            else if (strcmp(argv[i], "--stream") == 0)
+                split.set_streaming(true);
+            else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc)
+                channels = argv[++i];
+            else if (strcmp(argv[i], "--mix") == 0 && i + 1 < argc)
+                mix = argv[++i];
+            else if (strcmp(argv[i], "--flac") == 0)
+                flac = true;
+            else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+                trace = argv[++i];
+            else if (strcmp(argv[i], "--stats") == 0)
+                stats = true;
+            else if (strcmp(argv[i], "--progress") == 0)
+                progress_fd = 2;
+            else if (strcmp(argv[i], "--progress-fd") == 0 && i + 1 < argc)
+            {
+                char *end;
+                progress_fd = strtol(argv[++i], &end, 10);
+                progress_json = true;
+                if (!*argv[i] || *end || progress_fd < 0)
+                    return usage(argv[0]);
+            }
+            else if (strcmp(argv[i], "--verify") == 0 && i + 1 < argc)
+                verify = argv[++i];
+            else if (strcmp(argv[i], "--plan") == 0 && i + 1 < argc)
+                plan = argv[++i];
+            else if (strcmp(argv[i], "--plan-in") == 0 && i + 1 < argc)
+                plan_in = argv[++i];
+            else if (strcmp(argv[i], "--part") == 0 && i + 1 < argc)
+            {
+                if (sscanf(argv[++i], "%u/%u", &part_index, &part_count) != 2 || part_index < 1 || part_index > part_count)
+                    return usage(argv[0]);
+            }
+            else if (is_option(argv[i]))
+                return usage(argv[0]);
+            else
+                inputs.push_back(argv[i]);
+        }
+
+        split.set_silence_options(silence);
+        split.set_channel_map(channel_map_t::parse(channels, mix));
+    }
+    catch (const std::logic_error &e)
     {
-        std::cerr << "Usage: " << argv[0] << " [input_file.wav]" << std::endl;
+        return option_error(e, argv[0]);
+    }
+    catch (const std::runtime_error &e)
+    {
+        return option_error(e, argv[0]);
+    }
+
+    // -j spreads several inputs over workers, a single input is spread over encoder threads instead
+    split.set_flac(flac, inputs.size() == 1 && watch.empty() ? workers : 1);
+
+#ifndef WAVSPLIT_TRACE
+    if (!trace.empty())
+    {
+        std::cerr << "--trace: built without tracing (TRACE=0)" << std::endl;
         return 1;
     }
-    WAVsplitter split(argv[1]);
-    split.split();
+#endif
+
+    // written when main returns, after the workers are done
+    trace_session_t trace_session(trace);
+    memory_stats_session_t stats_session(stats);
+    progress_session_t progress_session(progress_fd, progress_json);
+
+    // plans and parts are made for a single input, and a plan already says which regions to write
+    bool planned = !plan.empty() || !plan_in.empty() || part_count > 0;
+    if (part_count > 0 && !plan_in.empty())
+        return usage(argv[0]);
+
+    if (!watch.empty())
+    {
+        // one archive can't take the splits of many files
+        if (!inputs.empty() || !split.get_archive().empty() || planned)
+            return usage(argv[0]);
+
+        WAV_watcher_t watcher(watch, output_directory, workers, [&split](WAVsplitter &s) { copy_options(split, s); });
+        watcher.run();
+        return 0;
+    }
+
+    if (inputs.size() > 1 || max_memory > 0)
+    {
+        // files are split independently, modes bound to a single input don't apply
+        if (inputs.empty() || !split.get_archive().empty() || !verify.empty() || !range.empty() || planned ||
+            std::find(inputs.begin(), inputs.end(), "-") != inputs.end())
+            return usage(argv[0]);
+
+        // glibc raises the mmap threshold as large blocks are freed, after which freed regions stay in the heap
+        // and count towards RSS; a fixed threshold hands them back to the system straight away
+        if (max_memory)
+            mallopt(M_MMAP_THRESHOLD, 1 << 20);
+
+        split_scheduler_t scheduler(max_memory ? max_memory : UINT64_MAX, workers, output_directory,
+                                    [&split](WAVsplitter &s) { copy_options(split, s); });
+        for (auto &i : inputs)
+            scheduler.add(i);
+        int failed = scheduler.wait();
+
+        // jobs are admitted by their estimated footprint, a run that went over the limit anyway fails
+        uint64_t peak = peak_rss();
+        bool over = max_memory && peak > max_memory;
+        std::cerr << "peak RSS: " << peak / (1 << 20) << " MiB";
+        if (max_memory)
+            std::cerr << " of " << max_memory / (1 << 20) << " MiB";
+        if (over)
+            std::cerr << ", over the limit";
+        std::cerr << std::endl;
+        return failed == 0 && !over ? 0 : 1;
+    }
+
+    if (inputs.size() != 1)
+        return usage(argv[0]);
+    const std::string &input = inputs.front();
+
+    // nothing but the regions is read when verifying or extracting a range, and nothing at all for a plan,
+    // keep the rest on disk
+    if (!verify.empty() || !range.empty() || !plan.empty())
+        split.set_max_buffered(0);
+
+    try
+    {
+        split.open(input);
+    }
+    catch (const std::logic_error &e)
+    {
+        return input_error(e, input);
+    }
+    catch (const std::runtime_error &e)
+    {
+        return input_error(e, input);
+    }
+
+    try
+    {
+        // the channel map can only be checked against the input's channels
+        channel_mixer_t(split.get_source().header, split.get_channel_map());
+
+        if (!range.empty())
+        {
+            // timecodes contain ':' as well, the middle one separates start and end unless '-' is used
+            size_t separator = range.find('-');
+            if (separator == std::string::npos)
+            {
+                size_t colons = std::count(range.begin(), range.end(), ':');
+                if (colons % 2 == 0)
+                    return usage(argv[0]);
+
+                separator = -1;
+                for (size_t c = 0; c <= colons / 2; c++)
+                    separator = range.find(':', separator + 1);
+            }
+
+            const WAV_t &source = split.get_source();
+            std::string end = range.substr(separator + 1);
+            split.select_range(parse_position(range.substr(0, separator), source.header.sample_rate),
+                               end.empty() ? source.frames() : parse_position(end, source.header.sample_rate));
+        }
+
+        if (part_count > 0)
+            split.select_part(part_index, part_count);
+        if (!plan_in.empty())
+            split.select_plan(split_plan_t::read(plan_in));
+    }
+    catch (const std::logic_error &e)
+    {
+        return option_error(e, argv[0]);
+    }
+    catch (const std::runtime_error &e)
+    {
+        return option_error(e, argv[0]);
+    }
+
+    try
+    {
+        if (!verify.empty())
+            return split.verify(verify) == 0 ? 0 : 1;
+        if (!output_directory.empty())
+            split.set_output_directory(output_directory);
+
+        if (!plan.empty())
+        {
+            std::string json = split.get_plan().to_json();
+            if (plan == "-")
+            {
+                std::cout << json << std::flush;
+                return 0;
+            }
+
+            std::ofstream f(plan);
+            if (!f.is_open() || !(f << json))
+            {
+                std::cerr << "Unable to write " << plan << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        split.split();
+    }
+    catch (const std::logic_error &e)
+    {
+        return input_error(e, input);
+    }
+    catch (const std::runtime_error &e)
+    {
+        return input_error(e, input);
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,205 @@
+#include "wavsplit.h"
+#include "WAVsplit.h"
+
+#include <cstdlib>
+#include <new>
+#include <unistd.h>
+
+static thread_local std::string last_error;
+
+static void *default_allocate(void *, size_t size)
+{
+    return malloc(size);
+}
+
+static void default_release(void *, void *pointer, size_t)
+{
+    free(pointer);
+}
+
+static const wavsplit_allocator_t default_allocator{default_allocate, default_release, nullptr};
+
+// region data taken from the caller's allocator, grown as regions need it and reused for the next one
+class region_buffer_t
+{
+private:
+    const wavsplit_allocator_t &m_allocator;
+    uint8_t *m_data{nullptr};
+    size_t m_size{0};
+
+public:
+    region_buffer_t(const wavsplit_allocator_t &allocator) : m_allocator(allocator)
+    {
+    }
+
+    ~region_buffer_t()
+    {
+        if (m_data)
+            m_allocator.release(m_allocator.context, m_data, m_size);
+    }
+
+    uint8_t *reserve(size_t size)
+    {
+        if (size <= m_size && m_data)
+            return m_data;
+
+        if (m_data)
+            m_allocator.release(m_allocator.context, m_data, m_size);
+        m_size = 0;
+
+        m_data = static_cast<uint8_t *>(m_allocator.allocate(m_allocator.context, size ? size : 1));
+        if (!m_data)
+            throw std::bad_alloc();
+
+        m_size = size ? size : 1;
+        return m_data;
+    }
+};
+
+// split a file (or buffer) and pass every region to the callback
+static int split_file(std::shared_ptr<RIFF_file_t> file, const wavsplit_options_t *user_options,
+                      wavsplit_region_callback_t callback, void *user)
+{
+    // only the fields the caller knows about are taken from its options
+    wavsplit_options_t options;
+    wavsplit_options_init(&options);
+    if (user_options)
+        memcpy(&options, user_options, user_options->size < sizeof(options) ? user_options->size : sizeof(options));
+
+    const wavsplit_allocator_t &allocator = options.allocator ? *options.allocator : default_allocator;
+
+    try
+    {
+        WAVsplitter splitter;
+
+        // every payload stays where it is, regions are read from the file or buffer on demand
+        splitter.set_max_buffered(0);
+        splitter.set_auto_split(options.auto_split != 0);
+
+        silence_options_t silence;
+        silence.threshold_db = options.silence_threshold_db;
+        silence.min_silence = options.silence_min_duration;
+        splitter.set_silence_options(silence);
+
+        RIFF_file_streambuf_t stream_buffer(file);
+        std::istream f(&stream_buffer);
+        splitter.open(f, file);
+
+        const WAV_t &source = splitter.get_source();
+        const RIFF_chunk_data_t *data = dynamic_cast<const RIFF_chunk_data_t *>(source.get_riff().get_chunk_with_id("data"));
+        uint64_t payload = data->get_offset() + 8;
+        uint32_t block_align = source.header.block_align;
+
+        // payloads are skipped while parsing, make sure the samples are really there
+        uint8_t last;
+        if (data->size() > 0 && file->read_some(payload + data->size() - 1, &last, 1) != 1)
+            throw std::runtime_error("Unexpected end of RIFF data.");
+
+        region_buffer_t buffer(allocator);
+        uint32_t index{0};
+        for (auto &i : splitter.get_splits())
+        {
+            std::vector<uint8_t> header = splitter.get_header(i);
+            std::string name = i.file_name + ".wav";
+
+            uint64_t offset = static_cast<uint64_t>(i.byte_offset) * block_align;
+            size_t size = static_cast<size_t>(i.byte_length) * block_align;
+
+            // a span past the payload would point outside the buffer
+            if (offset + size > static_cast<uint64_t>(data->size()))
+                throw std::runtime_error("Requested frames exceed the 'data' chunk.");
+
+            const uint8_t *bytes;
+            if (file->memory())
+            {
+                bytes = file->memory() + payload + offset;
+            }
+            else
+            {
+                uint8_t *dst = buffer.reserve(size);
+                data->read_data(offset, size, dst);
+                bytes = dst;
+            }
+
+            wavsplit_region_t region{};
+            region.name = name.c_str();
+            region.index = index++;
+            region.frame_offset = i.byte_offset;
+            region.frames = i.byte_length;
+            region.header = header.data();
+            region.header_size = header.size();
+            region.data = bytes;
+            region.data_size = size;
+            region.padding = size % 2;
+
+            if (callback(user, &region) != 0)
+                return WAVSPLIT_STOPPED;
+        }
+    }
+    catch (const std::bad_alloc &)
+    {
+        last_error = "Out of memory.";
+        return WAVSPLIT_ERROR_ALLOCATION;
+    }
+    catch (const std::exception &e)
+    {
+        last_error = e.what();
+        return WAVSPLIT_ERROR;
+    }
+
+    return WAVSPLIT_OK;
+}
+
+void wavsplit_options_init(wavsplit_options_t *options)
+{
+    silence_options_t silence;
+
+    memset(options, 0, sizeof(*options));
+    options->size = sizeof(*options);
+    options->silence_threshold_db = silence.threshold_db;
+    options->silence_min_duration = silence.min_silence;
+}
+
+int wavsplit_split_fd(int fd, const wavsplit_options_t *options, wavsplit_region_callback_t callback, void *user)
+{
+    last_error.clear();
+    if (!callback || lseek(fd, 0, SEEK_CUR) < 0)
+    {
+        last_error = callback ? "The descriptor is not a seekable file." : "No callback given.";
+        return WAVSPLIT_ERROR_ARGUMENT;
+    }
+
+    // a duplicate so the caller keeps ownership of fd
+    int own = dup(fd);
+    if (own < 0)
+    {
+        last_error = "Unable to duplicate the descriptor.";
+        return WAVSPLIT_ERROR;
+    }
+
+    return split_file(std::make_shared<RIFF_file_t>(own), options, callback, user);
+}
+
+int wavsplit_split_memory(const void *buffer, size_t size, const wavsplit_options_t *options,
+                          wavsplit_region_callback_t callback, void *user)
+{
+    last_error.clear();
+    if (!callback || (!buffer && size > 0))
+    {
+        last_error = callback ? "No buffer given." : "No callback given.";
+        return WAVSPLIT_ERROR_ARGUMENT;
+    }
+
+    std::shared_ptr<RIFF_file_t> file = std::make_shared<RIFF_file_t>(static_cast<const uint8_t *>(buffer), size);
+    return split_file(file, options, callback, user);
+}
+
+const char *wavsplit_last_error(void)
+{
+    return last_error.c_str();
+}
+
+int wavsplit_api_version(void)
+{
+    return WAVSPLIT_API_VERSION;
+}
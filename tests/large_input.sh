@@ -0,0 +1,40 @@
+#!/bin/sh
+# Splits a 3 GiB input, whose 'data' chunk is past the signed 32 bit range, and checks the frame counts of the
+# plan and of the last split against what wavgen wrote. Run by `make large-test` with the apps directory as $1.
+# The input is sparse and the split goes through a pipe, so it needs little disk space.
+set -e
+
+apps=${1:-./build/apps}
+dir=$(mktemp -d "${TMPDIR:-/tmp}/wavsplit-large-XXXXXX")
+trap 'rm -rf "$dir"' EXIT
+
+fail() {
+    echo "large_input: $*" >&2
+    exit 1
+}
+
+# wavgen reports "big.wav: N frames, 2 channels, ..." on stderr
+frames=$("$apps/wavgen" "$dir/big.wav" --size 3G --cues 4 --signal silence 2>&1 | sed -n 's/^[^:]*: \([0-9]*\) frames.*/\1/p')
+[ -n "$frames" ] || fail "wavgen didn't report its frame count"
+
+"$apps/wavsplit" --plan "$dir/plan.json" "$dir/big.wav"
+
+source_frames=$(sed -n 's/^ *"source_frames": \([0-9]*\),$/\1/p' "$dir/plan.json")
+[ "$source_frames" = "$frames" ] || fail "plan has $source_frames source frames, wavgen wrote $frames"
+
+# the regions are one per line, their frames must add up to the whole input
+region_frames=$(sed -n 's/.*"index": [0-9]*, .*"frames": \([0-9]*\), .*/\1/p' "$dir/plan.json")
+total=0
+for i in $region_frames; do
+    total=$((total + i))
+done
+[ "$total" = "$frames" ] || fail "plan regions have $total frames, wavgen wrote $frames"
+
+# the last region starts past 2 GiB, write only it and count its frames from the archive member's size
+last=$(echo "$region_frames" | tail -n 1)
+grep -v '"index": [0-2],' "$dir/plan.json" > "$dir/last.json"
+size=$("$apps/wavsplit" --plan-in "$dir/last.json" -t - "$dir/big.wav" | tar tvf - | awk '{ print $3 }')
+[ -n "$size" ] || fail "the last region wasn't written"
+[ $(((size - 44) / 4)) = "$last" ] || fail "the last split has $(((size - 44) / 4)) frames, the plan $last"
+
+echo "large_input: $frames frames, last split $last frames"
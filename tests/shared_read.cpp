@@ -0,0 +1,127 @@
+#include "WAVparser.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/*
+ * Several threads read one parsed WAV_t through its const members, once with every payload in memory and once
+ * with the 'data' payload left on disk. Built and run by `make tsan-test`, which fails on any data race
+ * ThreadSanitizer reports, or on a read returning other bytes than a single thread does.
+ */
+
+static const unsigned threads = 8;
+static const unsigned reads = 200;
+static const uint32_t frames = 100000;
+
+static void put32(std::vector<uint8_t> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back(value >> (i * 8));
+}
+
+static void put_chunk(std::vector<uint8_t> &out, const char *id, const std::vector<uint8_t> &payload)
+{
+    out.insert(out.end(), id, id + 4);
+    put32(out, payload.size());
+    out.insert(out.end(), payload.begin(), payload.end());
+    if (payload.size() % 2)
+        out.push_back(0);
+}
+
+// 16 bit stereo with a sample pattern that differs at every position, three cue points and a label after 'data'
+static std::string write_input()
+{
+    std::vector<uint8_t> fmt;
+    put32(fmt, 0x00020001);
+    put32(fmt, 44100);
+    put32(fmt, 44100 * 4);
+    put32(fmt, 0x00100004);
+
+    std::vector<uint8_t> data(static_cast<size_t>(frames) * 4);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = i * 2654435761u >> 24;
+
+    std::vector<uint8_t> cue;
+    put32(cue, 3);
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        put32(cue, i + 1);
+        put32(cue, 0);
+        cue.insert(cue.end(), {'d', 'a', 't', 'a'});
+        put32(cue, 0);
+        put32(cue, 0);
+        put32(cue, i * frames / 3);
+    }
+
+    std::vector<uint8_t> labl;
+    put32(labl, 1);
+    labl.insert(labl.end(), {'f', 'i', 'r', 's', 't', 0});
+    std::vector<uint8_t> adtl{'a', 'd', 't', 'l'};
+    put_chunk(adtl, "labl", labl);
+
+    std::vector<uint8_t> wave{'W', 'A', 'V', 'E'};
+    put_chunk(wave, "fmt ", fmt);
+    put_chunk(wave, "data", data);
+    put_chunk(wave, "cue ", cue);
+    put_chunk(wave, "LIST", adtl);
+
+    std::vector<uint8_t> riff;
+    put_chunk(riff, "RIFF", wave);
+
+    char path[] = "/tmp/wavsplit-shared-read-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, riff.data(), riff.size()) != static_cast<ssize_t>(riff.size()) || close(fd) != 0)
+    {
+        perror("shared_read: writing the input");
+        exit(1);
+    }
+    return path;
+}
+
+static unsigned check(const std::string &path, uint32_t max_buffered)
+{
+    const WAV_t wav(path, max_buffered);
+    const std::vector<uint8_t> expected = wav.read_frames(0, wav.frames());
+    const uint64_t total_size = wav.get_riff().total_size();
+
+    std::atomic<unsigned> failures{0};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]() {
+            for (unsigned k = 0; k < reads; k++)
+            {
+                uint32_t offset = (k * 7919 + t * 131) % wav.frames();
+                uint32_t count = std::min<uint32_t>(wav.frames() - offset, 1000);
+                std::vector<uint8_t> bytes = wav.read_frames(offset, count);
+                if (memcmp(bytes.data(), expected.data() + static_cast<size_t>(offset) * wav.header.block_align, bytes.size()) != 0)
+                    failures++;
+
+                const RIFF_t &riff = wav.get_riff();
+                if (riff.total_size() != total_size || !riff.exists_chunk_with_id("cue ") ||
+                    riff.get_root_chunk().get_subchunks().size() != 4 || wav.sample_size() != 2)
+                    failures++;
+            }
+        });
+    }
+    for (auto &i : workers)
+        i.join();
+
+    printf("max_buffered %u: %u failed reads\n", max_buffered, failures.load());
+    return failures;
+}
+
+int main()
+{
+    std::string path = write_input();
+
+    unsigned failures = check(path, UINT32_MAX) + check(path, 0);
+    unlink(path.c_str());
+
+    return failures == 0 ? 0 : 1;
+}
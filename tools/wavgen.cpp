@@ -0,0 +1,416 @@
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// wavgen: writes synthetic WAV files of any shape wavsplit has to cope with, as fast as the disk takes them
+
+static int usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [options] output.wav\n"
+              << "  --frames N                sample frames in the 'data' chunk (default one minute)\n"
+              << "  --duration SEC            the same in seconds\n"
+              << "  --size SIZE               the same as a 'data' payload size (K, M or G suffix), up to 4G\n"
+              << "  --rate HZ                 sample rate (default 44100)\n"
+              << "  --channels N              channels per frame (default 2)\n"
+              << "  --bits 8|16|24|32         bits per sample (default 16)\n"
+              << "  --float                   32 bit IEEE float samples\n"
+              << "  --extensible              write a WAVE_FORMAT_EXTENSIBLE 'fmt ' chunk\n"
+              << "  --signal sine|noise|silence\n"
+              << "                            sample content (default sine), silence leaves a sparse hole on disk\n"
+              << "  --cues N                  N evenly spaced cue points\n"
+              << "  --labels                  a 'labl' name for every cue point in a LIST 'adtl' chunk\n"
+              << "  --duplicate-names K       labels repeat after K distinct names\n"
+              << "  --odd-chunks N            N unknown chunks of odd sizes, each followed by its pad byte\n"
+              << "  --nest N                  a LIST chunk nested N deep\n"
+              << "  --metadata-first          put the cue, LIST and unknown chunks in front of 'data' instead of after it\n"
+              << "  --seed N                  seed for noise and chunk contents (default 1)"
+              << std::endl;
+    return 1;
+}
+
+// a byte count with an optional K, M or G suffix
+static uint64_t parse_size(const std::string &size)
+{
+    char *end;
+    double value = strtod(size.c_str(), &end);
+    switch (toupper(*end))
+    {
+    case 'G':
+        value *= 1024;
+        [[fallthrough]];
+    case 'M':
+        value *= 1024;
+        [[fallthrough]];
+    case 'K':
+        value *= 1024;
+    }
+    return value;
+}
+
+struct options_t
+{
+    uint64_t frames{0};
+    double duration{60};
+    uint64_t size{0};
+    uint32_t rate{44100};
+    uint16_t channels{2};
+    uint16_t bits{16};
+    bool is_float{false};
+    bool extensible{false};
+    std::string signal{"sine"};
+    uint32_t cues{0};
+    bool labels{false};
+    uint32_t duplicate_names{0};
+    uint32_t odd_chunks{0};
+    uint32_t nest{0};
+    bool metadata_first{false};
+    uint32_t seed{1};
+};
+
+// little endian chunk payloads
+class chunk_writer_t
+{
+private:
+    std::vector<uint8_t> m_bytes;
+
+public:
+    void u16(uint16_t v)
+    {
+        m_bytes.push_back(v & 0xff);
+        m_bytes.push_back(v >> 8);
+    }
+
+    void u32(uint32_t v)
+    {
+        u16(v & 0xffff);
+        u16(v >> 16);
+    }
+
+    void id(const char *id)
+    {
+        m_bytes.insert(m_bytes.end(), id, id + 4);
+    }
+
+    void bytes(const void *data, size_t size)
+    {
+        const uint8_t *b = static_cast<const uint8_t *>(data);
+        m_bytes.insert(m_bytes.end(), b, b + size);
+    }
+
+    // a complete chunk with its pad byte
+    void chunk(const char *chunk_id, const std::vector<uint8_t> &payload)
+    {
+        id(chunk_id);
+        u32(payload.size());
+        bytes(payload.data(), payload.size());
+        if (payload.size() % 2)
+            m_bytes.push_back(0);
+    }
+
+    std::vector<uint8_t> &get()
+    {
+        return m_bytes;
+    }
+};
+
+static std::vector<uint8_t> fmt_chunk(const options_t &o)
+{
+    uint16_t container = o.bits / 8;
+    chunk_writer_t w;
+
+    // 3 == WAVE_FORMAT_IEEE_FLOAT, 1 == WAVE_FORMAT_PCM
+    w.u16(o.extensible ? 0xFFFE : (o.is_float ? 3 : 1));
+    w.u16(o.channels);
+    w.u32(o.rate);
+    w.u32(o.rate * o.channels * container);
+    w.u16(o.channels * container);
+    w.u16(o.bits);
+
+    if (o.extensible)
+    {
+        // valid bits, one speaker per channel as far as there are speakers, the format GUID
+        static const uint8_t guid_tail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+        w.u16(22);
+        w.u16(o.bits);
+        w.u32(o.channels <= 18 ? (1u << o.channels) - 1 : 0);
+        w.u16(o.is_float ? 3 : 1);
+        w.bytes(guid_tail, sizeof(guid_tail));
+    }
+
+    chunk_writer_t chunk;
+    chunk.chunk("fmt ", w.get());
+    return chunk.get();
+}
+
+// the cue, LIST and unknown chunks
+static std::vector<uint8_t> metadata_chunks(const options_t &o, uint64_t frames, std::mt19937 &random)
+{
+    chunk_writer_t out;
+
+    if (o.cues)
+    {
+        chunk_writer_t cue;
+        cue.u32(o.cues);
+        for (uint32_t i = 0; i < o.cues; i++)
+        {
+            uint32_t position = frames * i / o.cues;
+            cue.u32(i + 1);
+            cue.u32(position);
+            cue.id("data");
+            cue.u32(0);
+            cue.u32(0);
+            cue.u32(position);
+        }
+        out.chunk("cue ", cue.get());
+    }
+
+    if (o.cues && o.labels)
+    {
+        chunk_writer_t adtl;
+        adtl.id("adtl");
+        for (uint32_t i = 0; i < o.cues; i++)
+        {
+            std::string name = "label_" + std::to_string(o.duplicate_names ? i % o.duplicate_names : i);
+
+            chunk_writer_t labl;
+            labl.u32(i + 1);
+            labl.bytes(name.c_str(), name.size() + 1);
+            adtl.chunk("labl", labl.get());
+        }
+        out.chunk("LIST", adtl.get());
+    }
+
+    for (uint32_t i = 0; i < o.odd_chunks; i++)
+    {
+        char id[8];
+        snprintf(id, sizeof(id), "x%03u", i % 1000);
+
+        std::vector<uint8_t> payload(1 + 2 * (random() % 512));
+        for (auto &b : payload)
+            b = random();
+        out.chunk(id, payload);
+    }
+
+    if (o.nest)
+    {
+        // built from the inside out, the innermost list holds a comment of odd length
+        chunk_writer_t inner;
+        inner.id("INFO");
+        std::string comment = "nested " + std::to_string(o.nest) + " deep";
+        std::vector<uint8_t> text(comment.begin(), comment.end());
+        text.push_back(0);
+        if (text.size() % 2 == 0)
+            text.push_back(0);
+        inner.chunk("ICMT", text);
+
+        std::vector<uint8_t> list = inner.get();
+        for (uint32_t depth = 1; depth < o.nest; depth++)
+        {
+            chunk_writer_t outer;
+            outer.id("nest");
+            outer.chunk("LIST", list);
+            list = outer.get();
+        }
+        out.chunk("LIST", list);
+    }
+
+    return out.get();
+}
+
+// one block of frames repeated over the whole 'data' chunk, with a whole number of sine periods so the seams are smooth
+static std::vector<uint8_t> signal_block(const options_t &o, uint32_t block_frames, std::mt19937 &random)
+{
+    uint16_t container = o.bits / 8;
+    std::vector<uint8_t> block(static_cast<size_t>(block_frames) * o.channels * container);
+
+    // 440 Hz and its harmonics, a different one per channel so mixes and selections can be told apart
+    std::vector<double> periods(o.channels);
+    for (uint16_t c = 0; c < o.channels; c++)
+        periods[c] = std::max<double>(1, llround(440.0 * (c + 1) * block_frames / o.rate));
+
+    for (uint32_t f = 0; f < block_frames; f++)
+    {
+        for (uint16_t c = 0; c < o.channels; c++)
+        {
+            double v;
+            if (o.signal == "noise")
+                v = std::uniform_real_distribution<double>(-1, 1)(random);
+            else if (o.signal == "sine")
+                v = 0.5 * sin(2 * M_PI * periods[c] * f / block_frames);
+            else
+                v = 0;
+
+            uint8_t *sample = &block[(static_cast<size_t>(f) * o.channels + c) * container];
+            if (o.is_float)
+            {
+                float s = v;
+                memcpy(sample, &s, 4);
+                continue;
+            }
+
+            double full = ldexp(1.0, o.bits - 1);
+            int64_t s = std::min<int64_t>(llround(v * full), full - 1);
+            if (o.bits == 8)
+                s += 128;
+            for (uint16_t b = 0; b < container; b++)
+                sample[b] = (s >> (8 * b)) & 0xff;
+        }
+    }
+    return block;
+}
+
+static void write_at(int fd, const uint8_t *data, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t n = pwrite(fd, data, size, offset);
+        if (n < 0)
+            throw std::runtime_error(std::string("Unable to write: ") + strerror(errno));
+        data += n;
+        size -= n;
+        offset += n;
+    }
+}
+
+static void generate(const std::string &filename, const options_t &o)
+{
+    if (o.is_float ? o.bits != 32 : (o.bits % 8 || o.bits < 8 || o.bits > 32))
+        throw std::runtime_error("Unsupported bits per sample.");
+    if (o.channels == 0 || o.rate == 0)
+        throw std::runtime_error("A WAV file needs at least one channel and a sample rate.");
+
+    uint32_t block_align = o.channels * (o.bits / 8);
+    uint64_t frames = o.frames;
+    if (o.size)
+        frames = o.size / block_align;
+    else if (!frames)
+        frames = llround(o.duration * o.rate);
+
+    std::mt19937 random(o.seed);
+    std::vector<uint8_t> fmt = fmt_chunk(o);
+    std::vector<uint8_t> metadata = metadata_chunks(o, frames, random);
+
+    uint64_t data_size = frames * block_align;
+    uint64_t riff_size = 4 + fmt.size() + metadata.size() + 8 + data_size + data_size % 2;
+    if (riff_size > UINT32_MAX)
+        throw std::runtime_error("The file would be larger than the 4 GiB a RIFF file can hold.");
+
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("Unable to open " + filename + ": " + strerror(errno));
+
+    chunk_writer_t head;
+    head.id("RIFF");
+    head.u32(riff_size);
+    head.id("WAVE");
+    head.bytes(fmt.data(), fmt.size());
+    if (o.metadata_first)
+        head.bytes(metadata.data(), metadata.size());
+    head.id("data");
+    head.u32(data_size);
+    write_at(fd, head.get().data(), head.get().size(), 0);
+
+    uint64_t data_offset = head.get().size();
+    uint64_t end = data_offset + data_size + data_size % 2;
+
+    // digital silence is all zero bytes (but for unsigned 8 bit), the file system keeps it as a hole
+    bool sparse = o.signal == "silence" && o.bits != 8;
+    if (!sparse)
+    {
+        uint32_t block_frames = std::max<uint32_t>((1 << 20) / block_align, 1);
+        std::vector<uint8_t> block = signal_block(o, block_frames, random);
+        for (uint64_t offset = 0; offset < data_size;)
+        {
+            size_t n = std::min<uint64_t>(block.size(), data_size - offset);
+            write_at(fd, block.data(), n, data_offset + offset);
+            offset += n;
+        }
+    }
+
+    if (!o.metadata_first)
+    {
+        write_at(fd, metadata.data(), metadata.size(), end);
+        end += metadata.size();
+    }
+
+    // also extends the file over a trailing hole and the pad byte
+    if (ftruncate(fd, end) != 0 || close(fd) != 0)
+        throw std::runtime_error("Unable to write " + filename + ": " + strerror(errno));
+
+    std::cerr << filename << ": " << frames << " frames, " << o.channels << " channels, " << o.bits << " bit, "
+              << o.cues << " cues, " << end << " bytes" << (sparse ? " (sparse)" : "") << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    options_t o;
+    std::string output;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            o.frames = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+            o.duration = atof(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+            o.size = parse_size(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+            o.rate = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc)
+            o.channels = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bits") == 0 && i + 1 < argc)
+            o.bits = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--float") == 0)
+        {
+            o.is_float = true;
+            o.bits = 32;
+        }
+        else if (strcmp(argv[i], "--extensible") == 0)
+            o.extensible = true;
+        else if (strcmp(argv[i], "--signal") == 0 && i + 1 < argc)
+            o.signal = argv[++i];
+        else if (strcmp(argv[i], "--cues") == 0 && i + 1 < argc)
+            o.cues = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--labels") == 0)
+            o.labels = true;
+        else if (strcmp(argv[i], "--duplicate-names") == 0 && i + 1 < argc)
+            o.duplicate_names = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--odd-chunks") == 0 && i + 1 < argc)
+            o.odd_chunks = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--nest") == 0 && i + 1 < argc)
+            o.nest = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--metadata-first") == 0)
+            o.metadata_first = true;
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            o.seed = strtoul(argv[++i], nullptr, 10);
+        else if (output.empty() && argv[i][0] != '-')
+            output = argv[i];
+        else
+            return usage(argv[0]);
+    }
+
+    if (output.empty() || (o.signal != "sine" && o.signal != "noise" && o.signal != "silence"))
+        return usage(argv[0]);
+
+    try
+    {
+        generate(output, o);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}